@@ -65,6 +65,46 @@ read_uint64(FILE *stream, uint64_t *value)
     return true;
 }
 
+bool
+read_uvarint32(FILE *stream, uint32_t *value)
+{
+    uint32_t result = 0;
+    unsigned shift = 0;
+    int      byte;
+
+    do {
+        byte = getc(stream);
+        if (byte == EOF) {
+            return false;
+        }
+        if ((shift == 28) && (byte & 0x70)) {
+            // The value doesn't fit in 32 bits.
+            return false;
+        }
+        result |= ((uint32_t)(byte & 0x7F)) << shift;
+        shift += 7;
+    } while ((byte & 0x80) && (shift < 35));
+
+    if (byte & 0x80) {
+        return false;
+    }
+
+    *value = result;
+    return true;
+}
+
+bool
+read_svarint32(FILE *stream, int32_t *value)
+{
+    uint32_t zigzag;
+
+    if (!read_uvarint32(stream, &zigzag)) {
+        return false;
+    }
+    *value = (int32_t)((zigzag >> 1) ^ ((uint32_t)0 - (zigzag & 1)));
+    return true;
+}
+
 char *
 read_len_string(FILE *stream)
 {
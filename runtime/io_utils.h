@@ -39,6 +39,22 @@ read_uint32(FILE *stream, uint32_t *value);
 bool
 read_uint64(FILE *stream, uint64_t *value);
 
+/*
+ * Read a variable length (LEB128) unsigned integer that must fit within 32
+ * bits.  Encodings longer than 5 bytes or whose value does not fit are
+ * treated as errors.
+ */
+bool
+read_uvarint32(FILE *stream, uint32_t *value);
+
+/*
+ * Read a zigzag encoded signed integer that must fit within 32 bits.  It's
+ * written as the varint of 0, -1, 1, -2, 2, ... mapped to 0, 1, 2, 3, 4,
+ * ..., so values near zero take a single byte whatever their sign.
+ */
+bool
+read_svarint32(FILE *stream, int32_t *value);
+
 /*
  * Read a length (16 bits) followed by a string of that length.
  */
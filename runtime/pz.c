@@ -11,7 +11,8 @@
 #include "pz.h"
 #include "pz_code.h"
 #include "pz_data.h"
-#include "pz_radix_tree.h"
+#include "pz_hash_table.h"
+#include "pz_segment.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -20,8 +21,8 @@
  * PZ Programs
  *************/
 
-struct PZ_Struct {
-    PZ_RadixTree *modules;
+struct PZ_Program_Struct {
+    PZ_HashTable *modules;
     PZ_Module    *entry_module;
 };
 
@@ -32,7 +33,7 @@ pz_init(void)
 
     pz = malloc(sizeof(PZ));
 
-    pz->modules = pz_radix_init();
+    pz->modules = pz_hash_init();
     pz->entry_module = NULL;
 
     return pz;
@@ -41,7 +42,7 @@ pz_init(void)
 void
 pz_free(PZ *pz)
 {
-    pz_radix_free(pz->modules, (free_fn)pz_module_free);
+    pz_hash_free(pz->modules, (free_fn)pz_module_free);
     if (NULL != pz->entry_module) {
         pz_module_free(pz->entry_module);
     }
@@ -51,13 +52,13 @@ pz_free(PZ *pz)
 void
 pz_add_module(PZ *pz, const char *name, PZ_Module *module)
 {
-    pz_radix_insert(pz->modules, name, module);
+    pz_hash_insert(pz->modules, name, module);
 }
 
-PZ_Module *
-pz_get_module(PZ *pz, const char *name)
+const PZ_Module *
+pz_get_module(const PZ *pz, const char *name)
 {
-    return pz_radix_lookup(pz->modules, name);
+    return pz_hash_lookup(pz->modules, name);
 }
 
 void
@@ -68,8 +69,8 @@ pz_add_entry_module(PZ *pz, PZ_Module *module)
     pz->entry_module = module;
 }
 
-PZ_Module *
-pz_get_entry_module(PZ *pz)
+const PZ_Module *
+pz_get_entry_module(const PZ *pz)
 {
     return pz->entry_module;
 }
@@ -79,6 +80,7 @@ pz_get_entry_module(PZ *pz)
  ************/
 
 struct PZ_Module_Struct {
+    char       *name;
     unsigned    num_structs;
     PZ_Struct  *structs;
     unsigned    num_datas;
@@ -86,8 +88,15 @@ struct PZ_Module_Struct {
     PZ_Proc   **procs;
     unsigned    num_procs;
     unsigned    total_code_size;
+    void       *code_mapping;
+    size_t      code_mapping_size;
+    void       *data_mapping;
+    size_t      data_mapping_size;
 
-    PZ_RadixTree *symbols;
+    PZ_HashTable   *symbols;
+    PZ_Proc_Symbol *exports;
+    unsigned        num_exports;
+    unsigned        max_exports;
 
     // TODO: Move this field to PZ
     int32_t entry_proc;
@@ -97,11 +106,13 @@ PZ_Module *
 pz_module_init(unsigned num_structs,
                unsigned num_data,
                unsigned num_procs,
+               unsigned num_exports,
                unsigned entry_proc)
 {
     PZ_Module *module;
 
     module = malloc(sizeof(PZ_Module));
+    module->name = NULL;
     module->num_structs = num_structs;
     if (num_structs > 0) {
         module->structs = malloc(sizeof(PZ_Struct) * num_structs);
@@ -126,8 +137,19 @@ pz_module_init(unsigned num_structs,
     }
     module->num_procs = num_procs;
     module->total_code_size = 0;
+    module->code_mapping = NULL;
+    module->code_mapping_size = 0;
+    module->data_mapping = NULL;
+    module->data_mapping_size = 0;
 
     module->symbols = NULL;
+    if (num_exports > 0) {
+        module->exports = malloc(sizeof(PZ_Proc_Symbol) * num_exports);
+    } else {
+        module->exports = NULL;
+    }
+    module->num_exports = 0;
+    module->max_exports = num_exports;
     module->entry_proc = entry_proc;
 
     return module;
@@ -146,11 +168,6 @@ pz_module_free(PZ_Module *module)
     }
 
     if (module->data != NULL) {
-        for (unsigned i = 0; i < module->num_datas; i++) {
-            if (module->data[i] != NULL) {
-                pz_data_free(module->data[i]);
-            }
-        }
         free(module->data);
     }
 
@@ -164,12 +181,38 @@ pz_module_free(PZ_Module *module)
         free(module->procs);
     }
 
+    if (module->code_mapping != NULL) {
+        pz_segment_free(module->code_mapping, module->code_mapping_size);
+    }
+    if (module->data_mapping != NULL) {
+        pz_segment_free(module->data_mapping, module->data_mapping_size);
+    }
+
     if (module->symbols != NULL) {
-        pz_radix_free(module->symbols, pz_proc_symbol_free);
+        pz_hash_free(module->symbols, pz_proc_symbol_free);
+    }
+    if (module->exports != NULL) {
+        free(module->exports);
+    }
+    if (module->name != NULL) {
+        free(module->name);
     }
     free(module);
 }
 
+void
+pz_module_set_name(PZ_Module *module, const char *name)
+{
+    assert(NULL == module->name);
+    module->name = strdup(name);
+}
+
+const char *
+pz_module_get_name(PZ_Module *module)
+{
+    return module->name;
+}
+
 PZ_Struct *
 pz_module_get_struct(PZ_Module *module, unsigned id)
 {
@@ -202,8 +245,42 @@ pz_module_get_proc(PZ_Module *module, unsigned id)
     return module->procs[id];
 }
 
+unsigned
+pz_module_get_num_procs(PZ_Module *module)
+{
+    return module->num_procs;
+}
+
+unsigned
+pz_module_get_num_datas(PZ_Module *module)
+{
+    return module->num_datas;
+}
+
+unsigned
+pz_module_get_num_structs(PZ_Module *module)
+{
+    return module->num_structs;
+}
+
+void
+pz_module_set_code_mapping(PZ_Module *module, void *addr, size_t size)
+{
+    assert(NULL == module->code_mapping);
+    module->code_mapping = addr;
+    module->code_mapping_size = size;
+}
+
+void
+pz_module_set_data_mapping(PZ_Module *module, void *addr, size_t size)
+{
+    assert(NULL == module->data_mapping);
+    module->data_mapping = addr;
+    module->data_mapping_size = size;
+}
+
 int32_t
-pz_module_get_entry_proc(PZ_Module *module)
+pz_module_get_entry_proc(const PZ_Module *module)
 {
     return module->entry_proc;
 }
@@ -214,24 +291,48 @@ pz_module_add_proc_symbol(PZ_Module      *module,
                           PZ_Proc_Symbol *proc)
 {
     if (NULL == module->symbols) {
-        module->symbols = pz_radix_init();
+        module->symbols = pz_hash_init();
     }
 
-    pz_radix_insert(module->symbols, name, proc);
+    pz_hash_insert(module->symbols, name, proc);
 }
 
 PZ_Proc_Symbol *
-pz_module_lookup_proc(PZ_Module *module, const char *name)
+pz_module_lookup_proc(const PZ_Module *module, const char *name)
 {
     if (NULL == module->symbols) {
         return NULL;
     } else {
-        return pz_radix_lookup(module->symbols, name);
+        return pz_hash_lookup(module->symbols, name);
+    }
+}
+
+bool
+pz_module_export_proc(PZ_Module *module, const char *name, unsigned id)
+{
+    PZ_Proc_Symbol *symbol;
+
+    assert(module->num_exports < module->max_exports);
+
+    if (NULL != pz_module_lookup_proc(module, name)) {
+        return false;
     }
+
+    /*
+     * The symbols live in the module's exports array, need_free is false
+     * so that freeing the symbol table doesn't free them.
+     */
+    symbol = &(module->exports[module->num_exports++]);
+    symbol->type = PZ_BUILTIN_BYTECODE;
+    symbol->proc.bytecode = pz_module_get_proc_code(module, id);
+    symbol->need_free = false;
+    pz_module_add_proc_symbol(module, name, symbol);
+
+    return true;
 }
 
 uint8_t *
-pz_module_get_proc_code(PZ_Module *module, unsigned id)
+pz_module_get_proc_code(const PZ_Module *module, unsigned id)
 {
     assert(id < module->num_procs);
 
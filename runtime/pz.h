@@ -14,12 +14,15 @@
 #include "pz_code.h"
 #include "pz_data.h"
 
-typedef struct PZ_Struct PZ;
+typedef struct PZ_Program_Struct PZ;
 
 typedef struct PZ_Module_Struct PZ_Module;
 
 /*
  * PZ Programs
+ *
+ * Once loaded a program is not modified, the functions that take a const
+ * PZ or PZ_Module may be called from any number of threads at once.
  *************/
 
 PZ *
@@ -39,14 +42,14 @@ pz_free(PZ *pz);
 void
 pz_add_module(PZ *pz, const char *name, PZ_Module *module);
 
-PZ_Module *
-pz_get_module(PZ *pz, const char *name);
+const PZ_Module *
+pz_get_module(const PZ *pz, const char *name);
 
 void
 pz_add_entry_module(PZ *pz, PZ_Module *module);
 
-PZ_Module *
-pz_get_entry_module(PZ *pz);
+const PZ_Module *
+pz_get_entry_module(const PZ *pz);
 
 /*
  * PZ Modules
@@ -56,11 +59,21 @@ PZ_Module *
 pz_module_init(unsigned num_structs,
                unsigned num_data,
                unsigned num_procs,
+               unsigned num_exports,
                unsigned entry_proc);
 
 void
 pz_module_free(PZ_Module *module);
 
+/*
+ * The module's name is strdup'd.
+ */
+void
+pz_module_set_name(PZ_Module *module, const char *name);
+
+const char *
+pz_module_get_name(PZ_Module *module);
+
 PZ_Struct *
 pz_module_get_struct(PZ_Module *module, unsigned struct_id);
 
@@ -76,8 +89,27 @@ pz_module_set_proc(PZ_Module *module, unsigned id, PZ_Proc *proc);
 PZ_Proc *
 pz_module_get_proc(PZ_Module *module, unsigned id);
 
+unsigned
+pz_module_get_num_procs(PZ_Module *module);
+
+unsigned
+pz_module_get_num_datas(PZ_Module *module);
+
+unsigned
+pz_module_get_num_structs(PZ_Module *module);
+
+/*
+ * Give the module ownership of the memory mappings holding its code and
+ * data, they will be unmapped when the module is freed.
+ */
+void
+pz_module_set_code_mapping(PZ_Module *module, void *addr, size_t size);
+
+void
+pz_module_set_data_mapping(PZ_Module *module, void *addr, size_t size);
+
 int32_t
-pz_module_get_entry_proc(PZ_Module *module);
+pz_module_get_entry_proc(const PZ_Module *module);
 
 void
 pz_module_add_proc_symbol(PZ_Module      *module,
@@ -85,13 +117,22 @@ pz_module_add_proc_symbol(PZ_Module      *module,
                           PZ_Proc_Symbol *proc);
 
 PZ_Proc_Symbol *
-pz_module_lookup_proc(PZ_Module *module, const char *name);
+pz_module_lookup_proc(const PZ_Module *module, const char *name);
+
+/*
+ * Export the procedure with the given ID so that other modules may import
+ * it by name.  The procedure's code must have been set, and the module can
+ * export at most num_exports procedures.  Returns false if the name is
+ * already exported.
+ */
+bool
+pz_module_export_proc(PZ_Module *module, const char *name, unsigned id);
 
 /*
  * Return a pointer to the code for the procedure with the given ID.
  */
 uint8_t *
-pz_module_get_proc_code(PZ_Module *module, unsigned id);
+pz_module_get_proc_code(const PZ_Module *module, unsigned id);
 
 void
 pz_module_print_loaded_stats(PZ_Module *module);
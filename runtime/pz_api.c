@@ -0,0 +1,82 @@
+/*
+ * Plasma embedding API
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#include <stdio.h>
+
+#include "pz_common.h"
+
+#include "pz_api.h"
+#include "pz_builtin.h"
+#include "pz_read.h"
+
+PZ *
+pz_load(unsigned           num_files,
+        const char *const  files[],
+        const char        *cache_dir,
+        bool               verbose)
+{
+    PZ_Module *builtins;
+    PZ_Module *module;
+    PZ        *pz;
+
+    if (num_files == 0) {
+        fprintf(stderr, "No modules to load\n");
+        return NULL;
+    }
+
+    builtins = pz_setup_builtins();
+    pz = pz_init();
+    pz_add_module(pz, "builtin", builtins);
+
+    for (unsigned i = 0; i < num_files; i++) {
+        const char *name;
+
+        module = pz_read(pz, files[i], cache_dir, verbose);
+        if (module == NULL) goto error;
+
+        if (i + 1 == num_files) {
+            pz_add_entry_module(pz, module);
+        } else {
+            name = pz_module_get_name(module);
+            if (pz_get_module(pz, name) != NULL) {
+                fprintf(stderr, "%s: Duplicate module: %s\n", files[i],
+                        name);
+                pz_module_free(module);
+                goto error;
+            }
+            pz_add_module(pz, name, module);
+        }
+    }
+
+    return pz;
+
+error:
+    pz_free(pz);
+    return NULL;
+}
+
+uint8_t *
+pz_lookup_proc(const PZ *pz, const char *module_name, const char *name)
+{
+    const PZ_Module *module;
+    PZ_Proc_Symbol  *proc;
+
+    if (module_name == NULL) {
+        module = pz_get_entry_module(pz);
+    } else {
+        module = pz_get_module(pz, module_name);
+    }
+    if (module == NULL) return NULL;
+
+    proc = pz_module_lookup_proc(module, name);
+    if ((proc == NULL) || (proc->type != PZ_BUILTIN_BYTECODE)) {
+        return NULL;
+    }
+
+    return proc->proc.bytecode;
+}
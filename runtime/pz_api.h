@@ -0,0 +1,68 @@
+/*
+ * Plasma embedding API
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#ifndef PZ_API_H
+#define PZ_API_H
+
+/*
+ * This is the header for programs that embed Plasma by linking with
+ * libpz (runtime/libpz.a or runtime/libpz.so).  A program is loaded once
+ * and its exported procedures can then be called any number of times:
+ *
+ *   pz = pz_load(1, files, NULL, false);
+ *   proc = pz_lookup_proc(pz, NULL, "add");
+ *   context = pz_context_init();
+ *
+ *   pz_context_push_int(context, 2);
+ *   pz_context_push_int(context, 3);
+ *   pz_context_call(context, proc);
+ *   result = pz_context_pop_int(context);
+ *
+ * Each context may be used by only one thread at a time, a program may be
+ * shared by many contexts.  Objects the program allocates stay on the
+ * context's heap until pz_context_reset() is called.  See pz_run.h for the
+ * context functions.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pz_common.h"
+
+#include "pz.h"
+#include "pz_run.h"
+
+/*
+ * Load each module in order, a module may only import modules before it.
+ * The last module is the program's entry module, so there must be at
+ * least one.  Returns NULL after printing an error.  Free the program with
+ * pz_free().
+ *
+ * If cache_dir is non-NULL translated code is cached there, see
+ * pz_cache.h.
+ */
+PZ *
+pz_load(unsigned           num_files,
+        const char *const  files[],
+        const char        *cache_dir,
+        bool               verbose);
+
+/*
+ * Find the procedure exported with the given name by the module named
+ * module_name, or by the entry module if module_name is NULL.  Returns
+ * NULL if there is no such procedure or if it is a C builtin.
+ */
+uint8_t *
+pz_lookup_proc(const PZ *pz, const char *module_name, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ! PZ_API_H */
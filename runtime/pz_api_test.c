@@ -0,0 +1,126 @@
+/*
+ * Embedding API tests
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ *
+ * These tests use libpz's API the way an embedding program would, which
+ * pzrun doesn't.  "make test" runs them.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pz_common.h"
+
+#include "pz_api.h"
+
+static unsigned num_failures = 0;
+
+static void
+check_int(const char *test, int32_t result, int32_t expect)
+{
+    if (result != expect) {
+        fprintf(stderr, "%s: got %d, expected %d\n", test, (int)result,
+                (int)expect);
+        num_failures++;
+    }
+}
+
+/*
+ * The tests don't depend on pzasm, so they build their program in memory:
+ * a single module that exports add (w w - w).
+ */
+static unsigned
+make_add_instrs(uint8_t *code)
+{
+    unsigned        offset = 0;
+    Immediate_Value imm = {.word = 0 };
+
+    offset = pz_write_instr(code, offset, PZI_ADD, PZW_FAST, 0, IMT_NONE,
+                            imm);
+    offset = pz_write_instr(code, offset, PZI_RET, 0, 0, IMT_NONE, imm);
+
+    return offset;
+}
+
+static PZ *
+make_program(uint8_t **code)
+{
+    PZ        *pz;
+    PZ_Module *module;
+    unsigned   size;
+
+    size = make_add_instrs(NULL);
+    *code = malloc(size);
+    make_add_instrs(*code);
+
+    module = pz_module_init(0, 0, 1, 1, 0);
+    pz_module_set_name(module, "api_test");
+    pz_module_set_proc(module, 0, pz_proc_init(*code, size));
+    pz_module_export_proc(module, "add", 0);
+
+    pz = pz_init();
+    pz_add_entry_module(pz, module);
+    return pz;
+}
+
+/*
+ * Make several calls with arguments on one context, each call must leave
+ * the context ready for the next.
+ */
+static void
+test_repeated_calls(PZ *pz)
+{
+    PZ_Context *context = pz_context_init();
+    uint8_t    *add = pz_lookup_proc(pz, NULL, "add");
+
+    pz_context_push_int(context, 2);
+    pz_context_push_int(context, 3);
+    pz_context_call(context, add);
+    check_int("first call", pz_context_pop_int(context), 5);
+
+    pz_context_push_int(context, 4);
+    pz_context_push_int(context, 5);
+    pz_context_call(context, add);
+    check_int("second call", pz_context_pop_int(context), 9);
+
+    pz_context_free(context);
+}
+
+/*
+ * A program needs an entry module, so loading no files fails.
+ */
+static void
+test_load_no_files(void)
+{
+    PZ *pz = pz_load(0, NULL, NULL, false);
+
+    if (pz != NULL) {
+        fprintf(stderr, "load no files: got a program, expected NULL\n");
+        num_failures++;
+        pz_free(pz);
+    }
+}
+
+int
+main(int argc, char *const argv[])
+{
+    PZ      *pz;
+    uint8_t *code;
+
+    pz = make_program(&code);
+
+    test_repeated_calls(pz);
+    test_load_no_files();
+
+    pz_free(pz);
+    free(code);
+
+    if (num_failures > 0) {
+        fprintf(stderr, "%u API tests failed\n", num_failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
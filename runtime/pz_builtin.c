@@ -10,7 +10,6 @@
 
 #include "pz_builtin.h"
 #include "pz_code.h"
-#include "pz_radix_tree.h"
 #include "pz_run.h"
 #include "pz_util.h"
 
@@ -23,6 +22,18 @@ static PZ_Proc_Symbol builtin_print = {
     false
 };
 
+static PZ_Proc_Symbol builtin_flush = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_flush_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_print_int = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_print_int_func },
+    false
+};
+
 static PZ_Proc_Symbol builtin_int_to_string = {
     PZ_BUILTIN_C_FUNC,
     { .c_func = builtin_int_to_string_func },
@@ -53,12 +64,108 @@ static PZ_Proc_Symbol builtin_concat_string = {
     false
 };
 
+static PZ_Proc_Symbol builtin_intern = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_intern_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_string_equals = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_string_equals_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_string_compare = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_string_compare_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_string_starts_with = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_string_starts_with_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_string_find = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_string_find_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_string_split = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_string_split_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_string_count_byte = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_string_count_byte_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_string_is_utf8 = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_string_is_utf8_func },
+    false
+};
+
 static PZ_Proc_Symbol builtin_die = {
     PZ_BUILTIN_C_FUNC,
     { .c_func = builtin_die_func },
     false
 };
 
+static PZ_Proc_Symbol builtin_new_channel = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_new_channel_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_new_spsc_channel = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_new_spsc_channel_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_send = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_send_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_recv = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_recv_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_try_recv = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_try_recv_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_array_range = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_array_range_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_array_size = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_array_size_func },
+    false
+};
+
+static PZ_Proc_Symbol builtin_array_get = {
+    PZ_BUILTIN_C_FUNC,
+    { .c_func = builtin_array_get_func },
+    false
+};
+
 static unsigned
 builtin_make_tag_instrs(uint8_t *bytecode)
 {
@@ -221,6 +328,47 @@ builtin_unshift_value_instrs(uint8_t *bytecode)
     return offset;
 }
 
+static unsigned
+builtin_parallel_map_instrs(uint8_t *bytecode)
+{
+    unsigned        offset = 0;
+    Immediate_Value imm = {.word = 0 };
+
+    /*
+     * Start a job that calls the function for each element of the array,
+     * then run its chunks or wait for them until it's finished.
+     *
+     * func array - array
+     */
+    offset = pz_write_instr(bytecode, offset, PZI_PARALLEL_MAP,
+            0, 0, IMT_NONE, imm);
+    offset = pz_write_instr(bytecode, offset, PZI_PARALLEL_STEP,
+            0, 0, IMT_NONE, imm);
+    offset = pz_write_instr(bytecode, offset, PZI_RET,
+            0, 0, IMT_NONE, imm);
+
+    return offset;
+}
+
+static unsigned
+builtin_parallel_reduce_instrs(uint8_t *bytecode)
+{
+    unsigned        offset = 0;
+    Immediate_Value imm = {.word = 0 };
+
+    /*
+     * func array init - int
+     */
+    offset = pz_write_instr(bytecode, offset, PZI_PARALLEL_REDUCE,
+            0, 0, IMT_NONE, imm);
+    offset = pz_write_instr(bytecode, offset, PZI_PARALLEL_STEP,
+            0, 0, IMT_NONE, imm);
+    offset = pz_write_instr(bytecode, offset, PZI_RET,
+            0, 0, IMT_NONE, imm);
+
+    return offset;
+}
+
 PZ_Module *
 pz_setup_builtins(void)
 {
@@ -231,10 +379,14 @@ pz_setup_builtins(void)
      * do not use the storage provided by PZ_Module.  TODO: maybe they
      * should?
      */
-    module = pz_module_init(0, 0, 0, -1);
+    module = pz_module_init(0, 0, 0, 0, -1);
 
     pz_module_add_proc_symbol(module, "print",
             &builtin_print);
+    pz_module_add_proc_symbol(module, "flush",
+            &builtin_flush);
+    pz_module_add_proc_symbol(module, "print_int",
+            &builtin_print_int);
     pz_module_add_proc_symbol(module, "int_to_string",
             &builtin_int_to_string);
     pz_module_add_proc_symbol(module, "free",
@@ -245,8 +397,40 @@ pz_setup_builtins(void)
             &builtin_gettimeofday);
     pz_module_add_proc_symbol(module, "concat_string",
             &builtin_concat_string);
+    pz_module_add_proc_symbol(module, "intern",
+            &builtin_intern);
+    pz_module_add_proc_symbol(module, "string_equals",
+            &builtin_string_equals);
+    pz_module_add_proc_symbol(module, "string_compare",
+            &builtin_string_compare);
+    pz_module_add_proc_symbol(module, "string_starts_with",
+            &builtin_string_starts_with);
+    pz_module_add_proc_symbol(module, "string_find",
+            &builtin_string_find);
+    pz_module_add_proc_symbol(module, "string_split",
+            &builtin_string_split);
+    pz_module_add_proc_symbol(module, "string_count_byte",
+            &builtin_string_count_byte);
+    pz_module_add_proc_symbol(module, "string_is_utf8",
+            &builtin_string_is_utf8);
     pz_module_add_proc_symbol(module, "die",
             &builtin_die);
+    pz_module_add_proc_symbol(module, "new_channel",
+            &builtin_new_channel);
+    pz_module_add_proc_symbol(module, "new_spsc_channel",
+            &builtin_new_spsc_channel);
+    pz_module_add_proc_symbol(module, "send",
+            &builtin_send);
+    pz_module_add_proc_symbol(module, "recv",
+            &builtin_recv);
+    pz_module_add_proc_symbol(module, "try_recv",
+            &builtin_try_recv);
+    pz_module_add_proc_symbol(module, "array_range",
+            &builtin_array_range);
+    pz_module_add_proc_symbol(module, "array_size",
+            &builtin_array_size);
+    pz_module_add_proc_symbol(module, "array_get",
+            &builtin_array_get);
 
     pz_module_add_proc_symbol(module, "make_tag",
             builtin_create(builtin_make_tag_instrs));
@@ -258,6 +442,10 @@ pz_setup_builtins(void)
             builtin_create(builtin_break_shift_tag_instrs));
     pz_module_add_proc_symbol(module, "unshift_value",
             builtin_create(builtin_unshift_value_instrs));
+    pz_module_add_proc_symbol(module, "parallel_map",
+            builtin_create(builtin_parallel_map_instrs));
+    pz_module_add_proc_symbol(module, "parallel_reduce",
+            builtin_create(builtin_parallel_reduce_instrs));
 
     /*
      * TODO: Add the new builtins that are built from PZ instructions rather
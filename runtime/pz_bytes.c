@@ -0,0 +1,210 @@
+/*
+ * Plasma byte scanning
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#include <string.h>
+
+#include "pz_common.h"
+
+#include "pz_bytes.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(PZ_NO_SIMD)
+#define PZ_BYTES_X86
+#include <immintrin.h>
+#endif
+
+static size_t
+count_scalar(const char *bytes, size_t len, char c);
+
+static const char *
+find_scalar(const char *bytes, size_t len, char c);
+
+static size_t
+ascii_prefix_scalar(const char *bytes, size_t len);
+
+static size_t      (*count_impl)(const char *, size_t, char) =
+    count_scalar;
+static const char *(*find_impl)(const char *, size_t, char) =
+    find_scalar;
+static size_t      (*ascii_prefix_impl)(const char *, size_t) =
+    ascii_prefix_scalar;
+
+size_t
+pz_bytes_count(const char *bytes, size_t len, char c)
+{
+    return count_impl(bytes, len, c);
+}
+
+const char *
+pz_bytes_find(const char *bytes, size_t len, char c)
+{
+    return find_impl(bytes, len, c);
+}
+
+size_t
+pz_bytes_ascii_prefix(const char *bytes, size_t len)
+{
+    return ascii_prefix_impl(bytes, len);
+}
+
+static size_t
+count_scalar(const char *bytes, size_t len, char c)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        count += bytes[i] == c;
+    }
+    return count;
+}
+
+static const char *
+find_scalar(const char *bytes, size_t len, char c)
+{
+    return memchr(bytes, c, len);
+}
+
+static size_t
+ascii_prefix_scalar(const char *bytes, size_t len)
+{
+    size_t i = 0;
+
+    while ((i < len) && !(bytes[i] & 0x80)) {
+        i++;
+    }
+    return i;
+}
+
+#ifdef PZ_BYTES_X86
+
+/*
+ * Each of these tests whole blocks of bytes and leaves the rest to the
+ * scalar version.  A block's movemask has a bit set for each byte that
+ * matched, or for ascii_prefix each byte with its high bit set.
+ */
+
+static size_t
+count_sse2(const char *bytes, size_t len, char c)
+{
+    __m128i needle = _mm_set1_epi8(c);
+    size_t  count = 0;
+    size_t  i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(bytes + i));
+
+        count += __builtin_popcount(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+    }
+    return count + count_scalar(bytes + i, len - i, c);
+}
+
+static const char *
+find_sse2(const char *bytes, size_t len, char c)
+{
+    __m128i needle = _mm_set1_epi8(c);
+    size_t  i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i  block = _mm_loadu_si128((const __m128i *)(bytes + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+
+        if (mask != 0) {
+            return bytes + i + __builtin_ctz(mask);
+        }
+    }
+    return find_scalar(bytes + i, len - i, c);
+}
+
+static size_t
+ascii_prefix_sse2(const char *bytes, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i  block = _mm_loadu_si128((const __m128i *)(bytes + i));
+        unsigned mask = _mm_movemask_epi8(block);
+
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + ascii_prefix_scalar(bytes + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+count_avx2(const char *bytes, size_t len, char c)
+{
+    __m256i needle = _mm256_set1_epi8(c);
+    size_t  count = 0;
+    size_t  i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(bytes + i));
+
+        count += __builtin_popcount(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+    }
+    return count + count_sse2(bytes + i, len - i, c);
+}
+
+__attribute__((target("avx2")))
+static const char *
+find_avx2(const char *bytes, size_t len, char c)
+{
+    __m256i needle = _mm256_set1_epi8(c);
+    size_t  i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i  block = _mm256_loadu_si256((const __m256i *)(bytes + i));
+        unsigned mask =
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+
+        if (mask != 0) {
+            return bytes + i + __builtin_ctz(mask);
+        }
+    }
+    return find_sse2(bytes + i, len - i, c);
+}
+
+__attribute__((target("avx2")))
+static size_t
+ascii_prefix_avx2(const char *bytes, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i  block = _mm256_loadu_si256((const __m256i *)(bytes + i));
+        unsigned mask = _mm256_movemask_epi8(block);
+
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + ascii_prefix_sse2(bytes + i, len - i);
+}
+
+#endif /* PZ_BYTES_X86 */
+
+void
+pz_bytes_init(void)
+{
+#ifdef PZ_BYTES_X86
+    // Every x86-64 CPU has SSE2.
+    count_impl = count_sse2;
+    find_impl = find_sse2;
+    ascii_prefix_impl = ascii_prefix_sse2;
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        count_impl = count_avx2;
+        find_impl = find_avx2;
+        ascii_prefix_impl = ascii_prefix_avx2;
+    }
+#endif
+}
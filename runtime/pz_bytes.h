@@ -0,0 +1,42 @@
+/*
+ * Plasma byte scanning
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#ifndef PZ_BYTES_H
+#define PZ_BYTES_H
+
+/*
+ * The loops that the string builtins spend their time in (see
+ * pz_string.h).  Each has a scalar version and, on x86-64, SSE2 and AVX2
+ * versions that test 16 or 32 bytes at a time.  pz_bytes_init() chooses
+ * the versions for the CPU the program is running on, until it's called
+ * the scalar versions are used.  Build with -DPZ_NO_SIMD to use only the
+ * scalar versions.
+ */
+
+void
+pz_bytes_init(void);
+
+/*
+ * The number of bytes equal to c.
+ */
+size_t
+pz_bytes_count(const char *bytes, size_t len, char c);
+
+/*
+ * The first byte equal to c, or NULL if there isn't one.
+ */
+const char *
+pz_bytes_find(const char *bytes, size_t len, char c);
+
+/*
+ * The number of ASCII bytes before the first byte that isn't ASCII.
+ */
+size_t
+pz_bytes_ascii_prefix(const char *bytes, size_t len);
+
+#endif /* ! PZ_BYTES_H */
@@ -0,0 +1,497 @@
+/*
+ * Plasma translated code cache
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pz_common.h"
+
+#include "pz.h"
+#include "pz_cache.h"
+#include "pz_code.h"
+#include "pz_util.h"
+
+/*
+ * The build ID identifies the exact runtime that translated the code.  The
+ * Makefile sets it to a checksum of the runtime's sources and CFLAGS.
+ */
+#ifndef PZ_BUILD_ID
+#define PZ_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+#define PZ_CACHE_MAGIC          "PZCACHE1"
+#define PZ_CACHE_BUILD_ID_LEN   64
+
+/*
+ * Cache files are only read by the runtime that wrote them, so they use
+ * the machine's native byte order and alignment:
+ *
+ *   CacheFile ::= Header ProcEntry* Relocation* Padding Code
+ */
+typedef struct {
+    char     magic[8];
+    uint64_t file_hash;
+    char     build_id[PZ_CACHE_BUILD_ID_LEN];
+    uint32_t num_procs;
+    uint32_t num_relocs;
+    uint32_t code_offset;
+    uint32_t code_size;
+} Cache_Header;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} Cache_Proc;
+
+typedef enum {
+    PZ_RELOC_CODE,
+    PZ_RELOC_DATA,
+    PZ_RELOC_IMPORT
+} Reloc_Type;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t type;
+    uint32_t value;
+} Cache_Reloc;
+
+struct PZ_Cache_Builder_Struct {
+    unsigned     num_procs;
+    Cache_Proc  *procs;
+    unsigned     code_size;
+
+    unsigned     num_relocs;
+    unsigned     relocs_capacity;
+    Cache_Reloc *relocs;
+};
+
+static char *
+cache_filename(const char *cache_dir, uint64_t file_hash);
+
+static const char *
+build_id(void);
+
+static void
+builder_add_reloc(PZ_Cache_Builder *builder,
+                  unsigned          proc,
+                  unsigned          offset,
+                  Reloc_Type        type,
+                  unsigned          value);
+
+static bool
+apply_relocs(uint8_t           *code,
+             uint32_t           code_size,
+             Cache_Reloc       *relocs,
+             uint32_t           num_relocs,
+             PZ_Module         *module,
+             PZ_Proc_Symbol   **imports,
+             unsigned           num_imports);
+
+uint64_t
+pz_cache_hash_bytes(uint64_t hash, const uint8_t *bytes, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ bytes[i]) * PZ_CACHE_HASH_PRIME;
+    }
+
+    return hash;
+}
+
+/*
+ * Loading
+ **********/
+
+bool
+pz_cache_load(const char      *cache_dir,
+              uint64_t         file_hash,
+              PZ_Module       *module,
+              PZ_Proc_Symbol **imports,
+              unsigned         num_imports,
+              bool             verbose)
+{
+    char         *filename;
+    int           fd;
+    struct stat   st;
+    uint8_t      *mapping = MAP_FAILED;
+    size_t        mapping_size = 0;
+    Cache_Header *header;
+    Cache_Proc   *procs;
+    Cache_Reloc  *relocs;
+    uint8_t      *code;
+    size_t        tables_end;
+
+    filename = cache_filename(cache_dir, file_hash);
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        if (verbose) {
+            fprintf(stderr, "No cached code in %s\n", filename);
+        }
+        free(filename);
+        return false;
+    }
+
+    if (0 == fstat(fd, &st) && st.st_size >= sizeof(Cache_Header)) {
+        mapping_size = st.st_size;
+        mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) goto invalid;
+
+    header = (Cache_Header *)mapping;
+    if (0 != memcmp(header->magic, PZ_CACHE_MAGIC, sizeof(header->magic)) ||
+        header->file_hash != file_hash ||
+        0 != strncmp(header->build_id, build_id(),
+                     PZ_CACHE_BUILD_ID_LEN) ||
+        header->num_procs != pz_module_get_num_procs(module))
+    {
+        goto invalid;
+    }
+
+    tables_end = sizeof(Cache_Header) +
+                 sizeof(Cache_Proc) * header->num_procs +
+                 sizeof(Cache_Reloc) * header->num_relocs;
+    if (tables_end > header->code_offset ||
+        header->code_offset % PZ_PROC_ALIGN != 0 ||
+        (size_t)header->code_offset + header->code_size > mapping_size)
+    {
+        goto invalid;
+    }
+    procs = (Cache_Proc *)(mapping + sizeof(Cache_Header));
+    relocs = (Cache_Reloc *)(procs + header->num_procs);
+    code = mapping + header->code_offset;
+
+    for (unsigned i = 0; i < header->num_procs; i++) {
+        if ((size_t)procs[i].offset + procs[i].size > header->code_size) {
+            goto invalid;
+        }
+    }
+
+    if (!apply_relocs(code, header->code_size, relocs, header->num_relocs,
+                      module, imports, num_imports))
+    {
+        goto invalid;
+    }
+
+    /*
+     * The interpreter never writes to its code, make that official.
+     */
+    if (0 != mprotect(mapping, mapping_size, PROT_READ)) {
+        perror("mprotect");
+        goto invalid;
+    }
+
+    for (unsigned i = 0; i < header->num_procs; i++) {
+        pz_module_set_proc(module, i,
+            pz_proc_init(code + procs[i].offset, procs[i].size));
+    }
+    pz_module_set_code_mapping(module, mapping, mapping_size);
+
+    if (verbose) {
+        fprintf(stderr, "Loaded cached code from %s\n", filename);
+    }
+    free(filename);
+    return true;
+
+invalid:
+    if (verbose) {
+        fprintf(stderr, "Ignoring invalid or stale cache file %s\n",
+                filename);
+    }
+    if (mapping != MAP_FAILED) {
+        munmap(mapping, mapping_size);
+    }
+    free(filename);
+    return false;
+}
+
+static bool
+apply_relocs(uint8_t           *code,
+             uint32_t           code_size,
+             Cache_Reloc       *relocs,
+             uint32_t           num_relocs,
+             PZ_Module         *module,
+             PZ_Proc_Symbol   **imports,
+             unsigned           num_imports)
+{
+    for (unsigned i = 0; i < num_relocs; i++) {
+        uintptr_t       value;
+        PZ_Proc_Symbol *import;
+
+        if ((size_t)relocs[i].offset + MACHINE_WORD_SIZE > code_size ||
+            relocs[i].offset % MACHINE_WORD_SIZE != 0)
+        {
+            return false;
+        }
+
+        switch (relocs[i].type) {
+            case PZ_RELOC_CODE:
+                if (relocs[i].value >= code_size) return false;
+                value = (uintptr_t)(code + relocs[i].value);
+                break;
+            case PZ_RELOC_DATA:
+                if (relocs[i].value >= pz_module_get_num_datas(module)) {
+                    return false;
+                }
+                value = (uintptr_t)pz_module_get_data(module,
+                                                      relocs[i].value);
+                break;
+            case PZ_RELOC_IMPORT:
+                if (relocs[i].value >= num_imports) return false;
+                import = imports[relocs[i].value];
+                switch (import->type) {
+                    case PZ_BUILTIN_BYTECODE:
+                        value = (uintptr_t)import->proc.bytecode;
+                        break;
+                    case PZ_BUILTIN_C_FUNC:
+                        value = (uintptr_t)import->proc.c_func;
+                        break;
+                    default:
+                        return false;
+                }
+                break;
+            default:
+                return false;
+        }
+
+        *((uintptr_t *)(&code[relocs[i].offset])) = value;
+    }
+
+    return true;
+}
+
+/*
+ * Saving
+ *********/
+
+PZ_Cache_Builder *
+pz_cache_builder_init(unsigned num_procs)
+{
+    PZ_Cache_Builder *builder = malloc(sizeof(PZ_Cache_Builder));
+
+    builder->num_procs = num_procs;
+    builder->procs = malloc(sizeof(Cache_Proc) * (num_procs + 1));
+    builder->code_size = 0;
+    builder->num_relocs = 0;
+    builder->relocs_capacity = 64;
+    builder->relocs = malloc(sizeof(Cache_Reloc) * builder->relocs_capacity);
+
+    return builder;
+}
+
+void
+pz_cache_builder_free(PZ_Cache_Builder *builder)
+{
+    free(builder->procs);
+    free(builder->relocs);
+    free(builder);
+}
+
+void
+pz_cache_builder_set_proc(PZ_Cache_Builder *builder,
+                          unsigned          proc,
+                          unsigned          offset,
+                          unsigned          size)
+{
+    unsigned end = ALIGN_UP(offset + size, PZ_PROC_ALIGN);
+
+    assert(proc < builder->num_procs);
+    assert(offset % PZ_PROC_ALIGN == 0);
+
+    builder->procs[proc].offset = offset;
+    builder->procs[proc].size = size;
+    if (end > builder->code_size) {
+        builder->code_size = end;
+    }
+}
+
+void
+pz_cache_builder_reloc_code(PZ_Cache_Builder *builder,
+                            unsigned          proc,
+                            unsigned          offset,
+                            unsigned          target_proc,
+                            unsigned          target_offset)
+{
+    assert(target_proc < builder->num_procs);
+
+    builder_add_reloc(builder, proc, offset, PZ_RELOC_CODE,
+                      builder->procs[target_proc].offset + target_offset);
+}
+
+void
+pz_cache_builder_reloc_data(PZ_Cache_Builder *builder,
+                            unsigned          proc,
+                            unsigned          offset,
+                            unsigned          data_id)
+{
+    builder_add_reloc(builder, proc, offset, PZ_RELOC_DATA, data_id);
+}
+
+void
+pz_cache_builder_reloc_import(PZ_Cache_Builder *builder,
+                              unsigned          proc,
+                              unsigned          offset,
+                              unsigned          import_id)
+{
+    builder_add_reloc(builder, proc, offset, PZ_RELOC_IMPORT, import_id);
+}
+
+static void
+builder_add_reloc(PZ_Cache_Builder *builder,
+                  unsigned          proc,
+                  unsigned          offset,
+                  Reloc_Type        type,
+                  unsigned          value)
+{
+    Cache_Reloc *reloc;
+
+    assert(proc < builder->num_procs);
+
+    if (builder->num_relocs == builder->relocs_capacity) {
+        builder->relocs_capacity *= 2;
+        builder->relocs = realloc(builder->relocs,
+            sizeof(Cache_Reloc) * builder->relocs_capacity);
+    }
+
+    reloc = &builder->relocs[builder->num_relocs++];
+    reloc->offset = builder->procs[proc].offset + offset;
+    reloc->type = type;
+    reloc->value = value;
+}
+
+bool
+pz_cache_save(PZ_Cache_Builder *builder,
+              const char       *cache_dir,
+              uint64_t          file_hash,
+              PZ_Module        *module,
+              bool              verbose)
+{
+    char         *filename;
+    char         *temp_filename = NULL;
+    FILE         *file = NULL;
+    Cache_Header  header;
+    uint8_t      *code;
+    size_t        tables_end;
+    bool          result = false;
+
+    if (0 != mkdir(cache_dir, 0777) && errno != EEXIST) {
+        perror(cache_dir);
+        return false;
+    }
+
+    /*
+     * Lay out the code as it will appear in the cache, the addresses it
+     * contains are meaningless once we exit so clear them.
+     */
+    code = malloc(builder->code_size);
+    memset(code, 0, builder->code_size);
+    for (unsigned i = 0; i < builder->num_procs; i++) {
+        memcpy(code + builder->procs[i].offset,
+               pz_module_get_proc_code(module, i),
+               builder->procs[i].size);
+    }
+    for (unsigned i = 0; i < builder->num_relocs; i++) {
+        memset(code + builder->relocs[i].offset, 0, MACHINE_WORD_SIZE);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PZ_CACHE_MAGIC, sizeof(header.magic));
+    header.file_hash = file_hash;
+    strncpy(header.build_id, build_id(), PZ_CACHE_BUILD_ID_LEN - 1);
+    header.num_procs = builder->num_procs;
+    header.num_relocs = builder->num_relocs;
+    tables_end = sizeof(Cache_Header) +
+                 sizeof(Cache_Proc) * builder->num_procs +
+                 sizeof(Cache_Reloc) * builder->num_relocs;
+    header.code_offset = ALIGN_UP(tables_end, PZ_PROC_ALIGN);
+    header.code_size = builder->code_size;
+
+    /*
+     * Write the cache to a temporary file and rename it into place, so
+     * that another pzrun process never sees a partially written file.
+     */
+    filename = cache_filename(cache_dir, file_hash);
+    temp_filename = malloc(strlen(filename) + 32);
+    sprintf(temp_filename, "%s.%ld", filename, (long)getpid());
+    file = fopen(temp_filename, "wb");
+    if (file == NULL) goto end;
+
+    if (1 != fwrite(&header, sizeof(header), 1, file)) goto end;
+    if (builder->num_procs != fwrite(builder->procs, sizeof(Cache_Proc),
+                                     builder->num_procs, file))
+    {
+        goto end;
+    }
+    if (builder->num_relocs != fwrite(builder->relocs, sizeof(Cache_Reloc),
+                                      builder->num_relocs, file))
+    {
+        goto end;
+    }
+    for (size_t i = tables_end; i < header.code_offset; i++) {
+        if (EOF == fputc(0, file)) goto end;
+    }
+    if (builder->code_size != fwrite(code, 1, builder->code_size, file)) {
+        goto end;
+    }
+    if (0 != fclose(file)) {
+        file = NULL;
+        goto end;
+    }
+    file = NULL;
+
+    if (0 != rename(temp_filename, filename)) goto end;
+    if (verbose) {
+        fprintf(stderr, "Saved code to cache file %s\n", filename);
+    }
+    result = true;
+
+end:
+    if (!result) {
+        perror(temp_filename);
+        if (file != NULL) {
+            fclose(file);
+        }
+        unlink(temp_filename);
+    }
+    free(code);
+    free(temp_filename);
+    free(filename);
+    return result;
+}
+
+/*
+ * Cache files
+ **************/
+
+static char *
+cache_filename(const char *cache_dir, uint64_t file_hash)
+{
+    uint64_t    key;
+    const char *id = build_id();
+    char       *filename;
+
+    key = pz_cache_hash_bytes(PZ_CACHE_HASH_INIT, (uint8_t *)&file_hash,
+                              sizeof(file_hash));
+    key = pz_cache_hash_bytes(key, (const uint8_t *)id, strlen(id));
+
+    filename = malloc(strlen(cache_dir) + 32);
+    sprintf(filename, "%s/%016" PRIx64 ".pzc", cache_dir, key);
+
+    return filename;
+}
+
+static const char *
+build_id(void)
+{
+    return PZ_BUILD_ID;
+}
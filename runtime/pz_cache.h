@@ -0,0 +1,109 @@
+/*
+ * Plasma translated code cache
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#ifndef PZ_CACHE_H
+#define PZ_CACHE_H
+
+#include "pz.h"
+#include "pz_code.h"
+
+/*
+ * Loading a module translates its bytecode into the token stream used by
+ * the interpreter.  The result can be saved in a cache directory and
+ * loaded with a single mmap() by later runs.
+ *
+ * Cache files are named after a key made from the PZ file's hash and the
+ * runtime's build ID, so a cache file is never used after either of these
+ * change.  The translated code contains absolute addresses, so the cache
+ * file also contains a relocation for each address that is resolved after
+ * loading.  All offsets are relative to the start of the module's code,
+ * which is laid out in the same order as the module's code segment.
+ */
+
+typedef struct PZ_Cache_Builder_Struct PZ_Cache_Builder;
+
+/*
+ * Hash some bytes using 64bit FNV-1a.  The first call should pass
+ * PZ_CACHE_HASH_INIT as the hash.
+ */
+#define PZ_CACHE_HASH_INIT  UINT64_C(0xCBF29CE484222325)
+#define PZ_CACHE_HASH_PRIME UINT64_C(0x100000001B3)
+
+uint64_t
+pz_cache_hash_bytes(uint64_t hash, const uint8_t *bytes, size_t len);
+
+/*
+ * Try to load the code for a module from the cache.  The module's procs
+ * must not have been set yet.  If this returns true then they have been
+ * set, if it returns false there was no usable cache file.
+ */
+bool
+pz_cache_load(const char      *cache_dir,
+              uint64_t         file_hash,
+              PZ_Module       *module,
+              PZ_Proc_Symbol **imports,
+              unsigned         num_imports,
+              bool             verbose);
+
+/*
+ * Builders record relocations while a module's code is being translated
+ * and then save it to the cache.
+ */
+PZ_Cache_Builder *
+pz_cache_builder_init(unsigned num_procs);
+
+void
+pz_cache_builder_free(PZ_Cache_Builder *builder);
+
+/*
+ * Set the offset and size of each procedure, they must all be set before
+ * any relocations are added.
+ */
+void
+pz_cache_builder_set_proc(PZ_Cache_Builder *builder,
+                          unsigned          proc,
+                          unsigned          offset,
+                          unsigned          size);
+
+/*
+ * Record that the word at offset within proc refers to:
+ *  - target_offset within target_proc.
+ *  - The data item with the given ID.
+ *  - The imported procedure with the given index.
+ */
+void
+pz_cache_builder_reloc_code(PZ_Cache_Builder *builder,
+                            unsigned          proc,
+                            unsigned          offset,
+                            unsigned          target_proc,
+                            unsigned          target_offset);
+
+void
+pz_cache_builder_reloc_data(PZ_Cache_Builder *builder,
+                            unsigned          proc,
+                            unsigned          offset,
+                            unsigned          data_id);
+
+void
+pz_cache_builder_reloc_import(PZ_Cache_Builder *builder,
+                              unsigned          proc,
+                              unsigned          offset,
+                              unsigned          import_id);
+
+/*
+ * Write the module's code to the cache.  A failure to save the cache is
+ * not fatal, the return value tells the caller if it was saved.
+ */
+bool
+pz_cache_save(PZ_Cache_Builder *builder,
+              const char       *cache_dir,
+              uint64_t          file_hash,
+              PZ_Module        *module,
+              bool              verbose);
+
+#endif /* ! PZ_CACHE_H */
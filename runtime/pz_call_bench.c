@@ -0,0 +1,133 @@
+/*
+ * Call overhead benchmark
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ *
+ * This program measures the cost of calling a Plasma procedure from C
+ * through libpz's API.  Run it with "make bench".
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "pz_common.h"
+
+#include "pz_api.h"
+
+#define NUM_CALLS 10000000
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * The benchmark doesn't depend on pzasm, so it builds its program in
+ * memory: a single module that exports add (w w - w).
+ */
+static unsigned
+make_add_instrs(uint8_t *code)
+{
+    unsigned        offset = 0;
+    Immediate_Value imm = {.word = 0 };
+
+    offset = pz_write_instr(code, offset, PZI_ADD, PZW_FAST, 0, IMT_NONE,
+                            imm);
+    offset = pz_write_instr(code, offset, PZI_RET, 0, 0, IMT_NONE, imm);
+
+    return offset;
+}
+
+static PZ *
+make_program(uint8_t **code)
+{
+    PZ        *pz;
+    PZ_Module *module;
+    unsigned   size;
+
+    size = make_add_instrs(NULL);
+    *code = malloc(size);
+    make_add_instrs(*code);
+
+    module = pz_module_init(0, 0, 1, 1, 0);
+    pz_module_set_name(module, "bench");
+    pz_module_set_proc(module, 0, pz_proc_init(*code, size));
+    pz_module_export_proc(module, "add", 0);
+
+    pz = pz_init();
+    pz_add_entry_module(pz, module);
+    return pz;
+}
+
+/*
+ * A C function to compare with, called through a pointer so that it isn't
+ * inlined.  It wraps on overflow like Plasma's add.
+ */
+static int32_t
+c_add(int32_t a, int32_t b)
+{
+    return (int32_t)((uint32_t)a + (uint32_t)b);
+}
+
+static int32_t (*volatile c_add_ptr)(int32_t, int32_t) = c_add;
+
+int
+main(int argc, char *const argv[])
+{
+    PZ         *pz;
+    PZ_Context *context;
+    uint8_t    *code;
+    uint8_t    *add;
+    double      start, c_time, call_time, lookup_time;
+    int32_t     total = 0;
+
+    pz = make_program(&code);
+    context = pz_context_init();
+
+    start = now();
+    for (int32_t i = 0; i < NUM_CALLS; i++) {
+        total = c_add_ptr(total, i);
+    }
+    c_time = now() - start;
+
+    add = pz_lookup_proc(pz, NULL, "add");
+    start = now();
+    for (int32_t i = 0; i < NUM_CALLS; i++) {
+        pz_context_push_int(context, total);
+        pz_context_push_int(context, i);
+        pz_context_call(context, add);
+        total = pz_context_pop_int(context);
+    }
+    call_time = now() - start;
+
+    start = now();
+    for (int32_t i = 0; i < NUM_CALLS; i++) {
+        add = pz_lookup_proc(pz, NULL, "add");
+        pz_context_push_int(context, total);
+        pz_context_push_int(context, i);
+        pz_context_call(context, add);
+        total = pz_context_pop_int(context);
+    }
+    lookup_time = now() - start;
+
+    printf("C call:                %6.1fns\n", c_time * 1e9 / NUM_CALLS);
+    printf("Plasma call:           %6.1fns\n",
+           call_time * 1e9 / NUM_CALLS);
+    printf("Plasma lookup and call: %5.1fns\n",
+           lookup_time * 1e9 / NUM_CALLS);
+    // Use the result so that none of the loops are optimised away.
+    printf("(checksum %d)\n", (int)total);
+
+    pz_context_free(context);
+    pz_free(pz);
+    free(code);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,344 @@
+/*
+ * Plasma channels
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "pz_common.h"
+
+#include "pz_channel.h"
+
+/*
+ * The ring buffers use the GCC/Clang __atomic builtins, C99 has no
+ * atomics of its own.
+ */
+#define LOAD(p, order)          __atomic_load_n((p), __ATOMIC_##order)
+#define STORE(p, v, order)      __atomic_store_n((p), (v), __ATOMIC_##order)
+
+#define MAX_CAPACITY (1u << 20)
+#define CACHE_LINE_SIZE 64
+
+/*
+ * In an MPMC channel each cell's sequence number says whose turn it is:
+ * it equals the send position when the cell is free for that send and
+ * the send position plus one once the message is written.  SPSC channels
+ * don't use it.
+ */
+typedef struct {
+    uint64_t seq;
+    uint64_t value;
+} Cell;
+
+typedef struct Waiter_Struct {
+    PZ_Fiber             *fiber;
+    PZ_Worker            *worker;
+    struct Waiter_Struct *next;
+} Waiter;
+
+typedef struct {
+    Waiter   *head;
+    Waiter   *tail;
+    // Read without the lock by the fast path, to see if it must wake one.
+    unsigned  num;
+} Waiter_List;
+
+struct PZ_Channel_Struct {
+    PZ_Channel_Kind  kind;
+    uint64_t         mask;
+    Cell            *cells;
+
+    /*
+     * Senders and receivers each have their own cache line so that they
+     * don't slow each other down.
+     */
+    char             pad1[CACHE_LINE_SIZE];
+    uint64_t         send_pos;
+    char             pad2[CACHE_LINE_SIZE];
+    uint64_t         recv_pos;
+    char             pad3[CACHE_LINE_SIZE];
+
+    // Parked fibers, protected by the lock.
+    pthread_mutex_t  lock;
+    Waiter_List      senders;
+    Waiter_List      receivers;
+};
+
+static bool
+ring_send(PZ_Channel *chan, uint64_t value);
+
+static bool
+ring_recv(PZ_Channel *chan, uint64_t *value);
+
+static void
+wake_one(PZ_Channel *chan, Waiter_List *list);
+
+static void
+waiter_add(Waiter_List *list, Waiter *waiter);
+
+static void
+waiter_remove(Waiter_List *list, Waiter *waiter);
+
+PZ_Channel *
+pz_channel_new(PZ_Heap *heap, PZ_Channel_Kind kind, unsigned capacity)
+{
+    PZ_Channel *chan;
+    uint64_t    size = 1;
+
+    while ((size < capacity) && (size < MAX_CAPACITY)) {
+        size *= 2;
+    }
+
+    chan = pz_heap_alloc(heap, sizeof(PZ_Channel));
+    chan->kind = kind;
+    chan->mask = size - 1;
+    chan->cells = pz_heap_alloc(heap, sizeof(Cell) * size);
+    for (uint64_t i = 0; i < size; i++) {
+        chan->cells[i].seq = i;
+    }
+    chan->send_pos = 0;
+    chan->recv_pos = 0;
+
+    /*
+     * The heap is a region so the lock is never destroyed, that's okay
+     * for a default mutex.
+     */
+    if (0 != pthread_mutex_init(&chan->lock, NULL)) {
+        fprintf(stderr, "Couldn't initialise a channel\n");
+        abort();
+    }
+    chan->senders.head = chan->senders.tail = NULL;
+    chan->senders.num = 0;
+    chan->receivers.head = chan->receivers.tail = NULL;
+    chan->receivers.num = 0;
+
+    return chan;
+}
+
+bool
+pz_channel_try_send(PZ_Channel *chan, uint64_t value)
+{
+    if (!ring_send(chan, value)) return false;
+
+    // Pairs with the fence in pz_channel_block_recv().
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (LOAD(&chan->receivers.num, RELAXED) > 0) {
+        wake_one(chan, &chan->receivers);
+    }
+    return true;
+}
+
+bool
+pz_channel_try_recv(PZ_Channel *chan, uint64_t *value)
+{
+    if (!ring_recv(chan, value)) return false;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (LOAD(&chan->senders.num, RELAXED) > 0) {
+        wake_one(chan, &chan->senders);
+    }
+    return true;
+}
+
+/*
+ * The fiber is added to the waiters before trying again, so either the
+ * retry sees a message sent after the first try or that send sees the
+ * waiter and wakes it.
+ */
+bool
+pz_channel_block_send(PZ_Channel *chan, PZ_Worker *worker, PZ_Fiber *fiber,
+                      uint64_t value)
+{
+    Waiter *waiter = malloc(sizeof(Waiter));
+
+    waiter->fiber = fiber;
+    waiter->worker = worker;
+
+    pthread_mutex_lock(&chan->lock);
+    waiter_add(&chan->senders, waiter);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (ring_send(chan, value)) {
+        waiter_remove(&chan->senders, waiter);
+        pthread_mutex_unlock(&chan->lock);
+        free(waiter);
+
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (LOAD(&chan->receivers.num, RELAXED) > 0) {
+            wake_one(chan, &chan->receivers);
+        }
+        return false;
+    }
+    pthread_mutex_unlock(&chan->lock);
+
+    return true;
+}
+
+bool
+pz_channel_block_recv(PZ_Channel *chan, PZ_Worker *worker, PZ_Fiber *fiber,
+                      uint64_t *value)
+{
+    Waiter *waiter = malloc(sizeof(Waiter));
+
+    waiter->fiber = fiber;
+    waiter->worker = worker;
+
+    pthread_mutex_lock(&chan->lock);
+    waiter_add(&chan->receivers, waiter);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (ring_recv(chan, value)) {
+        waiter_remove(&chan->receivers, waiter);
+        pthread_mutex_unlock(&chan->lock);
+        free(waiter);
+
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (LOAD(&chan->senders.num, RELAXED) > 0) {
+            wake_one(chan, &chan->senders);
+        }
+        return false;
+    }
+    pthread_mutex_unlock(&chan->lock);
+
+    return true;
+}
+
+/*
+ * The SPSC ring only needs each side to publish its position with a
+ * release store.  The MPMC ring is Dmitry Vyukov's bounded queue: a
+ * sender or receiver claims a position with a compare-and-swap and then
+ * uses the cell's sequence number to hand it over.
+ */
+static bool
+ring_send(PZ_Channel *chan, uint64_t value)
+{
+    Cell     *cell;
+    uint64_t  pos = LOAD(&chan->send_pos, RELAXED);
+
+    if (chan->kind == PZ_CHANNEL_SPSC) {
+        if (pos - LOAD(&chan->recv_pos, ACQUIRE) > chan->mask) {
+            return false;
+        }
+        chan->cells[pos & chan->mask].value = value;
+        STORE(&chan->send_pos, pos + 1, RELEASE);
+        return true;
+    }
+
+    while (true) {
+        int64_t diff;
+
+        cell = &chan->cells[pos & chan->mask];
+        diff = (int64_t)(LOAD(&cell->seq, ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&chan->send_pos, &pos, pos + 1,
+                    true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        } else if (diff < 0) {
+            // The cell hasn't been received from since the last lap.
+            return false;
+        } else {
+            pos = LOAD(&chan->send_pos, RELAXED);
+        }
+    }
+    cell->value = value;
+    STORE(&cell->seq, pos + 1, RELEASE);
+    return true;
+}
+
+static bool
+ring_recv(PZ_Channel *chan, uint64_t *value)
+{
+    Cell     *cell;
+    uint64_t  pos = LOAD(&chan->recv_pos, RELAXED);
+
+    if (chan->kind == PZ_CHANNEL_SPSC) {
+        if (pos == LOAD(&chan->send_pos, ACQUIRE)) {
+            return false;
+        }
+        *value = chan->cells[pos & chan->mask].value;
+        STORE(&chan->recv_pos, pos + 1, RELEASE);
+        return true;
+    }
+
+    while (true) {
+        int64_t diff;
+
+        cell = &chan->cells[pos & chan->mask];
+        diff = (int64_t)(LOAD(&cell->seq, ACQUIRE) - (pos + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&chan->recv_pos, &pos, pos + 1,
+                    true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        } else if (diff < 0) {
+            // Nothing has been sent to the cell yet.
+            return false;
+        } else {
+            pos = LOAD(&chan->recv_pos, RELAXED);
+        }
+    }
+    *value = cell->value;
+    // Free the cell for the send one lap later.
+    STORE(&cell->seq, pos + chan->mask + 1, RELEASE);
+    return true;
+}
+
+/*
+ * Make the first fiber parked on the list ready, it will try again.
+ */
+static void
+wake_one(PZ_Channel *chan, Waiter_List *list)
+{
+    Waiter *waiter;
+
+    pthread_mutex_lock(&chan->lock);
+    waiter = list->head;
+    if (waiter != NULL) {
+        waiter_remove(list, waiter);
+    }
+    pthread_mutex_unlock(&chan->lock);
+
+    if (waiter != NULL) {
+        pz_scheduler_wake(waiter->worker, waiter->fiber);
+        free(waiter);
+    }
+}
+
+static void
+waiter_add(Waiter_List *list, Waiter *waiter)
+{
+    waiter->next = NULL;
+    if (list->tail != NULL) {
+        list->tail->next = waiter;
+    } else {
+        list->head = waiter;
+    }
+    list->tail = waiter;
+    STORE(&list->num, list->num + 1, RELAXED);
+}
+
+static void
+waiter_remove(Waiter_List *list, Waiter *waiter)
+{
+    Waiter *prev = NULL;
+    Waiter *cur = list->head;
+
+    while (cur != waiter) {
+        prev = cur;
+        cur = cur->next;
+    }
+    if (prev != NULL) {
+        prev->next = waiter->next;
+    } else {
+        list->head = waiter->next;
+    }
+    if (list->tail == waiter) {
+        list->tail = prev;
+    }
+    STORE(&list->num, list->num - 1, RELAXED);
+}
@@ -0,0 +1,65 @@
+/*
+ * Plasma channels
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#ifndef PZ_CHANNEL_H
+#define PZ_CHANNEL_H
+
+#include "pz_heap.h"
+#include "pz_scheduler.h"
+
+/*
+ * A channel is a bounded queue of one-word messages that tasks use to pass
+ * data to each other.  The queue is a lock-free ring buffer: a
+ * single-producer single-consumer channel needs only loads and stores,
+ * other channels use a compare-and-swap per message.
+ *
+ * When a message can't be sent or received now the fiber waiting for it
+ * is parked on the channel and made ready by the next receive or send.
+ * Only this slow path takes the channel's lock.
+ *
+ * Channels are allocated on the heap like other objects and live until it
+ * is reset.
+ */
+typedef struct PZ_Channel_Struct PZ_Channel;
+
+typedef enum {
+    PZ_CHANNEL_SPSC,
+    PZ_CHANNEL_MPMC
+} PZ_Channel_Kind;
+
+/*
+ * The capacity is rounded up to a power of two, and is at least one.
+ */
+PZ_Channel *
+pz_channel_new(PZ_Heap *heap, PZ_Channel_Kind kind, unsigned capacity);
+
+/*
+ * These return false if the channel is full or empty.  They never block.
+ */
+bool
+pz_channel_try_send(PZ_Channel *chan, uint64_t value);
+
+bool
+pz_channel_try_recv(PZ_Channel *chan, uint64_t *value);
+
+/*
+ * Called after pz_channel_try_send() or pz_channel_try_recv() failed.
+ * These return true after parking the fiber on the channel: the caller
+ * must switch to another fiber, and try again when this one is made ready
+ * on its worker.  They return false if the message was sent or received
+ * after all.
+ */
+bool
+pz_channel_block_send(PZ_Channel *chan, PZ_Worker *worker, PZ_Fiber *fiber,
+                      uint64_t value);
+
+bool
+pz_channel_block_recv(PZ_Channel *chan, PZ_Worker *worker, PZ_Fiber *fiber,
+                      uint64_t *value);
+
+#endif /* ! PZ_CHANNEL_H */
@@ -35,11 +35,11 @@ pz_proc_symbol_free(void *proc_void)
 }
 
 PZ_Proc *
-pz_proc_init(unsigned size)
+pz_proc_init(uint8_t *code, unsigned size)
 {
     PZ_Proc *proc = malloc(sizeof(PZ_Proc));
 
-    proc->code = malloc(sizeof(uint8_t) * size);
+    proc->code = code;
     proc->code_size = size;
 
     return proc;
@@ -48,7 +48,6 @@ pz_proc_init(unsigned size)
 void
 pz_proc_free(PZ_Proc *proc)
 {
-    free(proc->code);
     free(proc);
 }
 
@@ -63,5 +62,3 @@ pz_proc_get_size(PZ_Proc *proc)
 {
     return proc->code_size;
 }
-
-
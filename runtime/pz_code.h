@@ -19,11 +19,16 @@ typedef enum {
     PZ_BUILTIN_C_FUNC
 } PZ_Import_Type;
 
+// See pz_run.h
+struct PZ_Context_Struct;
+
 typedef struct PZ_Proc_Symbol_Struct {
     PZ_Import_Type  type;
     union {
         uint8_t     *bytecode;
-        unsigned    (*c_func)(void *stack, unsigned sp);
+        unsigned    (*c_func)(void                     *stack,
+                              unsigned                  sp,
+                              struct PZ_Context_Struct *context);
     } proc;
     bool            need_free;
 } PZ_Proc_Symbol;
@@ -34,10 +39,12 @@ pz_proc_symbol_free(void *proc);
 typedef struct PZ_Proc_Struct PZ_Proc;
 
 /*
- * Create a new proc.
+ * Create a new proc whose code is owned by something else: the module's
+ * code segment or a mapped cache file.  The code is not freed with the
+ * proc.
  */
 PZ_Proc *
-pz_proc_init(unsigned size);
+pz_proc_init(uint8_t *code, unsigned size);
 
 /*
  * Free the proc.
@@ -51,4 +58,10 @@ pz_proc_get_code(PZ_Proc *proc);
 unsigned
 pz_proc_get_size(PZ_Proc *proc);
 
+/*
+ * Each procedure in a module's code segment (see pz_segment.h) begins at
+ * a multiple of PZ_PROC_ALIGN.
+ */
+#define PZ_PROC_ALIGN 16
+
 #endif /* ! PZ_CODE_H */
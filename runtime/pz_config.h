@@ -16,6 +16,87 @@
 #define PZ_FAST_INTEGER_TYPE int32_t
 #define PZ_FAST_UINTEGER_TYPE uint32_t
 
+/*
+ * Back code segments (see pz_segment.h) of at least PZ_HUGE_PAGE_SIZE
+ * bytes with transparent huge pages, where the OS supports them.  This
+ * reduces iTLB misses for large programs.
+ */
+#define PZ_CODE_HUGE_PAGES
+#define PZ_HUGE_PAGE_SIZE (2*1024*1024)
+
+/*
+ * Heaps (see pz_heap.h) allocate from chunks of this size, including a
+ * small header.  Chunks come from a pool shared by all heaps, it maps
+ * PZ_HEAP_CHUNKS_PER_MAPPING chunks at a time and keeps up to
+ * PZ_HEAP_POOL_MAX_CHUNKS chunks that heaps have finished with.
+ */
+#define PZ_HEAP_CHUNK_SIZE (1024*1024)
+#define PZ_HEAP_CHUNKS_PER_MAPPING 8
+#define PZ_HEAP_POOL_MAX_CHUNKS 64
+
+/*
+ * The size of each execution context's output buffer.  Strings longer than
+ * PZ_OUTPUT_COPY_MAX aren't copied into the buffer, they're written from
+ * where they are by the same writev() call as the buffer, which can write
+ * up to PZ_OUTPUT_MAX_PIECES pieces at a time.
+ */
+#define PZ_OUTPUT_BUFFER_SIZE (64*1024)
+#define PZ_OUTPUT_COPY_MAX 512
+#define PZ_OUTPUT_MAX_PIECES 64
+
+/*
+ * Concatenating strings copies them if the result is at most this long,
+ * otherwise it makes a rope (see pz_string.h).
+ */
+#define PZ_STRING_FLAT_MAX 64
+
+/*
+ * Converting an Int in this range to a string returns a string from a
+ * table that's shared by every context, without allocating.
+ */
+#define PZ_SMALL_INT_STRING_MIN (-128)
+#define PZ_SMALL_INT_STRING_MAX 1023
+
+/*
+ * When a worker already has this many spawned tasks waiting to run, a
+ * spawn runs its task immediately instead (see pz_scheduler.h).  Tasks
+ * that are spawned deep within a parallel computation are often too small
+ * to be worth the cost of sharing them.
+ */
+#define PZ_SPAWN_CUTOFF 8
+
+/*
+ * A spawn within a task that is already this many tasks deep runs its task
+ * immediately.  A divide and conquer computation spawns 2^depth tasks
+ * before this cutoff, enough to keep many workers busy, while the many
+ * small tasks near the leaves are simply called.
+ */
+#define PZ_SPAWN_MAX_DEPTH 8
+
+/*
+ * The initial number of entries in each of a fiber's stacks, they're
+ * doubled when a call or a push finds them nearly full.  A builtin may push
+ * at most PZ_STACK_MARGIN values onto the expression stack.
+ * Small stacks let a program have many thousands of tasks waiting.
+ */
+#define PZ_FIBER_STACK_SIZE 64
+#define PZ_STACK_MARGIN 64
+
+/*
+ * The interpreter polls for a safepoint at each call and backward jump.
+ * After this many polls a fiber lets other fibers on its worker run, and
+ * checks whether the program has been interrupted.
+ */
+#define PZ_TIME_SLICE 10000
+
+/*
+ * parallel_map and parallel_reduce split their array into chunks of this
+ * many elements, which are run as tasks.  The size is fixed, rather than
+ * depending on the number of workers, so that parallel_reduce combines
+ * the same elements in the same order however many workers there are.
+ */
+#define PZ_PARALLEL_CHUNK_SIZE 256
+
 /*
  * Debugging
  */
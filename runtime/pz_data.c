@@ -49,37 +49,6 @@ pz_struct_calculate_layout(PZ_Struct *s)
     s->total_size = total_size;
 }
 
-/*
- * Data
- *
- **********/
-
-void *
-pz_data_new_basic_data(unsigned raw_width)
-{
-    if (raw_width == 0) {
-        return malloc(MACHINE_WORD_SIZE);
-    } else {
-        return malloc(raw_width);
-    }
-}
-
-void *
-pz_data_new_array_data(unsigned raw_width, uint32_t num_elements)
-{
-    if (raw_width == 0) {
-        return malloc(MACHINE_WORD_SIZE * num_elements);
-    } else {
-        return malloc(raw_width * num_elements);
-    }
-}
-
-void
-pz_data_free(void *data)
-{
-    free(data);
-}
-
 /*
  * Functions for storing data in memory
  ***************************************/
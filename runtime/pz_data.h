@@ -10,6 +10,7 @@
 #define PZ_DATA_H
 
 #include "pz_format.h"
+#include "pz_util.h"
 
 /*
  * Structs
@@ -42,24 +43,10 @@ pz_struct_calculate_layout(PZ_Struct *s);
  *******/
 
 /*
- * Allocate space for basic data.  If the width is 0 then the data is a
- * reference to some other data, and should be machine word sized.
+ * Each data entry in a module's data segment (see pz_segment.h) begins at
+ * a multiple of PZ_DATA_ALIGN, this leaves room for pointer tags.
  */
-void *
-pz_data_new_basic_data(unsigned raw_width);
-
-/*
- * Allocate space for array data.  If the width is 0 then the array contains
- * references to other data, and each element should be machine word sized.
- */
-void *
-pz_data_new_array_data(unsigned raw_width, uint32_t num_elements);
-
-/*
- * Free any of the above data entries.
- */
-void
-pz_data_free(void *data);
+#define PZ_DATA_ALIGN MACHINE_WORD_SIZE
 
 /*
  * Functions for storing data in memory
@@ -0,0 +1,186 @@
+/*
+ * Plasma fork server
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "pz_common.h"
+
+#include "pz_fork_server.h"
+#include "pz_run.h"
+#include "pz_server.h"
+
+static volatile sig_atomic_t stop_server = 0;
+
+static void
+handle_stop(int sig);
+
+static void
+handle_child(int sig);
+
+static bool
+setup_signals(void);
+
+static void
+reap_workers(bool verbose);
+
+static void
+run_worker(PZ_Context *context,
+           uint8_t    *proc_code,
+           int         connection,
+           unsigned    time_limit);
+
+int
+pz_fork_server(PZ_Context *context,
+               uint8_t    *proc_code,
+               const char *socket_path,
+               unsigned    time_limit,
+               bool        verbose)
+{
+    int listener;
+
+    if (!setup_signals()) return EXIT_FAILURE;
+
+    listener = pz_server_listen(socket_path);
+    if (listener < 0) return EXIT_FAILURE;
+    if (verbose) {
+        printf("Waiting for connections on %s\n", socket_path);
+    }
+
+    while (!stop_server) {
+        int   connection;
+        pid_t pid;
+
+        connection = accept(listener, NULL, NULL);
+        if (connection < 0) {
+            if (errno == EINTR) {
+                // Either a worker exited or we've been asked to stop.
+                reap_workers(verbose);
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+
+        // Don't let the worker inherit anything waiting to be written.
+        fflush(stdout);
+        fflush(stderr);
+        pid = fork();
+        if (pid == 0) {
+            close(listener);
+            run_worker(context, proc_code, connection, time_limit);
+        } else if (pid < 0) {
+            perror("fork");
+        } else if (verbose) {
+            printf("Started worker %d\n", (int)pid);
+        }
+        close(connection);
+        reap_workers(verbose);
+    }
+
+    close(listener);
+    unlink(socket_path);
+    return EXIT_SUCCESS;
+}
+
+static void
+handle_stop(int sig)
+{
+    stop_server = 1;
+}
+
+static void
+handle_child(int sig)
+{
+    /*
+     * Nothing to do, the signal interrupts accept() and then the workers
+     * are reaped.
+     */
+}
+
+static bool
+setup_signals(void)
+{
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    // Not SA_RESTART, these signals must interrupt accept().
+    action.sa_flags = 0;
+
+    action.sa_handler = handle_stop;
+    if ((0 != sigaction(SIGINT, &action, NULL)) ||
+        (0 != sigaction(SIGTERM, &action, NULL)))
+    {
+        perror("sigaction");
+        return false;
+    }
+    action.sa_handler = handle_child;
+    if (0 != sigaction(SIGCHLD, &action, NULL)) {
+        perror("sigaction");
+        return false;
+    }
+
+    return true;
+}
+
+static void
+reap_workers(bool verbose)
+{
+    pid_t pid;
+    int   status;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        if (!verbose) continue;
+        if (WIFEXITED(status)) {
+            printf("Worker %d exited with %d\n", (int)pid,
+                   WEXITSTATUS(status));
+        } else if (WIFSIGNALED(status)) {
+            printf("Worker %d was killed by signal %d\n", (int)pid,
+                   WTERMSIG(status));
+        }
+    }
+}
+
+static void
+run_worker(PZ_Context *context,
+           uint8_t    *proc_code,
+           int         connection,
+           unsigned    time_limit)
+{
+    struct sigaction action;
+    int              retcode;
+
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = SIG_DFL;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGCHLD, &action, NULL);
+
+    if ((dup2(connection, STDIN_FILENO) < 0) ||
+        (dup2(connection, STDOUT_FILENO) < 0))
+    {
+        perror("dup2");
+        exit(EXIT_FAILURE);
+    }
+    close(connection);
+
+    // Alarms aren't inherited, the SIGALRM handler is.
+    if (time_limit > 0) {
+        alarm(time_limit);
+    }
+    retcode = pz_context_run(context, proc_code);
+    fflush(stdout);
+    exit(retcode);
+}
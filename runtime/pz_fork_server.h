@@ -0,0 +1,34 @@
+/*
+ * Plasma fork server
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#ifndef PZ_FORK_SERVER_H
+#define PZ_FORK_SERVER_H
+
+#include "pz_run.h"
+
+/*
+ * A fork server loads the program once and then forks a worker for each
+ * connection to its Unix socket.  Workers share the loaded code and data
+ * with the server, so starting one costs a fork rather than a load.
+ *
+ * A worker's standard input and output are the connection, it runs the
+ * procedure (normally the program's entry procedure) in its copy of
+ * context and exits with its result.  The server runs until it receives
+ * SIGINT or SIGTERM, it then removes the socket.
+ *
+ * If time_limit is non-zero each worker gets a SIGALRM after that many
+ * seconds, the caller's handler should call pz_interrupt().
+ */
+int
+pz_fork_server(PZ_Context *context,
+               uint8_t    *proc_code,
+               const char *socket_path,
+               unsigned    time_limit,
+               bool        verbose);
+
+#endif /* ! PZ_FORK_SERVER_H */
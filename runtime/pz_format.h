@@ -16,6 +16,13 @@
  * unsigned integers in big-endian format unless otherwise specified.
  * Strings are ANSI strings without a null terminated byte.  Their length is
  * usually given by a 16 bit number that precedes them.
+ *
+ * Most counts and IDs are small, so they are encoded as variable length
+ * unsigned integers (marked "varint" below).  These use the LEB128
+ * encoding: each byte holds 7 bits of the value, least significant group
+ * first, and the high bit of each byte is set if another byte follows.
+ * Values up to 127 take a single byte, a 32bit value takes at most 5
+ * bytes.
  */
 
 /*
@@ -24,13 +31,11 @@
  *
  * The PZ file begins with a magic number, a description string whose prefix
  * is given below (suffix & length don't matter allowing an ascii version
- * number to be provided), a 16 bit version number, an options entry then
- * the file's entries.
+ * number to be provided), a 16 bit version number, an options entry, a
+ * section directory then the sections themselves.
  *
- *   PZ ::= Magic DescString VersionNumber Options NumImportDatas(32bit)
- *          NumImportProcs(32bit) NumStructs(32bit) NumDatas(32bit)
- *          NumProcs(32bit)
- *          ImportDataRef* ImportProcRef* StructEntry* DataEntry* ProcEntry*
+ *   PZ ::= Magic DescString VersionNumber Options SectionDirectory
+ *          Section*
  *
  * Options
  * -------
@@ -43,7 +48,34 @@
  *
  *   OptionEntry ::= OptionType(16bit) Len(16bit) OptionValue
  *
- *  Procedure and data entries are each given a unique 32bit procedure or
+ * Sections
+ * --------
+ *
+ * The section directory lists each section with its offset from the
+ * beginning of the file, its length in bytes and a hash of its contents.
+ * A reader can seek directly to the sections it needs, and check each
+ * section's integrity before using it.  The hash is 32bit FNV-1a, see
+ * PZ_HASH_* below.  Sections may appear in any order within the file and
+ * readers skip section types they don't know.  Each of the five section
+ * types below must appear exactly once.
+ *
+ *   SectionDirectory ::= NumSections(8bit) SectionEntry*
+ *
+ *   SectionEntry ::= SectionType(8bit) Offset(32bit) Length(32bit)
+ *                    Hash(32bit)
+ *
+ *   Section ::= ImportsSection | StructsSection | DataSection | CodeSection
+ *             | ExportsSection
+ *
+ *   ImportsSection ::= NumImportDatas(varint) NumImportProcs(varint)
+ *                      ImportDataRef* ImportProcRef*
+ *   StructsSection ::= NumStructs(varint) StructEntry*
+ *   DataSection ::= NumDatas(varint) DataEntry*
+ *   CodeSection ::= NumProcs(varint) ProcEntry*
+ *   ExportsSection ::= ModuleName(String) NumExports(varint)
+ *                      ExportProcRef*
+ *
+ *  Procedure and data entries are each given a unique procedure or
  *  data ID.  To clarify, procedures and data entries exist in seperate ID
  *  spaces.  The IDs start at 0 for the first entry and are given
  *  sequentially in file order.  Therefore the imported procedures have
@@ -62,48 +94,78 @@
  *
  *   ImportProcRef ::= ModuleName(String) ProcName(String)
  *
+ * Exports
+ * -------
+ *
+ *  The exports section names the module and lists the procedures that
+ *  other modules may import from it.  Each procedure is given by its
+ *  unqualified name and its procedure ID, which must be a local procedure.
+ *
+ *   ExportProcRef ::= ProcName(String) ProcID(varint)
+ *
  * Struct information
  * ------------------
  *
- *   StructEntry ::= NumFields(32bit) Width*
+ *   StructEntry ::= NumFields(varint) Width*
  *
  * Constant data
  * -------------
  *
  *  A data entry is a data type followed by the data (numbers and
  *  references).  The number and widths of each number are given by the data
- *  type.  TODO: proc references.
+ *  type, a struct has a value for each of its fields.  References may refer
+ *  to data entries that come later in the section.
  *
  *   DataEntry ::= DataType DataValue*
+ *               | DATA_STRING(8) NumBytes(varint) Byte*
  *
  * Note that an array of structs is acheived by an array o pointers to
  * pre-defined structs.  (TODO: it'd be nice to support other data layouts
  * like an array of structs.)
  *
  *   DataType ::= DATA_BASIC(8) Width
- *              | DATA_ARRAY(8) NumElements(16) Width
- *              | DATA_STRUCT(8) StructRef
+ *              | DATA_ARRAY(8) NumElements(varint) Width
+ *              | DATA_STRUCT(8) StructRef(varint)
+ *
+ *  A string's bytes follow its length directly, without an encoding byte
+ *  each.  Strings are interned when they're loaded (see pz_string.h),
+ *  rather than being put in the module's data segment.
  *
  *  Which data value depends upon context.
  *
  *   DataValue ::= ENC_NORMAL NumBytes Byte*
  *               | ENC_FAST 4 Byte*
  *               | ENC_WPTR 4 Byte*
- *               | ENC_PTR 4 DataIndex(32bit)
+ *               | ENC_PTR Tag DataIndex(varint)
+ *               | ENC_CODE 0 ProcID(varint)
  *
  *  The encoding type and number of bytes are a single byte made up by
  *  PZ_MAKE_ENC below.  Currently fast words and pointer-sized words are
- *  always 32bit.  TODO: Support references to code.
+ *  always 32bit.  For references to data the low bits are a pointer tag
+ *  that is added to the address.  References to code give the address of a
+ *  procedure's code.
  *
  * Code
  * ----
  *
- *   ProcEntry ::= NumBlocks(32bit) Block+
- *   Block ::= NumInstructions(32bit) Instruction+
+ *   ProcEntry ::= NumBlocks(varint) Block+
+ *   Block ::= NumInstructions(varint) Instruction+
  *
- *   Instruction ::= Opcode(8bit) WidthByte{0,2} Immediate?
+ *   Instruction ::= Opcode(8bit) WidthByte? Immediate?
  *      InstructionStream?
  *
+ *  Instructions with two operand widths pack both of them into a single
+ *  width byte, see PZ_MAKE_WIDTHS below.
+ *
+ *  8bit immediate values, including the field number of a struct
+ *  reference, are a single byte.  64bit immediate values are always 8
+ *  bytes.  16 and 32bit numbers are signed varints: the varint of their
+ *  zigzag encoding, which maps 0, -1, 1, -2, ... to 0, 1, 2, 3, ..., so
+ *  that small negative numbers are short too.  The numbers are sign
+ *  extended from their width first, so an unsigned number's bit pattern
+ *  is kept.  References to procedures, data, structs and blocks are
+ *  varints.
+ *
  * Shared items
  * ------------
  *
@@ -120,11 +182,31 @@
 
 #define PZ_MAGIC_NUMBER         0x505A
 #define PZ_MAGIC_STRING_PART    "Plasma abstract machine bytecode"
-#define PZ_FORMAT_VERSION       0
+#define PZ_FORMAT_VERSION       6
 
 #define PZ_OPT_ENTRY_PROC       0
     /* Value: 32bit number of the program's entry procedure aka main() */
 
+#define PZ_SECTION_IMPORTS      0
+#define PZ_SECTION_STRUCTS      1
+#define PZ_SECTION_DATA         2
+#define PZ_SECTION_CODE         3
+#define PZ_SECTION_EXPORTS      4
+#define PZ_NUM_SECTION_TYPES    5
+
+/*
+ * The size of each entry in the section directory.
+ */
+#define PZ_SECTION_ENTRY_SIZE   13
+
+/*
+ * Section contents are hashed with 32bit FNV-1a: starting with
+ * PZ_HASH_INIT, for each byte xor the byte into the hash then multiply by
+ * PZ_HASH_PRIME modulo 2^32.
+ */
+#define PZ_HASH_INIT            0x811C9DC5
+#define PZ_HASH_PRIME           0x01000193
+
 /*
  * The width of data, either as an operand or in memory such as in a struct.
  */
@@ -137,14 +219,26 @@ typedef enum {
     PZW_PTR,  // native pointer width
 } Width;
 
+/*
+ * When an instruction has two operand widths they're packed into a single
+ * byte, the first width in the high nibble and the second in the low
+ * nibble.
+ */
+#define PZ_MAKE_WIDTHS(w1, w2)    (((w1) << 4) | (w2))
+#define PZ_WIDTHS_FIRST(byte)     (((byte) >> 4) & 0x0F)
+#define PZ_WIDTHS_SECOND(byte)    ((byte) & 0x0F)
+
 #define PZ_DATA_BASIC           0
 #define PZ_DATA_ARRAY           1
 #define PZ_DATA_STRUCT          2
+#define PZ_DATA_STRING          3
 
 /*
  * The high bits of a data width give the width type.  Width types are:
- *  - Pointers:                 32-bit references to some other
- *                              value, updated on load.
+ *  - Pointers:                 References (varint data indexes) to some
+ *                              other value, updated on load.
+ *  - Code:                     References (varint proc IDs) to some
+ *                              procedure's code, updated on load.
  *  - Words with pointer width: 32-bit values zero-extended to the width of
  *                              a pointer.
  *  - Fast words:               Must be encoded with 32bits.
@@ -164,7 +258,8 @@ enum pz_data_enc_type {
     pz_data_enc_type_normal = 0x10,
     pz_data_enc_type_fast   = 0x20,
     pz_data_enc_type_wptr   = 0x30,
-    pz_data_enc_type_ptr    = 0x40
+    pz_data_enc_type_ptr    = 0x40,
+    pz_data_enc_type_code   = 0x50
 };
 
 #endif /* ! PZ_FORMAT_H */
@@ -0,0 +1,201 @@
+/*
+ * Hash table
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pz_common.h"
+
+#include "pz_format.h"
+#include "pz_hash_table.h"
+
+/*
+ * An open addressing table with linear probing.  The slots are a single
+ * array, and each slot holds its key's hash so that most probes that don't
+ * match never touch the key.  The keys are stored one after the other in a
+ * single buffer and referred to by their offset within it.
+ *
+ * See runtime/pz_symbol_bench.c for a comparison with the radix tree this
+ * replaced.
+ */
+
+#define INITIAL_NUM_SLOTS   16
+#define INITIAL_KEYS_SIZE   256
+
+typedef struct {
+    uint32_t  hash;
+    uint32_t  key_offset;
+    uint32_t  key_len;
+    // NULL if this slot is empty.
+    void     *value;
+} PZ_HashTable_Slot;
+
+struct PZ_HashTable_Struct {
+    PZ_HashTable_Slot *slots;
+    // Always a power of two.
+    unsigned           num_slots;
+    unsigned           num_items;
+
+    char              *keys;
+    uint32_t           keys_size;
+    uint32_t           keys_capacity;
+};
+
+static uint32_t
+hash_string(const char *key, uint32_t *len);
+
+static PZ_HashTable_Slot *
+find_slot(const PZ_HashTable *table, const char *key, uint32_t key_len,
+          uint32_t hash);
+
+static void
+grow(PZ_HashTable *table);
+
+PZ_HashTable *
+pz_hash_init(void)
+{
+    PZ_HashTable *table;
+
+    table = malloc(sizeof(PZ_HashTable));
+    table->num_slots = INITIAL_NUM_SLOTS;
+    table->slots = calloc(table->num_slots, sizeof(PZ_HashTable_Slot));
+    table->num_items = 0;
+    table->keys_capacity = INITIAL_KEYS_SIZE;
+    table->keys = malloc(table->keys_capacity);
+    table->keys_size = 0;
+
+    return table;
+}
+
+void
+pz_hash_free(PZ_HashTable *table, free_fn free_item)
+{
+    if (NULL != free_item) {
+        for (unsigned i = 0; i < table->num_slots; i++) {
+            if (NULL != table->slots[i].value) {
+                free_item(table->slots[i].value);
+            }
+        }
+    }
+
+    free(table->slots);
+    free(table->keys);
+    free(table);
+}
+
+void *
+pz_hash_lookup(const PZ_HashTable *table, const char *key)
+{
+    uint32_t key_len;
+    uint32_t hash = hash_string(key, &key_len);
+
+    return find_slot(table, key, key_len, hash)->value;
+}
+
+void
+pz_hash_insert(PZ_HashTable *table, const char *key, void *value)
+{
+    uint32_t           key_len;
+    uint32_t           hash = hash_string(key, &key_len);
+    PZ_HashTable_Slot *slot;
+
+    assert(NULL != value);
+
+    // Keep the table at most 3/4 full so that probe sequences stay short.
+    if ((table->num_items + 1) * 4 > table->num_slots * 3) {
+        grow(table);
+    }
+
+    slot = find_slot(table, key, key_len, hash);
+    if (NULL != slot->value) {
+        fprintf(stderr, "Collision for %s pz_hash_insert", key);
+        abort();
+    }
+
+    while (table->keys_size + key_len + 1 > table->keys_capacity) {
+        table->keys_capacity *= 2;
+        table->keys = realloc(table->keys, table->keys_capacity);
+    }
+    memcpy(&table->keys[table->keys_size], key, key_len + 1);
+
+    slot->hash = hash;
+    slot->key_offset = table->keys_size;
+    slot->key_len = key_len;
+    slot->value = value;
+    table->keys_size += key_len + 1;
+    table->num_items++;
+}
+
+/*
+ * 32bit FNV-1a, the same hash used for PZ file sections.  The key's length
+ * is computed at the same time.
+ */
+static uint32_t
+hash_string(const char *key, uint32_t *len)
+{
+    uint32_t hash = PZ_HASH_INIT;
+    uint32_t i;
+
+    for (i = 0; key[i] != 0; i++) {
+        hash = (hash ^ (unsigned char)key[i]) * PZ_HASH_PRIME;
+    }
+    *len = i;
+
+    return hash;
+}
+
+/*
+ * Find the slot holding key, or the empty slot where it would go.
+ */
+static PZ_HashTable_Slot *
+find_slot(const PZ_HashTable *table, const char *key, uint32_t key_len,
+          uint32_t hash)
+{
+    unsigned mask = table->num_slots - 1;
+    unsigned i = hash & mask;
+
+    while (true) {
+        PZ_HashTable_Slot *slot = &table->slots[i];
+
+        if (NULL == slot->value) {
+            return slot;
+        }
+        if ((slot->hash == hash) && (slot->key_len == key_len) &&
+            (0 == memcmp(&table->keys[slot->key_offset], key, key_len)))
+        {
+            return slot;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static void
+grow(PZ_HashTable *table)
+{
+    PZ_HashTable_Slot *old_slots = table->slots;
+    unsigned           old_num_slots = table->num_slots;
+
+    table->num_slots *= 2;
+    table->slots = calloc(table->num_slots, sizeof(PZ_HashTable_Slot));
+
+    for (unsigned i = 0; i < old_num_slots; i++) {
+        PZ_HashTable_Slot *old_slot = &old_slots[i];
+
+        if (NULL != old_slot->value) {
+            unsigned mask = table->num_slots - 1;
+            unsigned j = old_slot->hash & mask;
+
+            while (NULL != table->slots[j].value) {
+                j = (j + 1) & mask;
+            }
+            table->slots[j] = *old_slot;
+        }
+    }
+
+    free(old_slots);
+}
@@ -0,0 +1,39 @@
+/*
+ * Hash table data structure for symbol lookup
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#ifndef PZ_HASH_TABLE_H
+#define PZ_HASH_TABLE_H
+
+/*
+ * A table from strings to non-NULL values.  Keys are copied into the
+ * table.
+ */
+typedef struct PZ_HashTable_Struct PZ_HashTable;
+
+PZ_HashTable *
+pz_hash_init(void);
+
+/*
+ * If free_item is non-NULL it is called for each value.
+ */
+void
+pz_hash_free(PZ_HashTable *table, free_fn free_item);
+
+/*
+ * Returns NULL if the key is not in the table.
+ */
+void *
+pz_hash_lookup(const PZ_HashTable *table, const char *key);
+
+/*
+ * The key must not already be in the table.
+ */
+void
+pz_hash_insert(PZ_HashTable *table, const char *key, void *value);
+
+#endif /* ! PZ_HASH_TABLE_H */
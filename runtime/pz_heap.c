@@ -0,0 +1,230 @@
+/*
+ * Plasma heap
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "pz_common.h"
+
+#include "pz_heap.h"
+#include "pz_segment.h"
+#include "pz_util.h"
+
+typedef struct PZ_Heap_Chunk_Struct PZ_Heap_Chunk;
+
+struct PZ_Heap_Chunk_Struct {
+    PZ_Heap_Chunk *next;
+    size_t         size;
+    // Normal chunks come from the pool, large objects' chunks are malloced.
+    bool           pooled;
+    /*
+     * A union so that the objects after the header are aligned.
+     */
+    union {
+        uintptr_t  word;
+        uint8_t    bytes[1];
+    } data;
+};
+
+/*
+ * The rest of the current chunk is the heap's allocation buffer.  A heap
+ * is only used by one thread at a time, so allocating from the buffer
+ * takes no lock, only refilling it does.
+ */
+struct PZ_Heap_Struct {
+    // The current chunk is first, it is followed by full chunks.
+    PZ_Heap_Chunk *chunks;
+    uint8_t       *next;
+    uint8_t       *limit;
+};
+
+/*
+ * The chunk pool is shared by every heap in the process.  It maps memory
+ * PZ_HEAP_CHUNKS_PER_MAPPING chunks at a time and keeps the chunks that
+ * heaps give back, so that heaps that are reset often, or are used by
+ * many threads at once, don't call mmap and munmap or malloc for each
+ * chunk.
+ */
+static pthread_mutex_t  pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static PZ_Heap_Chunk   *pool = NULL;
+static unsigned         pool_size = 0;
+
+#define CHUNK_DATA_SIZE \
+    (PZ_HEAP_CHUNK_SIZE - offsetof(PZ_Heap_Chunk, data))
+
+static PZ_Heap_Chunk *
+pool_get_chunk(void);
+
+static void
+pool_put_chunk(PZ_Heap_Chunk *chunk);
+
+static PZ_Heap_Chunk *
+new_large_chunk(size_t size);
+
+static void
+free_chunk(PZ_Heap_Chunk *chunk);
+
+PZ_Heap *
+pz_heap_init(void)
+{
+    PZ_Heap *heap;
+
+    heap = malloc(sizeof(PZ_Heap));
+    heap->chunks = pool_get_chunk();
+    heap->next = heap->chunks->data.bytes;
+    heap->limit = heap->next + heap->chunks->size;
+
+    return heap;
+}
+
+void
+pz_heap_free(PZ_Heap *heap)
+{
+    pz_heap_reset(heap);
+    free_chunk(heap->chunks);
+    free(heap);
+}
+
+void *
+pz_heap_alloc(PZ_Heap *heap, size_t size)
+{
+    void *result;
+
+    size = ALIGN_UP(size, MACHINE_WORD_SIZE);
+    if (size > (size_t)(heap->limit - heap->next)) {
+        PZ_Heap_Chunk *chunk;
+
+        if (size > CHUNK_DATA_SIZE / 4) {
+            /*
+             * Large objects get a chunk of their own, it goes after the
+             * current chunk so that the current chunk can still be used.
+             */
+            chunk = new_large_chunk(size);
+            chunk->next = heap->chunks->next;
+            heap->chunks->next = chunk;
+            return chunk->data.bytes;
+        }
+
+        chunk = pool_get_chunk();
+        chunk->next = heap->chunks;
+        heap->chunks = chunk;
+        heap->next = chunk->data.bytes;
+        heap->limit = heap->next + chunk->size;
+    }
+
+    result = heap->next;
+    heap->next += size;
+    return result;
+}
+
+void
+pz_heap_reset(PZ_Heap *heap)
+{
+    PZ_Heap_Chunk *chunk = heap->chunks;
+    PZ_Heap_Chunk *first = NULL;
+
+    // Keep one chunk of the normal size.
+    while (chunk != NULL) {
+        PZ_Heap_Chunk *next = chunk->next;
+
+        if ((first == NULL) && chunk->pooled) {
+            first = chunk;
+        } else {
+            free_chunk(chunk);
+        }
+        chunk = next;
+    }
+
+    first->next = NULL;
+    heap->chunks = first;
+    heap->next = first->data.bytes;
+    heap->limit = heap->next + first->size;
+}
+
+static PZ_Heap_Chunk *
+pool_get_chunk(void)
+{
+    PZ_Heap_Chunk *chunk;
+    uint8_t       *mapping;
+    size_t         mapping_size;
+
+    pthread_mutex_lock(&pool_lock);
+    chunk = pool;
+    if (chunk != NULL) {
+        pool = chunk->next;
+        pool_size--;
+        pthread_mutex_unlock(&pool_lock);
+        chunk->next = NULL;
+        return chunk;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    mapping = pz_segment_init(
+      PZ_HEAP_CHUNK_SIZE * PZ_HEAP_CHUNKS_PER_MAPPING, true, &mapping_size);
+    if (mapping == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        abort();
+    }
+
+    // Keep the first chunk and give the rest to the pool.
+    for (unsigned i = 0; i < PZ_HEAP_CHUNKS_PER_MAPPING; i++) {
+        chunk = (PZ_Heap_Chunk *)(mapping + i * PZ_HEAP_CHUNK_SIZE);
+        chunk->next = NULL;
+        chunk->size = CHUNK_DATA_SIZE;
+        chunk->pooled = true;
+        if (i > 0) {
+            pool_put_chunk(chunk);
+        }
+    }
+    return (PZ_Heap_Chunk *)mapping;
+}
+
+static void
+pool_put_chunk(PZ_Heap_Chunk *chunk)
+{
+    pthread_mutex_lock(&pool_lock);
+    if (pool_size < PZ_HEAP_POOL_MAX_CHUNKS) {
+        chunk->next = pool;
+        pool = chunk;
+        pool_size++;
+        chunk = NULL;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    if (chunk != NULL) {
+        pz_segment_free((uint8_t *)chunk, PZ_HEAP_CHUNK_SIZE);
+    }
+}
+
+static PZ_Heap_Chunk *
+new_large_chunk(size_t size)
+{
+    PZ_Heap_Chunk *chunk;
+
+    chunk = malloc(sizeof(PZ_Heap_Chunk) + size);
+    if (chunk == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        abort();
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->pooled = false;
+
+    return chunk;
+}
+
+static void
+free_chunk(PZ_Heap_Chunk *chunk)
+{
+    if (chunk->pooled) {
+        pool_put_chunk(chunk);
+    } else {
+        free(chunk);
+    }
+}
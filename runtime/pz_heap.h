@@ -0,0 +1,45 @@
+/*
+ * Plasma heap
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#ifndef PZ_HEAP_H
+#define PZ_HEAP_H
+
+/*
+ * The heap holds the objects that a program allocates.  It is a region:
+ * objects are allocated by bumping a pointer through large chunks and
+ * are never freed individually.  Instead the whole heap is reset once the
+ * program has finished with everything in it, such as between the
+ * requests handled by a server.
+ *
+ * Each context has its own heap and only one thread uses a heap at a
+ * time, so allocating takes no lock.  When a heap's chunk is full it takes
+ * another from a pool shared by every heap, see pz_config.h.
+ */
+typedef struct PZ_Heap_Struct PZ_Heap;
+
+PZ_Heap *
+pz_heap_init(void);
+
+void
+pz_heap_free(PZ_Heap *heap);
+
+/*
+ * Allocate size bytes aligned to the machine word size, leaving room for
+ * pointer tags.
+ */
+void *
+pz_heap_alloc(PZ_Heap *heap, size_t size);
+
+/*
+ * Free everything allocated from the heap.  The first chunk is kept for
+ * reuse.
+ */
+void
+pz_heap_reset(PZ_Heap *heap);
+
+#endif /* ! PZ_HEAP_H */
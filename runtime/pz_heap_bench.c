@@ -0,0 +1,106 @@
+/*
+ * Heap allocation benchmark
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ *
+ * This program measures how allocation throughput changes with the number
+ * of threads allocating at once, each from its own heap as each worker's
+ * context does.  Run it with "make bench".
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "pz_common.h"
+
+#include "pz_heap.h"
+
+#define MAX_THREADS 8
+#define NUM_ROUNDS 20
+#define ALLOCS_PER_ROUND 1000000
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Allocate small objects of a few sizes, resetting the heap after each
+ * round the way a server does between requests.  The heap takes more
+ * chunks from the shared pool during each round and gives them back when
+ * it's reset.
+ */
+static void *
+allocate(void *arg)
+{
+    PZ_Heap   *heap = pz_heap_init();
+    uintptr_t *total = arg;
+    // Sum into a local, the threads' totals share a cache line.
+    uintptr_t  sum = 0;
+
+    for (unsigned round = 0; round < NUM_ROUNDS; round++) {
+        for (unsigned i = 0; i < ALLOCS_PER_ROUND; i++) {
+            uintptr_t *obj = pz_heap_alloc(heap, 16 + (i % 4) * 8);
+
+            obj[0] = i;
+            sum += (uintptr_t)obj[0];
+        }
+        pz_heap_reset(heap);
+    }
+
+    pz_heap_free(heap);
+    *total += sum;
+    return NULL;
+}
+
+int
+main(int argc, char *const argv[])
+{
+    uintptr_t total[MAX_THREADS] = { 0 };
+    uintptr_t checksum = 0;
+    double    single_rate = 0;
+
+    for (unsigned num_threads = 1; num_threads <= MAX_THREADS;
+            num_threads *= 2)
+    {
+        pthread_t threads[MAX_THREADS];
+        double    start, time, rate;
+
+        start = now();
+        for (unsigned t = 0; t < num_threads; t++) {
+            if (0 != pthread_create(&threads[t], NULL, allocate,
+                        &total[t]))
+            {
+                fprintf(stderr, "Couldn't create a thread\n");
+                return EXIT_FAILURE;
+            }
+        }
+        for (unsigned t = 0; t < num_threads; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        time = now() - start;
+
+        rate = (double)num_threads * NUM_ROUNDS * ALLOCS_PER_ROUND /
+            time / 1e6;
+        if (num_threads == 1) {
+            single_rate = rate;
+        }
+        printf("%u thread(s): %7.1fM allocations/s, %4.2fx one thread\n",
+               num_threads, rate, rate / single_rate);
+    }
+
+    for (unsigned t = 0; t < MAX_THREADS; t++) {
+        checksum += total[t];
+    }
+    // Use the result so that the stores aren't optimised away.
+    printf("(checksum %lu)\n", (unsigned long)checksum);
+
+    return EXIT_SUCCESS;
+}
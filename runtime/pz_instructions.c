@@ -86,9 +86,28 @@ Instruction_Info instruction_info_data[] = {
     /* PZI_STORE */
     { 1, IMT_STRUCT_REF_FIELD },
 
+    /* PZI_SPAWN */
+    { 1, IMT_CODE_REF },
+    /* PZI_WAIT */
+    { 1, IMT_NONE },
+
     /* Non-encoded instructions */
     /* PZI_END */
     { 0, IMT_NONE },
     /* PZI_CCALL */
-    { 0, IMT_CODE_REF }
+    { 0, IMT_CODE_REF },
+    /* PZI_TASK_RESULT */
+    { 0, IMT_NONE },
+    /* PZI_TASK_END */
+    { 0, IMT_NONE },
+    /* PZI_PARALLEL_MAP */
+    { 0, IMT_NONE },
+    /* PZI_PARALLEL_REDUCE */
+    { 0, IMT_NONE },
+    /* PZI_PARALLEL_STEP */
+    { 0, IMT_NONE },
+    /* PZI_CHUNK_START */
+    { 0, IMT_NONE },
+    /* PZI_CHUNK_STEP */
+    { 0, IMT_NONE }
 };
@@ -72,13 +72,30 @@ typedef enum {
     PZI_LOAD,
     PZI_STORE,
 
+    /*
+     * Spawn a call to a procedure as a task, it may run in parallel with
+     * its caller.  The procedure takes and returns a single value.  Wait
+     * replaces a task with the value it returned.
+     */
+    PZI_SPAWN,
+    PZI_WAIT,
+
     /*
      * These instructions do not appear in bytecode, they are implied by
      * other instructions during bytecode loading and inserted into the
      * instruction stream then.
      */
     PZI_END,
-    PZI_CCALL
+    PZI_CCALL,
+    // Used by fibers that run spawned tasks.
+    PZI_TASK_RESULT,
+    PZI_TASK_END,
+    // Used by the parallel_map and parallel_reduce builtins.
+    PZI_PARALLEL_MAP,
+    PZI_PARALLEL_REDUCE,
+    PZI_PARALLEL_STEP,
+    PZI_CHUNK_START,
+    PZI_CHUNK_STEP
 } Opcode;
 
 typedef enum {
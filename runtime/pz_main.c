@@ -8,16 +8,18 @@
  * This program executes plasma bytecode.
  */
 
+#include <getopt.h>
+#include <signal.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "pz_common.h"
 
-#include "pz.h"
-#include "pz_builtin.h"
-#include "pz_radix_tree.h"
-#include "pz_read.h"
-#include "pz_run.h"
+#include "pz_api.h"
+#include "pz_fork_server.h"
+#include "pz_scheduler.h"
+#include "pz_server.h"
 
 static void
 help(const char *progname, FILE *stream);
@@ -25,15 +27,73 @@ help(const char *progname, FILE *stream);
 static void
 version(void);
 
+static int
+run_init(const PZ *pz, PZ_Context *context, const char *init_proc);
+
+static bool
+setup_time_limit(void);
+
+static void
+time_limit_handler(int signal);
+
+static const char *short_options = "c:f:i:j:s::t:vVh";
+
+static const struct option long_options[] = {
+    { "serve", optional_argument, NULL, 's' },
+    { NULL, 0, NULL, 0 }
+};
+
 int
 main(int argc, char *const argv[])
 {
-    bool verbose = false;
-    int  option;
+    bool        verbose = false;
+    const char *cache_dir = getenv("PZ_CACHE_DIR");
+    const char *socket_path = NULL;
+    bool        serve = false;
+    const char *init_proc = NULL;
+    unsigned    num_workers = pz_scheduler_default_workers();
+    unsigned    time_limit = 0;
+    int         option;
 
-    option = getopt(argc, argv, "vVh");
+    option = getopt_long(argc, argv, short_options, long_options, NULL);
     while (option != -1) {
         switch (option) {
+            case 'c':
+                cache_dir = optarg;
+                break;
+            case 'f':
+                socket_path = optarg;
+                break;
+            case 'i':
+                init_proc = optarg;
+                break;
+            case 'j': {
+                char *end;
+                long  jobs = strtol(optarg, &end, 10);
+
+                if ((*end != 0) || (jobs < 1) || (jobs > UINT_MAX)) {
+                    fprintf(stderr, "Invalid number of workers: %s\n",
+                            optarg);
+                    return EXIT_FAILURE;
+                }
+                num_workers = jobs;
+                break;
+            }
+            case 's':
+                serve = true;
+                socket_path = optarg;
+                break;
+            case 't': {
+                char *end;
+                long  seconds = strtol(optarg, &end, 10);
+
+                if ((*end != 0) || (seconds < 1) || (seconds > UINT_MAX)) {
+                    fprintf(stderr, "Invalid time limit: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                time_limit = seconds;
+                break;
+            }
             case 'h':
                 help(argv[0], stdout);
                 return EXIT_SUCCESS;
@@ -47,37 +107,87 @@ main(int argc, char *const argv[])
                 help(argv[0], stderr);
                 return EXIT_FAILURE;
         }
-        option = getopt(argc, argv, "vh");
+        option = getopt_long(argc, argv, short_options, long_options,
+                             NULL);
+    }
+    if ((time_limit > 0) && serve) {
+        fprintf(stderr, "A time limit can't be used with --serve\n");
+        return EXIT_FAILURE;
+    }
+    if ((time_limit > 0) && !setup_time_limit()) {
+        return EXIT_FAILURE;
     }
-    if (optind + 1 == argc) {
-        PZ_Module *builtins;
-        PZ_Module *module;
-        PZ        *pz;
 
-        builtins = pz_setup_builtins();
-        pz = pz_init();
-        pz_add_module(pz, "builtin", builtins);
-        module = pz_read(pz, argv[optind], verbose);
-        if (module != NULL) {
-            int retcode;
+    if (optind < argc) {
+        PZ *pz;
 
-            pz_add_entry_module(pz, module);
-            retcode = pz_run(pz);
+        pz = pz_load(argc - optind, (const char *const *)&argv[optind],
+                     cache_dir, verbose);
+        if (pz != NULL) {
+            PZ_Context   *context;
+            PZ_Scheduler *sched = NULL;
+            int           retcode = 0;
+
+            /*
+             * The program's output bypasses stdio, anything that the loader
+             * printed must be written first.
+             */
+            fflush(stdout);
+            context = pz_context_init();
+            if (init_proc != NULL) {
+                retcode = run_init(pz, context, init_proc);
+            }
+            /*
+             * The scheduler is attached after the init procedure has run
+             * so that a fork server never starts threads before it forks,
+             * its workers start their own.  A single worker still needs a
+             * scheduler, so that a task blocked on a channel lets the
+             * others run.
+             */
+            if (retcode == 0) {
+                sched = pz_scheduler_init(num_workers);
+                if (sched != NULL) {
+                    pz_scheduler_attach(sched, context);
+                } else {
+                    retcode = EXIT_FAILURE;
+                }
+            }
+            if (retcode != 0) {
+                // The error has been reported.
+            } else if (serve) {
+                retcode = pz_server(pz, context, socket_path, verbose);
+            } else {
+                uint8_t *entry_proc = pz_get_entry_proc_code(pz);
+
+                if (entry_proc == NULL) {
+                    fprintf(stderr, "No entry procedure\n");
+                    retcode = EXIT_FAILURE;
+                } else if (socket_path != NULL) {
+                    retcode = pz_fork_server(context, entry_proc,
+                                             socket_path, time_limit,
+                                             verbose);
+                } else {
+                    if (time_limit > 0) {
+                        alarm(time_limit);
+                    }
+                    retcode = pz_context_run(context, entry_proc);
+                }
+            }
 
 #ifndef NDEBUG
             // This free makes reading valgrind's reports a little easier.
+            if (sched != NULL) {
+                pz_scheduler_free(sched);
+            }
+            pz_context_free(context);
             pz_free(pz);
 #endif
             return retcode;
         } else {
-#ifndef NDEBUG
-            // This free makes reading valgrind's reports a little easier.
-            pz_free(pz);
-#endif
             return EXIT_FAILURE;
         }
     } else {
-        fprintf(stderr, "Expected exactly one PZ file\n");
+        fprintf(stderr, "Expected at least one PZ file\n");
         help(argv[0], stderr);
         return EXIT_FAILURE;
     }
@@ -85,12 +195,100 @@ main(int argc, char *const argv[])
     return EXIT_SUCCESS;
 }
 
+/*
+ * Run the procedure exported by the entry module with the given name.
+ */
+static int
+run_init(const PZ *pz, PZ_Context *context, const char *init_proc)
+{
+    uint8_t *proc;
+    int      retcode;
+
+    proc = pz_lookup_proc(pz, NULL, init_proc);
+    if (proc == NULL) {
+        fprintf(stderr, "Procedure not found: %s\n", init_proc);
+        return EXIT_FAILURE;
+    }
+
+    retcode = pz_context_run(context, proc);
+    if (retcode != 0) {
+        fprintf(stderr, "%s returned %d\n", init_proc, retcode);
+    }
+    return retcode;
+}
+
+static bool
+setup_time_limit(void)
+{
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = time_limit_handler;
+    if (0 != sigaction(SIGALRM, &action, NULL)) {
+        perror("sigaction");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * The program stops at its next safepoint.
+ */
+static void
+time_limit_handler(int signal)
+{
+    static const char message[] = "Time limit exceeded\n";
+    ssize_t           result;
+
+    result = write(STDERR_FILENO, message, sizeof(message) - 1);
+    (void)result;
+    pz_interrupt();
+}
+
 static void
 help(const char *progname, FILE *stream)
 {
-    fprintf(stream, "%s [-v] <PZ FILE>\n", progname);
+    fprintf(stream, "%s [-v] [-c CACHE_DIR] [-i INIT_PROC] [-j WORKERS] "
+                    "[-t SECONDS]\n"
+                    "    [-f SOCKET | --serve[=SOCKET]] "
+                    "[<LIBRARY PZ FILE> ...] <PZ FILE>\n", progname);
     fprintf(stream, "%s -h\n", progname);
     fprintf(stream, "%s -V\n", progname);
+    fprintf(stream, "\n");
+    fprintf(stream, "  Library modules are loaded in the order given, each "
+                    "module may import\n");
+    fprintf(stream, "  any module before it.  The last PZ file is the "
+                    "program.\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "  -c CACHE_DIR  Cache translated code in CACHE_DIR, "
+                    "this may also be\n");
+    fprintf(stream, "                set with the PZ_CACHE_DIR environment "
+                    "variable.\n");
+    fprintf(stream, "  -i INIT_PROC  Run the procedure INIT_PROC exported by "
+                    "the program\n");
+    fprintf(stream, "                before the entry procedure, it must "
+                    "return 0.\n");
+    fprintf(stream, "  -j WORKERS    Run spawned tasks on WORKERS threads, "
+                    "the default is\n");
+    fprintf(stream, "                one for each CPU.  With -j 1 tasks "
+                    "take turns on one\n");
+    fprintf(stream, "                thread.\n");
+    fprintf(stream, "  -t SECONDS    Stop the program if it runs for longer "
+                    "than SECONDS, or\n");
+    fprintf(stream, "                with -f each worker.\n");
+    fprintf(stream, "  -f SOCKET     Run as a fork server, forking a worker "
+                    "for each\n");
+    fprintf(stream, "                connection to the Unix socket SOCKET, "
+                    "see\n");
+    fprintf(stream, "                runtime/pz_fork_server.h.\n");
+    fprintf(stream, "  -s, --serve[=SOCKET]\n");
+    fprintf(stream, "                Run as a persistent server, running a "
+                    "procedure for each\n");
+    fprintf(stream, "                request read from the standard input "
+                    "or from the Unix\n");
+    fprintf(stream, "                socket SOCKET, see "
+                    "runtime/pz_server.h.\n");
 }
 
 static void
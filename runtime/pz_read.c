@@ -14,21 +14,104 @@
 
 #include "io_utils.h"
 #include "pz.h"
+#include "pz_cache.h"
 #include "pz_code.h"
 #include "pz_data.h"
 #include "pz_format.h"
-#include "pz_radix_tree.h"
 #include "pz_read.h"
 #include "pz_run.h"
+#include "pz_segment.h"
+#include "pz_string.h"
+#include "pz_util.h"
 
 typedef struct {
     unsigned         num_procs;
     PZ_Proc_Symbol **procs;
 } PZ_Imported;
 
+/*
+ * The kind of address written by an instruction's immediate value, so
+ * that it can be relocated when loaded from the cache.
+ */
+typedef enum {
+    RELOC_NONE,
+    RELOC_CODE,
+    RELOC_DATA,
+    RELOC_IMPORT
+} Reloc_Kind;
+
+/*
+ * The procedures that each procedure refers to, used to lay out the code.
+ */
+typedef struct {
+    unsigned  num_callees;
+    unsigned  capacity;
+    unsigned *callees;
+} PZ_Callees;
+
+/*
+ * A reference within static data that can't be written while the data is
+ * read.  Either a data entry that comes later in the section, or code,
+ * which is loaded after the data.
+ */
+typedef struct {
+    Reloc_Kind  kind;
+    void      **dest;
+    unsigned    target;
+    unsigned    tag;
+} PZ_Data_Fixup;
+
+typedef struct {
+    unsigned       num_fixups;
+    unsigned       capacity;
+    PZ_Data_Fixup *fixups;
+} PZ_Data_Fixups;
+
+typedef struct {
+    uint32_t  hash;
+    size_t    size;
+    uint8_t  *data;
+} PZ_Data_Index_Slot;
+
+typedef struct {
+    unsigned            num_slots;
+    PZ_Data_Index_Slot *slots;
+} PZ_Data_Index;
+
+typedef struct {
+    bool     present;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t hash;
+} PZ_Section;
+
+static bool
+read_file_contents(FILE *file, uint8_t **contents, size_t *size);
+
 static bool
 read_options(FILE *file, const char *filename, int32_t *entry_proc);
 
+static bool
+read_section_directory(FILE          *file,
+                       const char    *filename,
+                       const uint8_t *contents,
+                       size_t         size,
+                       PZ_Section     sections[PZ_NUM_SECTION_TYPES],
+                       uint64_t      *file_hash);
+
+static bool
+check_section_hash(const char    *filename,
+                   const uint8_t *contents,
+                   size_t         size,
+                   PZ_Section    *section,
+                   uint64_t      *file_hash);
+
+static bool
+seek_section(FILE *file, PZ_Section *section);
+
+static bool
+check_section_end(FILE *file, const char *filename, PZ_Section *section);
+
 static bool
 read_imported_data(FILE *file, unsigned num_data, const char *filename);
 
@@ -39,6 +122,13 @@ read_imported_procs(FILE        *file,
                     PZ_Imported *imported,
                     const char  *filename);
 
+static bool
+read_exports(FILE       *file,
+             unsigned    num_exports,
+             unsigned    num_imported_procs,
+             PZ_Module  *module,
+             const char *filename);
+
 static bool
 read_structs(FILE       *file,
              unsigned    num_structs,
@@ -47,37 +137,87 @@ read_structs(FILE       *file,
              bool        verbose);
 
 static bool
-read_data(FILE       *file,
-          unsigned    num_datas,
-          PZ_Module  *module,
-          const char *filename,
-          bool        verbose);
+read_data(FILE           *file,
+          unsigned        num_datas,
+          PZ_Module      *module,
+          PZ_Imported    *imported,
+          PZ_Data_Fixups *fixups,
+          uint8_t       **segment,
+          size_t         *mapping_size,
+          const char     *filename,
+          bool            verbose);
+
+static bool
+read_data_type(FILE       *file,
+               PZ_Module  *module,
+               unsigned   *mem_width,
+               uint32_t   *num_elements,
+               PZ_Struct **struct_,
+               bool       *string);
+
+static void
+data_index_init(PZ_Data_Index *index, unsigned num_datas);
+
+static uint8_t *
+data_index_find_or_add(PZ_Data_Index *index, uint8_t *data, size_t size);
 
 static bool
 read_data_width(FILE *file, unsigned *mem_width);
 
 static bool
-read_data_slot(FILE *file, void *dest, PZ_Module *module);
+read_data_slot(FILE           *file,
+               void           *dest,
+               PZ_Module      *module,
+               PZ_Imported    *imported,
+               PZ_Data_Fixups *fixups);
+
+static void
+add_data_fixup(PZ_Data_Fixups *fixups,
+               Reloc_Kind      kind,
+               void           *dest,
+               unsigned        target,
+               unsigned        tag);
 
 static bool
-read_code(FILE        *file,
-          unsigned     num_procs,
-          PZ_Module   *module,
-          PZ_Imported *imported,
-          const char  *filename,
-          bool         verbose);
+fixup_data_code_refs(PZ_Data_Fixups *fixups,
+                     PZ_Module      *module,
+                     PZ_Imported    *imported,
+                     const char     *filename);
+
+static bool
+skip_data_slot(FILE *file);
+
+static bool
+read_code(FILE             *file,
+          unsigned          num_procs,
+          PZ_Module        *module,
+          PZ_Imported      *imported,
+          PZ_Cache_Builder *cache,
+          const char       *filename,
+          bool              verbose);
 
 static unsigned
-read_proc(FILE         *file,
-          PZ_Imported  *imported,
-          PZ_Module    *module,
-          uint8_t      *proc_code,
-          unsigned    **block_offsets);
+read_proc(FILE              *file,
+          PZ_Imported       *imported,
+          PZ_Module         *module,
+          PZ_Cache_Builder  *cache,
+          unsigned           proc_num,
+          uint8_t           *proc_code,
+          unsigned         **block_offsets,
+          PZ_Callees        *callees);
+
+static void
+add_callee(PZ_Callees *callees, unsigned callee);
+
+static unsigned *
+layout_procs(unsigned num_procs, PZ_Callees *callees, int32_t entry_proc);
 
 PZ_Module *
-pz_read(PZ *pz, const char *filename, bool verbose)
+pz_read(PZ *pz, const char *filename, const char *cache_dir, bool verbose)
 {
     FILE        *file;
+    uint8_t     *contents = NULL;
+    size_t       size;
     uint16_t     magic, version;
     char        *string;
     int32_t      entry_proc = -1;
@@ -86,11 +226,20 @@ pz_read(PZ *pz, const char *filename, bool verbose)
     uint32_t     num_structs;
     uint32_t     num_datas;
     uint32_t     num_procs;
-    uint8_t      extra_byte;
+    uint32_t     num_exports;
+    PZ_Section   sections[PZ_NUM_SECTION_TYPES];
+    uint64_t     file_hash = 0;
+    PZ_Cache_Builder *cache = NULL;
     PZ_Module   *module = NULL;
     PZ_Imported  imported;
+    PZ_Data_Fixups data_fixups;
+    uint8_t     *data_segment = NULL;
+    size_t       data_mapping_size = 0;
 
     imported.procs = NULL;
+    data_fixups.num_fixups = 0;
+    data_fixups.capacity = 0;
+    data_fixups.fixups = NULL;
 
     file = fopen(filename, "rb");
     if (file == NULL) {
@@ -98,6 +247,23 @@ pz_read(PZ *pz, const char *filename, bool verbose)
         return NULL;
     }
 
+    /*
+     * Read the whole file once, its sections are hashed from this copy and
+     * then parsed through a stream over it.
+     */
+    if (!read_file_contents(file, &contents, &size)) {
+        perror(filename);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    file = fmemopen(contents, size, "rb");
+    if (file == NULL) {
+        perror(filename);
+        free(contents);
+        return NULL;
+    }
+
     if (!read_uint16(file, &magic)) goto error;
     if (magic != PZ_MAGIC_NUMBER) {
         fprintf(stderr, "%s: bad magic value, is this a PZ file?\n",
@@ -124,12 +290,32 @@ pz_read(PZ *pz, const char *filename, bool verbose)
     }
 
     if (!read_options(file, filename, &entry_proc)) goto error;
+    if (!read_section_directory(file, filename, contents, size, sections,
+                                cache_dir != NULL ? &file_hash : NULL))
+    {
+        goto error;
+    }
 
-    if (!read_uint32(file, &num_imported_datas)) goto error;
-    if (!read_uint32(file, &num_imported_procs)) goto error;
-    if (!read_uint32(file, &num_structs)) goto error;
-    if (!read_uint32(file, &num_datas)) goto error;
-    if (!read_uint32(file, &num_procs)) goto error;
+    /*
+     * Read the number of entries in each section so that the module can be
+     * allocated.  The sections' contents are read below.
+     */
+    if (!seek_section(file, &sections[PZ_SECTION_STRUCTS])) goto error;
+    if (!read_uvarint32(file, &num_structs)) goto error;
+    if (!seek_section(file, &sections[PZ_SECTION_DATA])) goto error;
+    if (!read_uvarint32(file, &num_datas)) goto error;
+    if (!seek_section(file, &sections[PZ_SECTION_CODE])) goto error;
+    if (!read_uvarint32(file, &num_procs)) goto error;
+    if (!seek_section(file, &sections[PZ_SECTION_IMPORTS])) goto error;
+    if (!read_uvarint32(file, &num_imported_datas)) goto error;
+    if (!read_uvarint32(file, &num_imported_procs)) goto error;
+    if (!seek_section(file, &sections[PZ_SECTION_EXPORTS])) goto error;
+    string = read_len_string(file);
+    if (string == NULL) goto error;
+    if (!read_uvarint32(file, &num_exports)) {
+        free(string);
+        goto error;
+    }
 
     /*
      * Convert the entry proc from the on-disc format to an offset into the
@@ -138,7 +324,15 @@ pz_read(PZ *pz, const char *filename, bool verbose)
      */
     entry_proc -= num_imported_procs;
 
-    module = pz_module_init(num_structs, num_datas, num_procs, entry_proc);
+    module = pz_module_init(num_structs, num_datas, num_procs, num_exports,
+                            entry_proc);
+    pz_module_set_name(module, string);
+    free(string);
+    string = NULL;
+
+    if (!seek_section(file, &sections[PZ_SECTION_IMPORTS])) goto error;
+    if (!read_uvarint32(file, &num_imported_datas)) goto error;
+    if (!read_uvarint32(file, &num_imported_procs)) goto error;
 
     if (!read_imported_data(file, num_imported_datas, filename)) goto error;
     if (!read_imported_procs(file, num_imported_procs, pz, &imported,
@@ -146,8 +340,16 @@ pz_read(PZ *pz, const char *filename, bool verbose)
     {
         goto error;
     }
+    if (!check_section_end(file, filename, &sections[PZ_SECTION_IMPORTS])) {
+        goto error;
+    }
 
+    if (!seek_section(file, &sections[PZ_SECTION_STRUCTS])) goto error;
+    if (!read_uvarint32(file, &num_structs)) goto error;
     if (!read_structs(file, num_structs, module, filename, verbose)) goto error;
+    if (!check_section_end(file, filename, &sections[PZ_SECTION_STRUCTS])) {
+        goto error;
+    }
 
     /*
      * read the file in two passes.  During the first pass we calculate the
@@ -155,28 +357,84 @@ pz_read(PZ *pz, const char *filename, bool verbose)
      * where each individual entry begins.  Then in the second pass we fill
      * read the bytecode and data, resolving any intra-module references.
      */
-    if (!read_data(file, num_datas, module, filename, verbose)) goto error;
-    if (!read_code(file, num_procs, module, &imported, filename, verbose))
+    if (!seek_section(file, &sections[PZ_SECTION_DATA])) goto error;
+    if (!read_uvarint32(file, &num_datas)) goto error;
+    if (!read_data(file, num_datas, module, &imported, &data_fixups,
+                   &data_segment, &data_mapping_size, filename, verbose))
     {
         goto error;
     }
+    if (!check_section_end(file, filename, &sections[PZ_SECTION_DATA])) {
+        goto error;
+    }
 
-    if (imported.procs) {
-        free(imported.procs);
-        imported.procs = NULL;
+    if (cache_dir == NULL ||
+        !pz_cache_load(cache_dir, file_hash, module, imported.procs,
+                       imported.num_procs, verbose))
+    {
+        if (cache_dir != NULL) {
+            cache = pz_cache_builder_init(num_procs);
+        }
+        if (!seek_section(file, &sections[PZ_SECTION_CODE])) goto error;
+        if (!read_uvarint32(file, &num_procs)) goto error;
+        if (!read_code(file, num_procs, module, &imported, cache, filename,
+                       verbose))
+        {
+            goto error;
+        }
+        if (!check_section_end(file, filename, &sections[PZ_SECTION_CODE]))
+        {
+            goto error;
+        }
+        if (cache != NULL) {
+            pz_cache_save(cache, cache_dir, file_hash, module, verbose);
+            pz_cache_builder_free(cache);
+            cache = NULL;
+        }
     }
 
     /*
-     * We should now be at the end of the file, so we should expect to get
-     * an error if we read any further.
+     * Now that the code is loaded the data's references to it can be
+     * written, after which nothing writes to static data.
      */
-    read_uint8(file, &extra_byte);
-    if (0 == feof(file)) {
-        fprintf(stderr, "%s: junk at end of file", filename);
+    if (!fixup_data_code_refs(&data_fixups, module, &imported, filename)) {
+        goto error;
+    }
+    if (data_segment != NULL &&
+        !pz_segment_protect(data_segment, data_mapping_size))
+    {
         goto error;
     }
 
+    /*
+     * Exports refer to code, so they're read last.
+     */
+    if (!seek_section(file, &sections[PZ_SECTION_EXPORTS])) goto error;
+    string = read_len_string(file);
+    if (string == NULL) goto error;
+    free(string);
+    string = NULL;
+    if (!read_uvarint32(file, &num_exports)) goto error;
+    if (!read_exports(file, num_exports, num_imported_procs, module,
+                      filename))
+    {
+        goto error;
+    }
+    if (!check_section_end(file, filename, &sections[PZ_SECTION_EXPORTS]))
+    {
+        goto error;
+    }
+
+    if (imported.procs) {
+        free(imported.procs);
+        imported.procs = NULL;
+    }
+    if (data_fixups.fixups) {
+        free(data_fixups.fixups);
+    }
+
     fclose(file);
+    free(contents);
     return module;
 
 error:
@@ -186,15 +444,45 @@ error:
         fprintf(stderr, "%s: Unexpected end of file.\n", filename);
     }
     fclose(file);
+    free(contents);
     if (imported.procs) {
         free(imported.procs);
     }
+    if (data_fixups.fixups) {
+        free(data_fixups.fixups);
+    }
+    if (cache) {
+        pz_cache_builder_free(cache);
+    }
     if (module) {
         pz_module_free(module);
     }
     return NULL;
 }
 
+static bool
+read_file_contents(FILE *file, uint8_t **contents, size_t *size)
+{
+    long len;
+
+    if (0 != fseek(file, 0, SEEK_END)) return false;
+    len = ftell(file);
+    if (len < 0) return false;
+    if (0 != fseek(file, 0, SEEK_SET)) return false;
+
+    *size = len;
+    // malloc(0) may return NULL, which would look like an error.
+    *contents = malloc(len > 0 ? len : 1);
+    if (*contents == NULL) return false;
+    if (*size != fread(*contents, sizeof(uint8_t), *size, file)) {
+        free(*contents);
+        *contents = NULL;
+        return false;
+    }
+
+    return true;
+}
+
 static bool
 read_options(FILE *file, const char *filename, int32_t *entry_proc)
 {
@@ -227,6 +515,134 @@ read_options(FILE *file, const char *filename, int32_t *entry_proc)
     return true;
 }
 
+/*
+ * If file_hash isn't NULL the file's header and every section that is
+ * loaded are hashed into it with 64bit FNV-1a, while the sections'
+ * hashes are checked.  This identifies the module in the cache.
+ */
+static bool
+read_section_directory(FILE          *file,
+                       const char    *filename,
+                       const uint8_t *contents,
+                       size_t         size,
+                       PZ_Section     sections[PZ_NUM_SECTION_TYPES],
+                       uint64_t      *file_hash)
+{
+    uint8_t num_sections;
+    long    header_len;
+
+    for (unsigned i = 0; i < PZ_NUM_SECTION_TYPES; i++) {
+        sections[i].present = false;
+    }
+
+    if (!read_uint8(file, &num_sections)) return false;
+    for (unsigned i = 0; i < num_sections; i++) {
+        uint8_t    type;
+        PZ_Section section;
+
+        if (!read_uint8(file, &type)) return false;
+        if (!read_uint32(file, &section.offset)) return false;
+        if (!read_uint32(file, &section.length)) return false;
+        if (!read_uint32(file, &section.hash)) return false;
+        section.present = true;
+
+        if (type >= PZ_NUM_SECTION_TYPES) {
+            // Skip sections we don't understand.
+            continue;
+        }
+        if (sections[type].present) {
+            fprintf(stderr, "%s: Duplicate section %d\n", filename, type);
+            return false;
+        }
+        sections[type] = section;
+    }
+
+    if (file_hash != NULL) {
+        header_len = ftell(file);
+        if (header_len < 0) return false;
+        *file_hash = pz_cache_hash_bytes(PZ_CACHE_HASH_INIT, contents,
+                                         header_len);
+    }
+
+    /*
+     * Check each section before reading any of them, this way we don't
+     * need to undo any work when a later section turns out to be corrupt.
+     */
+    for (unsigned i = 0; i < PZ_NUM_SECTION_TYPES; i++) {
+        if (!sections[i].present) {
+            fprintf(stderr, "%s: Missing section %d\n", filename, i);
+            return false;
+        }
+        if (!check_section_hash(filename, contents, size, &sections[i],
+                                file_hash))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+check_section_hash(const char    *filename,
+                   const uint8_t *contents,
+                   size_t         size,
+                   PZ_Section    *section,
+                   uint64_t      *file_hash)
+{
+    const uint8_t *bytes;
+    uint32_t       hash = PZ_HASH_INIT;
+
+    if (section->offset > size || section->length > size - section->offset)
+    {
+        fprintf(stderr, "%s: Section at offset %u is past the end of file\n",
+                filename, (unsigned)section->offset);
+        return false;
+    }
+    bytes = contents + section->offset;
+    if (file_hash == NULL) {
+        for (uint32_t i = 0; i < section->length; i++) {
+            hash = (hash ^ bytes[i]) * PZ_HASH_PRIME;
+        }
+    } else {
+        uint64_t hash64 = *file_hash;
+
+        for (uint32_t i = 0; i < section->length; i++) {
+            hash = (hash ^ bytes[i]) * PZ_HASH_PRIME;
+            hash64 = (hash64 ^ bytes[i]) * PZ_CACHE_HASH_PRIME;
+        }
+        *file_hash = hash64;
+    }
+
+    if (hash != section->hash) {
+        fprintf(stderr, "%s: Section at offset %u is corrupt\n",
+                filename, (unsigned)section->offset);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+seek_section(FILE *file, PZ_Section *section)
+{
+    return 0 == fseek(file, section->offset, SEEK_SET);
+}
+
+static bool
+check_section_end(FILE *file, const char *filename, PZ_Section *section)
+{
+    long pos = ftell(file);
+
+    if (pos != (long)section->offset + (long)section->length) {
+        fprintf(stderr, "%s: Section at offset %u has the wrong length\n",
+                filename, (unsigned)section->offset);
+        return false;
+    }
+
+    return true;
+}
+
 static bool
 read_imported_data(FILE *file, unsigned num_datas, const char *filename)
 {
@@ -250,7 +666,7 @@ read_imported_procs(FILE        *file,
     procs = malloc(sizeof(PZ_Proc_Symbol *) * num_procs);
 
     for (uint32_t i = 0; i < num_procs; i++) {
-        PZ_Module           *builtin_module;
+        const PZ_Module     *import_module;
         char                *module;
         char                *name;
         PZ_Proc_Symbol      *proc;
@@ -258,22 +674,31 @@ read_imported_procs(FILE        *file,
         module = read_len_string(file);
         if (module == NULL) goto error;
         name = read_len_string(file);
-        if (name == NULL) goto error;
+        if (name == NULL) {
+            free(module);
+            goto error;
+        }
 
         /*
-         * Currently we don't support linking, only the builtin
-         * pseudo-module is recognised.
+         * Modules must be loaded before the modules that import them, this
+         * means that cyclic imports are not supported.  Since the importing
+         * module is loaded last calls to imported bytecode are resolved
+         * to direct code addresses.
          */
-        if (strcmp("builtin", module) != 0) {
-            fprintf(stderr, "Linking is not supported.\n");
+        import_module = pz_get_module(pz, module);
+        if (import_module == NULL) {
+            fprintf(stderr, "%s: Module not found: %s\n", filename, module);
+            free(module);
+            free(name);
+            goto error;
         }
-        builtin_module = pz_get_module(pz, "builtin");
 
-        proc = pz_module_lookup_proc(builtin_module, name);
+        proc = pz_module_lookup_proc(import_module, name);
         if (proc) {
             procs[i] = proc;
         } else {
-            fprintf(stderr, "Procedure not found: %s.%s\n", module, name);
+            fprintf(stderr, "%s: Procedure not found: %s.%s\n",
+                    filename, module, name);
             free(module);
             free(name);
             goto error;
@@ -292,6 +717,50 @@ error:
     return false;
 }
 
+static bool
+read_exports(FILE       *file,
+             unsigned    num_exports,
+             unsigned    num_imported_procs,
+             PZ_Module  *module,
+             const char *filename)
+{
+    for (unsigned i = 0; i < num_exports; i++) {
+        char    *name;
+        uint32_t proc_id;
+
+        name = read_len_string(file);
+        if (name == NULL) return false;
+        if (!read_uvarint32(file, &proc_id)) {
+            free(name);
+            return false;
+        }
+
+        /*
+         * Only local procedures may be exported, convert the ID to an
+         * offset into the procedure array like the entry proc.
+         */
+        if ((proc_id < num_imported_procs) ||
+            (proc_id - num_imported_procs >=
+                pz_module_get_num_procs(module)))
+        {
+            fprintf(stderr, "%s: Invalid exported procedure: %s\n",
+                    filename, name);
+            free(name);
+            return false;
+        }
+        if (!pz_module_export_proc(module, name,
+                                   proc_id - num_imported_procs))
+        {
+            fprintf(stderr, "%s: Duplicate export: %s\n", filename, name);
+            free(name);
+            return false;
+        }
+        free(name);
+    }
+
+    return true;
+}
+
 static bool
 read_structs(FILE       *file,
              unsigned    num_structs,
@@ -303,7 +772,7 @@ read_structs(FILE       *file,
         uint32_t   num_fields;
         PZ_Struct *s;
 
-        if (!read_uint32(file, &num_fields)) return false;
+        if (!read_uvarint32(file, &num_fields)) return false;
 
         s = pz_module_get_struct(module, i);
         pz_struct_init(s, num_fields);
@@ -320,63 +789,269 @@ read_structs(FILE       *file,
     return true;
 }
 
+/*
+ * The data is read in two passes, like the code.  The first pass
+ * calculates the size of the module's data segment, the second reads the
+ * data into it.  References to code are recorded in fixups, they're
+ * written after the code is loaded and before the segment is made
+ * read-only.
+ */
 static bool
-read_data(FILE       *file,
-          unsigned    num_datas,
-          PZ_Module  *module,
-          const char *filename,
-          bool        verbose)
+read_data(FILE           *file,
+          unsigned        num_datas,
+          PZ_Module      *module,
+          PZ_Imported    *imported,
+          PZ_Data_Fixups *fixups,
+          uint8_t       **segment_,
+          size_t         *mapping_size,
+          const char     *filename,
+          bool            verbose)
 {
-    unsigned  total_size = 0;
-    void     *data = NULL;
+    bool            result = false;
+    long            file_pos;
+    size_t          segment_size = 0;
+    uint8_t        *segment = NULL;
+    size_t          offset = 0;
+    unsigned        num_duplicates = 0;
+    unsigned        num_code_fixups = 0;
+    PZ_Data_Index   index;
+    uint32_t        max_string_len = 0;
+    char           *string_buffer = NULL;
+
+    index.slots = NULL;
 
+    file_pos = ftell(file);
+    if (file_pos == -1) return false;
     for (uint32_t i = 0; i < num_datas; i++) {
-        uint8_t   data_type_id;
-        unsigned  mem_width;
-        uint16_t  num_elements;
-        void     *data_ptr;
-
-        if (!read_uint8(file, &data_type_id)) goto error;
-        switch (data_type_id) {
-            case PZ_DATA_BASIC:
-                if (!read_data_width(file, &mem_width)) goto error;
-                data = pz_data_new_basic_data(mem_width);
-                if (!read_data_slot(file, data, module)) goto error;
-                total_size += mem_width;
+        unsigned   mem_width;
+        uint32_t   num_elements;
+        PZ_Struct *struct_;
+        bool       string;
 
-                break;
-            case PZ_DATA_ARRAY:
-                if (!read_uint16(file, &num_elements)) return 0;
-                if (!read_data_width(file, &mem_width)) goto error;
-                data = pz_data_new_array_data(mem_width, num_elements);
-                data_ptr = data;
-                for (int i = 0; i < num_elements; i++) {
-                    if (!read_data_slot(file, data_ptr, module)) goto error;
-                    data_ptr += mem_width;
-                }
-                total_size += mem_width * num_elements;
-                break;
-            case PZ_DATA_STRUCT:
-                fprintf(stderr, "structs not implemented yet");
-                abort();
+        if (!read_data_type(file, module, &mem_width, &num_elements,
+                            &struct_, &string))
+        {
+            goto end;
+        }
+        if (string) {
+            // Strings are interned rather than put in the segment.
+            if (0 != fseek(file, num_elements, SEEK_CUR)) goto end;
+            if (num_elements > max_string_len) {
+                max_string_len = num_elements;
+            }
+            continue;
+        }
+        for (uint32_t j = 0; j < num_elements; j++) {
+            if (!skip_data_slot(file)) goto end;
+        }
+        segment_size = ALIGN_UP(segment_size, PZ_DATA_ALIGN) +
+            (struct_ ? struct_->total_size : mem_width * num_elements);
+    }
+
+    if (num_datas == 0) {
+        return true;
+    }
+    segment = pz_segment_init(segment_size > 0 ? segment_size : 1, false,
+                              mapping_size);
+    if (segment == NULL) goto end;
+    pz_module_set_data_mapping(module, segment, *mapping_size);
+    *segment_ = segment;
+    data_index_init(&index, num_datas);
+    string_buffer = malloc(max_string_len > 0 ? max_string_len : 1);
+    if (string_buffer == NULL) {
+        fprintf(stderr, "%s: No memory for a string of %u bytes\n",
+                filename, (unsigned)max_string_len);
+        goto end;
+    }
+
+    if (0 != fseek(file, file_pos, SEEK_SET)) goto end;
+    for (uint32_t i = 0; i < num_datas; i++) {
+        unsigned   mem_width;
+        uint32_t   num_elements;
+        PZ_Struct *struct_;
+        bool       string;
+        uint8_t   *data = segment + offset;
+        uint8_t   *duplicate;
+        size_t     size;
+        unsigned   num_fixups = fixups->num_fixups;
+
+        if (!read_data_type(file, module, &mem_width, &num_elements,
+                            &struct_, &string))
+        {
+            goto end;
+        }
+        if (string) {
+            if (num_elements != fread(string_buffer, 1, num_elements, file))
+            {
+                goto end;
+            }
+            pz_module_set_data(module, i,
+                    pz_string_intern_bytes(string_buffer, num_elements));
+            continue;
+        }
+        for (uint32_t j = 0; j < num_elements; j++) {
+            uint8_t *dest = struct_ ? data + struct_->field_offsets[j] :
+                                      data + j * mem_width;
+
+            if (!read_data_slot(file, dest, module, imported, fixups)) {
+                goto end;
+            }
+        }
+        size = struct_ ? struct_->total_size : mem_width * num_elements;
+
+        /*
+         * If we've already loaded identical data then use that, the space
+         * for this entry will be reused by the next one.  Entries with
+         * references that haven't been written yet can't be compared.
+         */
+        if (num_fixups == fixups->num_fixups) {
+            duplicate = data_index_find_or_add(&index, data, size);
+        } else {
+            duplicate = data;
+        }
+        if (duplicate != data) {
+            memset(data, 0, size);
+            data = duplicate;
+            num_duplicates++;
+        } else {
+            offset = ALIGN_UP(offset + size, PZ_DATA_ALIGN);
         }
 
         pz_module_set_data(module, i, data);
-        data = NULL;
     }
 
+    /*
+     * All the data has been read, so forward references can be written
+     * now.  References to code are kept for later.
+     */
+    for (unsigned i = 0; i < fixups->num_fixups; i++) {
+        PZ_Data_Fixup *fixup = &fixups->fixups[i];
+
+        if (fixup->kind == RELOC_DATA) {
+            *fixup->dest = (uint8_t *)pz_module_get_data(module,
+                    fixup->target) + fixup->tag;
+        } else {
+            fixups->fixups[num_code_fixups++] = *fixup;
+        }
+    }
+    fixups->num_fixups = num_code_fixups;
+
     if (verbose) {
         printf("Loaded %d data entries with a total of %d bytes\n",
-               (unsigned)num_datas, total_size);
+               (unsigned)num_datas, (unsigned)offset);
+        if (num_duplicates > 0) {
+            printf("%d data entries were duplicates\n", num_duplicates);
+        }
     }
+    result = true;
 
-    return true;
+end:
+    if (index.slots != NULL) {
+        free(index.slots);
+    }
+    if (string_buffer != NULL) {
+        free(string_buffer);
+    }
+    return result;
+}
 
-error:
-    if (data != NULL) {
-        pz_data_free(data);
+/*
+ * Read the type of a data entry, returning the width in memory of each
+ * element and the number of elements.  For structs the struct is returned
+ * too, its fields give the layout.  For strings string is set and the
+ * elements are the string's bytes, which follow without encoding bytes.
+ */
+static bool
+read_data_type(FILE       *file,
+               PZ_Module  *module,
+               unsigned   *mem_width,
+               uint32_t   *num_elements,
+               PZ_Struct **struct_,
+               bool       *string)
+{
+    uint8_t  data_type_id;
+    uint32_t struct_id;
+
+    *struct_ = NULL;
+    *string = false;
+    if (!read_uint8(file, &data_type_id)) return false;
+    switch (data_type_id) {
+        case PZ_DATA_BASIC:
+            if (!read_data_width(file, mem_width)) return false;
+            *num_elements = 1;
+            return true;
+        case PZ_DATA_ARRAY:
+            if (!read_uvarint32(file, num_elements)) return false;
+            if (!read_data_width(file, mem_width)) return false;
+            return true;
+        case PZ_DATA_STRUCT:
+            if (!read_uvarint32(file, &struct_id)) return false;
+            if (struct_id >= pz_module_get_num_structs(module)) {
+                fprintf(stderr, "Invalid struct reference %u\n",
+                        (unsigned)struct_id);
+                return false;
+            }
+            *struct_ = pz_module_get_struct(module, struct_id);
+            *num_elements = (*struct_)->num_fields;
+            *mem_width = 0;
+            return true;
+        case PZ_DATA_STRING:
+            if (!read_uvarint32(file, num_elements)) return false;
+            *mem_width = 1;
+            *string = true;
+            return true;
+        default:
+            fprintf(stderr, "Unknown data type %d\n", data_type_id);
+            return false;
     }
-    return false;
+}
+
+/*
+ * An index of the data loaded so far, for finding duplicates.  It's an
+ * open addressing hash table with at least twice as many slots as data
+ * entries.
+ */
+static void
+data_index_init(PZ_Data_Index *index, unsigned num_datas)
+{
+    index->num_slots = 1;
+    while (index->num_slots < num_datas * 2) {
+        index->num_slots *= 2;
+    }
+    index->slots = malloc(sizeof(PZ_Data_Index_Slot) * index->num_slots);
+    memset(index->slots, 0, sizeof(PZ_Data_Index_Slot) * index->num_slots);
+}
+
+/*
+ * Return identical data that is already in the index, or add this data and
+ * return it.
+ */
+static uint8_t *
+data_index_find_or_add(PZ_Data_Index *index, uint8_t *data, size_t size)
+{
+    uint32_t hash = PZ_HASH_INIT;
+    unsigned mask = index->num_slots - 1;
+    unsigned i;
+
+    for (size_t j = 0; j < size; j++) {
+        hash = (hash ^ data[j]) * PZ_HASH_PRIME;
+    }
+
+    for (i = hash & mask; index->slots[i].data != NULL; i = (i + 1) & mask)
+    {
+        PZ_Data_Index_Slot *slot = &index->slots[i];
+
+        if ((slot->hash == hash) && (slot->size == size) &&
+            (0 == memcmp(slot->data, data, size)))
+        {
+            return slot->data;
+        }
+    }
+
+    index->slots[i].hash = hash;
+    index->slots[i].size = size;
+    index->slots[i].data = data;
+    return data;
 }
 
 static bool
@@ -393,7 +1068,11 @@ read_data_width(FILE *file, unsigned *mem_width)
 }
 
 static bool
-read_data_slot(FILE *file, void *dest, PZ_Module *module)
+read_data_slot(FILE           *file,
+               void           *dest,
+               PZ_Module      *module,
+               PZ_Imported    *imported,
+               PZ_Data_Fixups *fixups)
 {
     uint8_t               enc_width, raw_enc;
     enum pz_data_enc_type type;
@@ -436,19 +1115,38 @@ read_data_slot(FILE *file, void *dest, PZ_Module *module)
             }
         case pz_data_enc_type_ptr: {
             uint32_t ref;
+            unsigned tag = PZ_DATA_ENC_BYTES(raw_enc);
             void **  dest_ = (void **)dest;
-            void *   data;
+            uint8_t *data;
 
             // Data is a reference, link in the correct information.
-            // XXX: support non-data references, such as proc
-            // references.
-            if (!read_uint32(file, &ref)) return false;
+            if (!read_uvarint32(file, &ref)) return false;
+            if (ref >= pz_module_get_num_datas(module)) {
+                fprintf(stderr, "Invalid data reference\n");
+                return false;
+            }
             data = pz_module_get_data(module, ref);
             if (data != NULL) {
-                *dest_ = data;
+                *dest_ = data + tag;
             } else {
-                fprintf(stderr, "forward references arn't yet supported.\n");
-                abort();
+                // The data hasn't been read yet.
+                add_data_fixup(fixups, RELOC_DATA, dest, ref, tag);
+            }
+        }
+            return true;
+        case pz_data_enc_type_code: {
+            uint32_t ref;
+
+            if (!read_uvarint32(file, &ref)) return false;
+            if (ref < imported->num_procs) {
+                add_data_fixup(fixups, RELOC_IMPORT, dest, ref, 0);
+            } else {
+                ref -= imported->num_procs;
+                if (ref >= pz_module_get_num_procs(module)) {
+                    fprintf(stderr, "Invalid procedure reference\n");
+                    return false;
+                }
+                add_data_fixup(fixups, RELOC_CODE, dest, ref, 0);
             }
         }
             return true;
@@ -480,18 +1178,107 @@ read_data_slot(FILE *file, void *dest, PZ_Module *module)
 }
 
 static bool
-read_code(FILE        *file,
-          unsigned     num_procs,
-          PZ_Module   *module,
-          PZ_Imported *imported,
-          const char  *filename,
-          bool         verbose)
+skip_data_slot(FILE *file)
 {
-    bool       result = false;
-    unsigned **block_offsets = malloc(sizeof(unsigned *) * num_procs);
-    long       file_pos;
+    uint8_t  raw_enc;
+    uint32_t ref;
+
+    if (!read_uint8(file, &raw_enc)) return false;
+    switch (PZ_DATA_ENC_TYPE(raw_enc)) {
+        case pz_data_enc_type_normal:
+            return 0 == fseek(file, PZ_DATA_ENC_BYTES(raw_enc), SEEK_CUR);
+        case pz_data_enc_type_ptr:
+        case pz_data_enc_type_code:
+            return read_uvarint32(file, &ref);
+        case pz_data_enc_type_fast:
+        case pz_data_enc_type_wptr:
+            // For these width types the encoded width is 32bit.
+            return 0 == fseek(file, 4, SEEK_CUR);
+        default:
+            fprintf(stderr, "Unexpected data encoding %d.\n", raw_enc);
+            return false;
+    }
+}
+
+static void
+add_data_fixup(PZ_Data_Fixups *fixups,
+               Reloc_Kind      kind,
+               void           *dest,
+               unsigned        target,
+               unsigned        tag)
+{
+    PZ_Data_Fixup *fixup;
+
+    if (fixups->num_fixups == fixups->capacity) {
+        fixups->capacity = fixups->capacity ? fixups->capacity * 2 : 16;
+        fixups->fixups = realloc(fixups->fixups,
+                                 sizeof(PZ_Data_Fixup) * fixups->capacity);
+    }
+    fixup = &fixups->fixups[fixups->num_fixups++];
+    fixup->kind = kind;
+    fixup->dest = (void **)dest;
+    fixup->target = target;
+    fixup->tag = tag;
+}
+
+/*
+ * Write the data's references to code, the code must have been loaded.
+ */
+static bool
+fixup_data_code_refs(PZ_Data_Fixups *fixups,
+                     PZ_Module      *module,
+                     PZ_Imported    *imported,
+                     const char     *filename)
+{
+    for (unsigned i = 0; i < fixups->num_fixups; i++) {
+        PZ_Data_Fixup  *fixup = &fixups->fixups[i];
+        PZ_Proc_Symbol *proc_sym;
+
+        switch (fixup->kind) {
+            case RELOC_CODE:
+                *fixup->dest = pz_module_get_proc_code(module,
+                                                       fixup->target);
+                break;
+            case RELOC_IMPORT:
+                proc_sym = imported->procs[fixup->target];
+                if (proc_sym->type != PZ_BUILTIN_BYTECODE) {
+                    fprintf(stderr,
+                            "%s: Data can't refer to a C procedure\n",
+                            filename);
+                    return false;
+                }
+                *fixup->dest = proc_sym->proc.bytecode;
+                break;
+            default:
+                fprintf(stderr, "Internal error.\n");
+                abort();
+        }
+    }
+
+    return true;
+}
+
+static bool
+read_code(FILE             *file,
+          unsigned          num_procs,
+          PZ_Module        *module,
+          PZ_Imported      *imported,
+          PZ_Cache_Builder *cache,
+          const char       *filename,
+          bool              verbose)
+{
+    bool        result = false;
+    unsigned  **block_offsets = malloc(sizeof(unsigned *) * num_procs);
+    PZ_Callees *callees = malloc(sizeof(PZ_Callees) * num_procs);
+    unsigned   *proc_sizes = malloc(sizeof(unsigned) * num_procs);
+    unsigned   *order = NULL;
+    long        file_pos;
+    size_t      code_size;
+    uint8_t    *segment = NULL;
+    size_t      mapping_size;
 
     memset(block_offsets, 0, sizeof(unsigned *) * num_procs);
+    memset(callees, 0, sizeof(PZ_Callees) * num_procs);
 
     /*
      * We read procedures in two phases, once to calculate their sizes, and
@@ -505,18 +1292,43 @@ read_code(FILE        *file,
     if (file_pos == -1) goto end;
 
     for (unsigned i = 0; i < num_procs; i++) {
-        unsigned proc_size;
-        PZ_Proc *proc;
-
         if (verbose) {
             fprintf(stderr, "Reading proc %d\n", i);
         }
 
-        proc_size =
-          read_proc(file, imported, module, NULL, &block_offsets[i]);
-        if (proc_size == 0) goto end;
-        proc = pz_proc_init(proc_size);
-        pz_module_set_proc(module, i, proc);
+        proc_sizes[i] = read_proc(file, imported, module, NULL, i, NULL,
+                                  &block_offsets[i], &callees[i]);
+        if (proc_sizes[i] == 0) goto end;
+    }
+
+    /*
+     * Place all the procedures in a single segment, in the order that they
+     * are reached through the call graph.
+     */
+    order = layout_procs(num_procs, callees,
+                         pz_module_get_entry_proc(module));
+    code_size = 0;
+    for (unsigned i = 0; i < num_procs; i++) {
+        code_size = ALIGN_UP(code_size, PZ_PROC_ALIGN);
+        code_size += proc_sizes[order[i]];
+    }
+    if (code_size > 0) {
+        segment = pz_segment_init(code_size, true, &mapping_size);
+        if (segment == NULL) goto end;
+        pz_module_set_code_mapping(module, segment, mapping_size);
+    }
+    code_size = 0;
+    for (unsigned i = 0; i < num_procs; i++) {
+        unsigned proc_num = order[i];
+
+        code_size = ALIGN_UP(code_size, PZ_PROC_ALIGN);
+        pz_module_set_proc(module, proc_num,
+            pz_proc_init(segment + code_size, proc_sizes[proc_num]));
+        if (cache != NULL) {
+            pz_cache_builder_set_proc(cache, proc_num, code_size,
+                                      proc_sizes[proc_num]);
+        }
+        code_size += proc_sizes[proc_num];
     }
 
     /*
@@ -534,14 +1346,21 @@ read_code(FILE        *file,
             fprintf(stderr, "Reading proc %d\n", i);
         }
 
-        if (0 == read_proc(file, imported, module,
+        if (0 == read_proc(file, imported, module, cache, i,
                            pz_module_get_proc_code(module, i),
-                           &block_offsets[i]))
+                           &block_offsets[i], NULL))
         {
             goto end;
         }
     }
 
+    /*
+     * The interpreter never writes to its code.
+     */
+    if (segment != NULL && !pz_segment_protect(segment, mapping_size)) {
+        goto end;
+    }
+
     if (verbose) {
         pz_module_print_loaded_stats(module);
     }
@@ -556,15 +1375,104 @@ end:
         }
         free(block_offsets);
     }
+    for (unsigned i = 0; i < num_procs; i++) {
+        if (callees[i].callees != NULL) {
+            free(callees[i].callees);
+        }
+    }
+    free(callees);
+    free(proc_sizes);
+    if (order != NULL) {
+        free(order);
+    }
     return result;
 }
 
+static void
+add_callee(PZ_Callees *callees, unsigned callee)
+{
+    if (callees->num_callees == callees->capacity) {
+        callees->capacity = callees->capacity ? callees->capacity * 2 : 4;
+        callees->callees = realloc(callees->callees,
+            sizeof(unsigned) * callees->capacity);
+    }
+    callees->callees[callees->num_callees++] = callee;
+}
+
+/*
+ * Order the procedures by a depth first walk of the call graph, starting
+ * at the entry procedure then each procedure in ID order.  This places
+ * callees near their callers.
+ */
+static unsigned *
+layout_procs(unsigned num_procs, PZ_Callees *callees, int32_t entry_proc)
+{
+    unsigned *order = malloc(sizeof(unsigned) * num_procs);
+    unsigned  num_ordered = 0;
+    bool     *visited = malloc(sizeof(bool) * num_procs);
+    // Each procedure is pushed at most once per reference to it, plus
+    // once as a root.
+    unsigned  stack_size = num_procs;
+    unsigned *stack;
+    unsigned  sp = 0;
+
+    for (unsigned i = 0; i < num_procs; i++) {
+        stack_size += callees[i].num_callees;
+    }
+    stack = malloc(sizeof(unsigned) * stack_size);
+    memset(visited, 0, sizeof(bool) * num_procs);
+
+    for (unsigned i = 0; i <= num_procs; i++) {
+        unsigned root;
+
+        if (i == 0) {
+            if ((entry_proc < 0) || ((unsigned)entry_proc >= num_procs)) {
+                continue;
+            }
+            root = entry_proc;
+        } else {
+            root = i - 1;
+        }
+
+        stack[sp++] = root;
+        while (sp > 0) {
+            unsigned proc = stack[--sp];
+
+            if (visited[proc]) continue;
+            visited[proc] = true;
+            order[num_ordered++] = proc;
+
+            // Push in reverse so that the first callee is visited next.
+            for (unsigned j = callees[proc].num_callees; j > 0; j--) {
+                unsigned callee = callees[proc].callees[j - 1];
+
+                if (!visited[callee]) {
+                    stack[sp++] = callee;
+                }
+            }
+        }
+    }
+    assert(num_ordered == num_procs);
+
+    free(stack);
+    free(visited);
+    return order;
+}
+
+/*
+ * If cache is non-NULL then during the second pass record a relocation
+ * for every address written into the code.  During the first pass the
+ * local procedures referred to are added to callees.
+ */
 static unsigned
-read_proc(FILE        *file,
-          PZ_Imported *imported,
-          PZ_Module   *module,
-          uint8_t     *proc_code,
-          unsigned   **block_offsets)
+read_proc(FILE              *file,
+          PZ_Imported       *imported,
+          PZ_Module         *module,
+          PZ_Cache_Builder  *cache,
+          unsigned           proc_num,
+          uint8_t           *proc_code,
+          unsigned         **block_offsets,
+          PZ_Callees        *callees)
 {
     uint32_t num_blocks;
     bool     first_pass = (proc_code == NULL);
@@ -575,7 +1483,7 @@ read_proc(FILE        *file,
      * here's where they might appear.
      */
 
-    if (!read_uint32(file, &num_blocks)) return 0;
+    if (!read_uvarint32(file, &num_blocks)) return 0;
     if (first_pass) {
         /*
          * This is the first pass - set up the block offsets array.
@@ -593,26 +1501,36 @@ read_proc(FILE        *file,
             (*block_offsets)[i] = proc_offset;
         }
 
-        if (!read_uint32(file, &num_instructions)) return 0;
+        if (!read_uvarint32(file, &num_instructions)) return 0;
         for (uint32_t j = 0; j < num_instructions; j++) {
             uint8_t         byte;
             Opcode          opcode;
             Width           width1 = 0, width2 = 0;
             Immediate_Type  immediate_type;
             Immediate_Value immediate_value;
+            Reloc_Kind      reloc = RELOC_NONE;
+            unsigned        imm_offset;
+            unsigned        reloc_target = 0;
+            unsigned        reloc_target_offset = 0;
 
             /*
-             * Read the opcode and the data width(s)
+             * Read the opcode and the data width(s), two widths share a
+             * single byte.
              */
             if (!read_uint8(file, &byte)) return 0;
             opcode = byte;
-            if (instruction_info_data[opcode].ii_num_width_bytes > 0) {
-                if (!read_uint8(file, &byte)) return 0;
-                width1 = byte;
-                if (instruction_info_data[opcode].ii_num_width_bytes > 1) {
+            switch (instruction_info_data[opcode].ii_num_width_bytes) {
+                case 0:
+                    break;
+                case 1:
                     if (!read_uint8(file, &byte)) return 0;
-                    width2 = byte;
-                }
+                    width1 = byte;
+                    break;
+                default:
+                    if (!read_uint8(file, &byte)) return 0;
+                    width1 = PZ_WIDTHS_FIRST(byte);
+                    width2 = PZ_WIDTHS_SECOND(byte);
+                    break;
             }
 
             /*
@@ -626,25 +1544,37 @@ read_proc(FILE        *file,
                 case IMT_8:
                     if (!read_uint8(file, &immediate_value.uint8)) return 0;
                     break;
-                case IMT_16:
-                    if (!read_uint16(file, &immediate_value.uint16))
+                case IMT_16: {
+                    int32_t imm32;
+                    if (!read_svarint32(file, &imm32)) return 0;
+                    if ((imm32 < INT16_MIN) || (imm32 > INT16_MAX)) {
+                        fprintf(stderr,
+                                "16bit immediate value out of range\n");
                         return 0;
+                    }
+                    immediate_value.uint16 = (uint16_t)imm32;
                     break;
-                case IMT_32:
-                    if (!read_uint32(file, &immediate_value.uint32))
-                        return 0;
+                }
+                case IMT_32: {
+                    int32_t imm32;
+                    if (!read_svarint32(file, &imm32)) return 0;
+                    immediate_value.uint32 = (uint32_t)imm32;
                     break;
+                }
                 case IMT_64:
                     if (!read_uint64(file, &immediate_value.uint64))
                         return 0;
                     break;
                 case IMT_CODE_REF: {
                     uint32_t imm32;
-                    if (!read_uint32(file, &imm32)) return 0;
+                    if (!read_uvarint32(file, &imm32)) return 0;
 
                     if (imm32 < imported->num_procs) {
                         PZ_Proc_Symbol *proc_sym = imported->procs[imm32];
 
+                        reloc = RELOC_IMPORT;
+                        reloc_target = imm32;
+
                         switch (proc_sym->type) {
                             case PZ_BUILTIN_BYTECODE:
                                 immediate_value.word =
@@ -652,6 +1582,11 @@ read_proc(FILE        *file,
                                     ->proc.bytecode;
                                 break;
                             case PZ_BUILTIN_C_FUNC:
+                                if (opcode == PZI_SPAWN) {
+                                    fprintf(stderr,
+                                            "Can't spawn a C procedure\n");
+                                    return 0;
+                                }
                                 /*
                                  * Fix up the instruction to a CCall,
                                  *
@@ -667,20 +1602,31 @@ read_proc(FILE        *file,
                         }
                     } else {
                         imm32 -= imported->num_procs;
+                        reloc = RELOC_CODE;
+                        reloc_target = imm32;
                         if (!first_pass) {
                             immediate_value.word =
                               (uintptr_t)pz_module_get_proc_code(module,
                                                                  imm32);
                         } else {
                             immediate_value.word = 0;
+                            if (imm32 >= pz_module_get_num_procs(module)) {
+                                fprintf(stderr,
+                                        "Invalid procedure reference\n");
+                                return 0;
+                            }
+                            add_callee(callees, imm32);
                         }
                     }
                     break;
                 }
                 case IMT_LABEL_REF: {
                     uint32_t imm32;
-                    if (!read_uint32(file, &imm32)) return 0;
+                    if (!read_uvarint32(file, &imm32)) return 0;
+                    reloc = RELOC_CODE;
+                    reloc_target = proc_num;
                     if (!first_pass) {
+                        reloc_target_offset = (*block_offsets)[imm32];
                         immediate_value.word =
                           (uintptr_t)&proc_code[(*block_offsets)[imm32]];
                     } else {
@@ -690,7 +1636,9 @@ read_proc(FILE        *file,
                 }
                 case IMT_DATA_REF: {
                     uint32_t imm32;
-                    if (!read_uint32(file, &imm32)) return 0;
+                    if (!read_uvarint32(file, &imm32)) return 0;
+                    reloc = RELOC_DATA;
+                    reloc_target = imm32;
                     immediate_value.word =
                       (uintptr_t)pz_module_get_data(module, imm32);
                     break;
@@ -698,7 +1646,11 @@ read_proc(FILE        *file,
                 case IMT_STRUCT_REF: {
                     uint32_t   imm32;
                     PZ_Struct *struct_;
-                    if (!read_uint32(file, &imm32)) return 0;
+                    if (!read_uvarint32(file, &imm32)) return 0;
+                    if (imm32 >= pz_module_get_num_structs(module)) {
+                        fprintf(stderr, "Invalid struct reference\n");
+                        return 0;
+                    }
                     struct_ = pz_module_get_struct(module, imm32);
                     immediate_value.word = struct_->total_size;
                     break;
@@ -708,18 +1660,50 @@ read_proc(FILE        *file,
                     uint8_t    imm8;
                     PZ_Struct *struct_;
 
-                    if (!read_uint32(file, &imm32)) return 0;
+                    if (!read_uvarint32(file, &imm32)) return 0;
                     if (!read_uint8(file, &imm8)) return 0;
+                    if (imm32 >= pz_module_get_num_structs(module)) {
+                        fprintf(stderr, "Invalid struct reference\n");
+                        return 0;
+                    }
                     struct_ = pz_module_get_struct(module, imm32);
+                    if (imm8 >= struct_->num_fields) {
+                        fprintf(stderr, "Invalid struct field reference\n");
+                        return 0;
+                    }
 
                     immediate_value.uint16 = struct_->field_offsets[imm8];
                     break;
                 }
             }
 
+            imm_offset = pz_immediate_offset(proc_offset, immediate_type);
             proc_offset =
               pz_write_instr(proc_code, proc_offset, opcode, width1, width2,
                              immediate_type, immediate_value);
+
+            if (cache != NULL && !first_pass) {
+                // Only word sized immediates hold addresses.
+                assert(reloc == RELOC_NONE ||
+                       imm_offset + MACHINE_WORD_SIZE == proc_offset);
+
+                switch (reloc) {
+                    case RELOC_NONE:
+                        break;
+                    case RELOC_CODE:
+                        pz_cache_builder_reloc_code(cache, proc_num,
+                            imm_offset, reloc_target, reloc_target_offset);
+                        break;
+                    case RELOC_DATA:
+                        pz_cache_builder_reloc_data(cache, proc_num,
+                            imm_offset, reloc_target);
+                        break;
+                    case RELOC_IMPORT:
+                        pz_cache_builder_reloc_import(cache, proc_num,
+                            imm_offset, reloc_target);
+                        break;
+                }
+            }
         }
     }
 
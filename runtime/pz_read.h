@@ -9,9 +9,11 @@
 #ifndef PZ_READ_H
 #define PZ_READ_H
 
-#include "pz_radix_tree.h"
-
+/*
+ * Read a PZ file.  If cache_dir is non-NULL then the module's translated
+ * code is loaded from, or saved to, that directory (see pz_cache.h).
+ */
 PZ_Module *
-pz_read(PZ *pz, const char *filename, bool verbose);
+pz_read(PZ *pz, const char *filename, const char *cache_dir, bool verbose);
 
 #endif /* ! PZ_READ_H */
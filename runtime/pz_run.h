@@ -13,34 +13,135 @@
 #include "pz_format.h"
 #include "pz_instructions.h"
 
+/*
+ * Execution contexts.
+ *
+ * A context holds the state of a running program: its stacks, heap and
+ * output buffer.  It can run many procedures, one after the other.  Each
+ * context may be used by only one thread at a time, but any number of
+ * contexts may run the same PZ at once.
+ *
+ **********************/
+
+typedef struct PZ_Context_Struct PZ_Context;
+
+PZ_Context *
+pz_context_init(void);
+
+void
+pz_context_free(PZ_Context *context);
+
+/*
+ * Write any buffered output and free everything on the context's heap.
+ * Objects from an earlier run must not be used after this.
+ */
+void
+pz_context_reset(PZ_Context *context);
+
+/*
+ * Set the file descriptor that the program's output is written to, the
+ * default is standard output.
+ */
+void
+pz_context_set_output(PZ_Context *context, int fd);
+
 /*
  * Imported foreign builtins.
  *
  * The exact meaning of the parameters depends upon implementation details
  * within pz_run_*.c.
  *
+ * setenv changes the environment of the whole process, not only that of
+ * the context.
+ *
  ******************************/
 
 unsigned
-builtin_print_func(void *stack, unsigned sp);
+builtin_print_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_flush_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_print_int_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_int_to_string_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_setenv_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_free_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_gettimeofday_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_concat_string_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_intern_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_string_equals_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_string_compare_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_string_starts_with_func(void       *stack,
+                                unsigned    sp,
+                                PZ_Context *context);
+
+unsigned
+builtin_string_find_func(void *stack, unsigned sp, PZ_Context *context);
 
 unsigned
-builtin_int_to_string_func(void *stack, unsigned sp);
+builtin_string_split_func(void *stack, unsigned sp, PZ_Context *context);
 
 unsigned
-builtin_setenv_func(void *stack, unsigned sp);
+builtin_string_count_byte_func(void       *stack,
+                               unsigned    sp,
+                               PZ_Context *context);
 
 unsigned
-builtin_free_func(void *stack, unsigned sp);
+builtin_string_is_utf8_func(void *stack, unsigned sp, PZ_Context *context);
 
 unsigned
-builtin_gettimeofday_func(void *void_stack, unsigned sp);
+builtin_die_func(void *stack, unsigned sp, PZ_Context *context);
+
+/*
+ * Channels, see pz_channel.h.  send and recv park the calling fiber when
+ * they can't finish now.
+ */
+unsigned
+builtin_new_channel_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_new_spsc_channel_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_send_func(void *stack, unsigned sp, PZ_Context *context);
 
 unsigned
-builtin_concat_string_func(void *stack, unsigned sp);
+builtin_recv_func(void *stack, unsigned sp, PZ_Context *context);
 
 unsigned
-builtin_die_func(void *stack, unsigned sp);
+builtin_try_recv_func(void *stack, unsigned sp, PZ_Context *context);
+
+/*
+ * Arrays of Ints for parallel_map and parallel_reduce, which are built
+ * from instructions in pz_builtin.c.
+ */
+unsigned
+builtin_array_range_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_array_size_func(void *stack, unsigned sp, PZ_Context *context);
+
+unsigned
+builtin_array_get_func(void *stack, unsigned sp, PZ_Context *context);
 
 /*
  * The size of "fast" integers in bytes.
@@ -59,8 +160,55 @@ extern const uintptr_t pz_tag_bits;
  *
  ******************/
 
+/*
+ * Returns NULL if the program has no entry procedure.
+ */
+uint8_t *
+pz_get_entry_proc_code(const PZ *pz);
+
+/*
+ * Run a procedure in the context, it must have the same signature as the
+ * program's entry procedure: no arguments and an integer result, which is
+ * returned.  The program's output is flushed before this returns.
+ */
 int
-pz_run(PZ *pz);
+pz_context_run(PZ_Context *context, uint8_t *proc_code);
+
+/*
+ * Ask every running program to stop, each context stops at its next
+ * safepoint by printing an error and exiting the process.  This is
+ * async-signal-safe, pzrun calls it when its time limit runs out.
+ */
+void
+pz_interrupt(void);
+
+/*
+ * Call a procedure with any signature.  Its arguments are pushed onto the
+ * context before the call, first argument first, and replaced by its
+ * results after the call, which are popped last result first.  Integers
+ * are the "fast" width (w).  The program's output is flushed before this
+ * returns.
+ */
+void
+pz_context_call(PZ_Context *context, uint8_t *proc_code);
+
+void
+pz_context_push_int(PZ_Context *context, int32_t value);
+
+void
+pz_context_push_ptr(PZ_Context *context, void *value);
+
+int32_t
+pz_context_pop_int(PZ_Context *context);
+
+void *
+pz_context_pop_ptr(PZ_Context *context);
+
+/*
+ * Pop a string as NUL-terminated bytes, which stay on the context's heap.
+ */
+const char *
+pz_context_pop_string(PZ_Context *context);
 
 /*
  * Build the raw code of the program.
@@ -86,4 +234,11 @@ pz_write_instr(uint8_t        *proc,
                Immediate_Type  imm_type,
                Immediate_Value imm);
 
+/*
+ * The offset of the immediate value of an instruction written by
+ * pz_write_instr() at the given offset.
+ */
+unsigned
+pz_immediate_offset(unsigned offset, Immediate_Type imm_type);
+
 #endif /* ! PZ_RUN_H */
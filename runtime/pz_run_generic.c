@@ -8,20 +8,25 @@
 
 #include "pz_common.h"
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
+#include "pz_channel.h"
 #include "pz_code.h"
+#include "pz_heap.h"
 #include "pz_instructions.h"
 #include "pz_run.h"
+#include "pz_scheduler.h"
+#include "pz_string.h"
 #include "pz_trace.h"
 #include "pz_util.h"
 
-#define RETURN_STACK_SIZE 1024
-#define EXPR_STACK_SIZE 1024
-
 typedef union {
     uint8_t   u8;
     int8_t    s8;
@@ -152,6 +157,15 @@ typedef enum {
     PZT_STORE_16,
     PZT_STORE_32,
     PZT_STORE_64,
+    PZT_SPAWN,
+    PZT_WAIT,
+    PZT_TASK_RESULT,
+    PZT_TASK_END,
+    PZT_PARALLEL_MAP,
+    PZT_PARALLEL_REDUCE,
+    PZT_PARALLEL_STEP,
+    PZT_CHUNK_START,
+    PZT_CHUNK_STEP,
     PZT_END,
     PZT_CCALL,
     PZT_LAST_TOKEN = PZT_CCALL,
@@ -164,65 +178,527 @@ typedef enum {
 static unsigned
 pz_immediate_size(Immediate_Type imt);
 
+/*
+ * Execution contexts
+ *
+ *********************/
+
+/*
+ * A fiber is a thread of Plasma execution with its own stacks.  A context
+ * has a main fiber for the calls made through the API and, when it has a
+ * worker, a fiber for each task that it has started but not finished.
+ * Switching fibers only saves and loads the interpreter's registers.
+ *
+ * The stacks start small and grow when a call or a push finds them nearly
+ * full, nothing points into them so they can be moved.  A builtin may push
+ * up to PZ_STACK_MARGIN values.
+ */
+struct PZ_Fiber_Struct {
+    uint8_t       **return_stack;
+    unsigned        return_stack_size;
+    Stack_Value    *expr_stack;
+    unsigned        expr_stack_size;
+    unsigned        rsp;
+    // The arguments or results of a call, see pz_context_push_int().
+    unsigned        esp;
+    uint8_t        *ip;
+    // The task that the fiber runs, NULL for the main fiber.
+    PZ_Task        *task;
+    // The task that the fiber is parked waiting for.
+    PZ_Task        *waiting;
+    // The next fiber in the context's list of free fibers.
+    PZ_Fiber       *next;
+};
+
+struct PZ_Context_Struct {
+    PZ_Fiber        main_fiber;
+    // The fiber being run, or the main fiber.
+    PZ_Fiber       *fiber;
+    // Fibers of finished tasks, kept for reuse.
+    PZ_Fiber       *free_fibers;
+    PZ_Heap        *heap;
+    // NULL if spawned tasks run immediately.
+    PZ_Worker      *worker;
+    // Set by a builtin that parked the fiber, see PZT_CCALL.
+    bool            blocked;
+    /*
+     * Special procedures that are at the bottom of the return stack.  The
+     * wrapper exits the interpreter, the task end finishes a task and
+     * switches to the next fiber.  The task result procedure is returned
+     * to by a call to a task's procedure, see PZT_SPAWN.  The chunk
+     * procedures run part of a parallel map or reduce.
+     */
+    uint8_t        *wrapper_proc;
+    uint8_t        *task_end_proc;
+    uint8_t        *task_result_proc;
+    uint8_t        *chunk_start_proc;
+    uint8_t        *chunk_step_proc;
+
+    /*
+     * The program's output that hasn't been written yet, in order.  Each
+     * piece is either part of the output buffer or a long string.  The
+     * lock is held while they're changed, because when a program dies the
+     * output of every worker's context is written by the thread that died.
+     */
+    pthread_mutex_t output_lock;
+    int             output_fd;
+    unsigned        num_output_pieces;
+    struct iovec    output_pieces[PZ_OUTPUT_MAX_PIECES];
+    size_t          output_len;
+    char            output[PZ_OUTPUT_BUFFER_SIZE];
+};
+
+/*
+ * Arrays of Ints, they don't change once they're made.
+ */
+typedef struct {
+    uint32_t size;
+    int32_t  elements[];
+} Int_Array;
+
+/*
+ * parallel_map and parallel_reduce split their array into chunks of
+ * PZ_PARALLEL_CHUNK_SIZE elements and spawn a task for each chunk.  The
+ * task calls the function for each of the chunk's elements in turn: a map
+ * stores each result in the chunk's part of the output array, a reduce
+ * folds the chunk's elements into the chunk's accumulator.  When a
+ * worker's deque is full the fiber that started the job runs the next
+ * chunk itself.  Once every chunk is finished a reduce folds the initial
+ * value and the chunks' accumulators together in order, so the result
+ * doesn't depend on how the chunks were scheduled.
+ */
+typedef enum {
+    PARALLEL_MAP,
+    PARALLEL_REDUCE
+} Parallel_Kind;
+
+typedef struct Parallel_Job_Struct Parallel_Job;
+
+typedef struct {
+    Parallel_Job    *job;
+    const Int_Array *input;
+    uint32_t         pos;
+    uint32_t         end;
+    // A reduce's accumulator.
+    int32_t          acc;
+    // The function has been called and its result is on the stack.
+    bool             calling;
+    // NULL if the chunk is run by the fiber that started the job.
+    PZ_Task         *task;
+} Chunk;
+
+struct Parallel_Job_Struct {
+    Parallel_Kind  kind;
+    uint8_t       *func;
+    Int_Array     *output;
+    Chunk         *chunks;
+    uint32_t       num_chunks;
+    // The next chunk to spawn or run, and the next one to wait for.
+    uint32_t       next_start;
+    uint32_t       next_wait;
+    // Folds the chunks' accumulators once they're all finished.
+    Chunk          combine;
+    bool           combining;
+    // The fiber that started the job is running a chunk.
+    bool           calling;
+};
+
+static void
+context_exec(PZ_Context *context);
+
+static PZ_Fiber *
+context_safepoint(PZ_Context *context, PZ_Fiber *fiber);
+
+static void
+context_write(PZ_Context *context, const char *string, size_t len);
+
+static void
+context_flush_locked(PZ_Context *context);
+
+static void
+context_flush_all(PZ_Context *context);
+
+static void
+writev_all(int fd, struct iovec *pieces, unsigned num_pieces);
+
+static uint8_t *
+make_special_proc(Opcode opcode);
+
+static Int_Array *
+int_array_new(PZ_Heap *heap, uint32_t size);
+
+static Parallel_Job *
+parallel_job_new(PZ_Heap *heap, Parallel_Kind kind, uint8_t *func,
+                 const Int_Array *input, int32_t init);
+
+static Chunk *
+parallel_next(PZ_Context *context, Parallel_Job *job);
+
+static void
+fiber_init(PZ_Fiber *fiber);
+
+static void
+fiber_free(PZ_Fiber *fiber);
+
+static void
+fiber_grow(PZ_Fiber *fiber, unsigned rsp, unsigned esp);
+
+PZ_Context *
+pz_context_init(void)
+{
+    PZ_Context *context;
+
+    pz_string_init();
+
+    context = malloc(sizeof(PZ_Context));
+    fiber_init(&context->main_fiber);
+    context->fiber = &context->main_fiber;
+    context->free_fibers = NULL;
+    context->heap = pz_heap_init();
+    context->worker = NULL;
+    context->blocked = false;
+    pthread_mutex_init(&context->output_lock, NULL);
+    context->output_fd = STDOUT_FILENO;
+    context->num_output_pieces = 0;
+    context->output_len = 0;
+
+    context->wrapper_proc = make_special_proc(PZI_END);
+    context->task_end_proc = make_special_proc(PZI_TASK_END);
+    context->task_result_proc = make_special_proc(PZI_TASK_RESULT);
+    context->chunk_start_proc = make_special_proc(PZI_CHUNK_START);
+    context->chunk_step_proc = make_special_proc(PZI_CHUNK_STEP);
+
+    return context;
+}
+
+void
+pz_context_free(PZ_Context *context)
+{
+    pz_context_flush(context);
+    while (context->free_fibers != NULL) {
+        PZ_Fiber *fiber = context->free_fibers;
+
+        context->free_fibers = fiber->next;
+        fiber_free(fiber);
+        free(fiber);
+    }
+    free(context->wrapper_proc);
+    free(context->task_end_proc);
+    free(context->task_result_proc);
+    free(context->chunk_start_proc);
+    free(context->chunk_step_proc);
+    pz_heap_free(context->heap);
+    fiber_free(&context->main_fiber);
+    pthread_mutex_destroy(&context->output_lock);
+    free(context);
+}
+
+static uint8_t *
+make_special_proc(Opcode opcode)
+{
+    Immediate_Value imv_none;
+    unsigned        size;
+    uint8_t        *proc;
+
+    memset(&imv_none, 0, sizeof(imv_none));
+    size = pz_write_instr(NULL, 0, opcode, 0, 0, IMT_NONE, imv_none);
+    proc = malloc(size);
+    pz_write_instr(proc, 0, opcode, 0, 0, IMT_NONE, imv_none);
+
+    return proc;
+}
+
+void
+pz_context_reset(PZ_Context *context)
+{
+    // Output that hasn't been written may refer to strings on the heap.
+    pz_context_flush(context);
+    pz_heap_reset(context->heap);
+    if (context->worker != NULL) {
+        pz_scheduler_reset(context->worker);
+    }
+}
+
+void
+pz_context_set_worker(PZ_Context *context, PZ_Worker *worker)
+{
+    context->worker = worker;
+}
+
+PZ_Fiber *
+pz_context_new_fiber(PZ_Context *context, PZ_Task *task,
+                     uint8_t *proc_code, uint64_t arg)
+{
+    PZ_Fiber *fiber = context->free_fibers;
+
+    if (fiber != NULL) {
+        context->free_fibers = fiber->next;
+    } else {
+        fiber = malloc(sizeof(PZ_Fiber));
+        fiber_init(fiber);
+    }
+
+    // The procedure is entered as if it was called by the task end.
+    fiber->return_stack[0] = context->task_end_proc;
+    fiber->rsp = 0;
+    fiber->expr_stack[1].u64 = arg;
+    fiber->esp = 1;
+    fiber->ip = proc_code;
+    fiber->task = task;
+    fiber->waiting = NULL;
+
+    return fiber;
+}
+
+void
+pz_context_run_worker(PZ_Context *context)
+{
+    PZ_Fiber *fiber = pz_scheduler_next(context->worker);
+
+    if (fiber != NULL) {
+        context->fiber = fiber;
+        context_exec(context);
+        context->fiber = &context->main_fiber;
+    }
+}
+
+/*
+ * Fibers
+ *
+ *********/
+
+static void
+fiber_init(PZ_Fiber *fiber)
+{
+    fiber->return_stack_size = PZ_FIBER_STACK_SIZE;
+    fiber->return_stack =
+      malloc(sizeof(uint8_t *) * fiber->return_stack_size);
+    fiber->expr_stack_size = PZ_FIBER_STACK_SIZE + PZ_STACK_MARGIN;
+    fiber->expr_stack = malloc(sizeof(Stack_Value) * fiber->expr_stack_size);
+    fiber->expr_stack[0].u64 = 0;
+    fiber->rsp = 0;
+    fiber->esp = 0;
+    fiber->ip = NULL;
+    fiber->task = NULL;
+    fiber->waiting = NULL;
+    fiber->next = NULL;
+}
+
+static void
+fiber_free(PZ_Fiber *fiber)
+{
+    free(fiber->return_stack);
+    free(fiber->expr_stack);
+}
+
+/*
+ * Make sure that the return stack has room for rsp and the expression
+ * stack has room for PZ_STACK_MARGIN values above esp.
+ */
+static void
+fiber_grow(PZ_Fiber *fiber, unsigned rsp, unsigned esp)
+{
+    if (rsp >= fiber->return_stack_size) {
+        while (rsp >= fiber->return_stack_size) {
+            fiber->return_stack_size *= 2;
+        }
+        fiber->return_stack = realloc(fiber->return_stack,
+          sizeof(uint8_t *) * fiber->return_stack_size);
+    }
+    if (esp + PZ_STACK_MARGIN >= fiber->expr_stack_size) {
+        while (esp + PZ_STACK_MARGIN >= fiber->expr_stack_size) {
+            fiber->expr_stack_size *= 2;
+        }
+        fiber->expr_stack = realloc(fiber->expr_stack,
+          sizeof(Stack_Value) * fiber->expr_stack_size);
+    }
+    if ((fiber->return_stack == NULL) || (fiber->expr_stack == NULL)) {
+        fprintf(stderr, "Out of memory for stacks\n");
+        abort();
+    }
+}
+
+void
+pz_context_set_output(PZ_Context *context, int fd)
+{
+    pz_context_flush(context);
+    context->output_fd = fd;
+}
+
+/*
+ * Short strings are copied into the output buffer, adding to the last
+ * piece if it ends where they're copied to.  Long strings are added as
+ * pieces of their own, strings don't change and they stay on the heap
+ * until the context is reset, which flushes the output first.
+ */
+static void
+context_write(PZ_Context *context, const char *string, size_t len)
+{
+    struct iovec *last;
+    char         *dest;
+
+    if (len == 0) return;
+
+    pthread_mutex_lock(&context->output_lock);
+    if (len > PZ_OUTPUT_COPY_MAX) {
+        if (context->num_output_pieces == PZ_OUTPUT_MAX_PIECES) {
+            context_flush_locked(context);
+        }
+        last = &context->output_pieces[context->num_output_pieces++];
+        last->iov_base = (char *)string;
+        last->iov_len = len;
+    } else {
+        if (context->output_len + len > PZ_OUTPUT_BUFFER_SIZE) {
+            context_flush_locked(context);
+        }
+        dest = &context->output[context->output_len];
+        last = context->num_output_pieces > 0 ?
+            &context->output_pieces[context->num_output_pieces - 1] : NULL;
+        if ((last == NULL) ||
+            ((char *)last->iov_base + last->iov_len != dest))
+        {
+            if (context->num_output_pieces == PZ_OUTPUT_MAX_PIECES) {
+                context_flush_locked(context);
+                dest = context->output;
+            }
+            last = &context->output_pieces[context->num_output_pieces++];
+            last->iov_base = dest;
+            last->iov_len = 0;
+        }
+        memcpy(dest, string, len);
+        last->iov_len += len;
+        context->output_len += len;
+    }
+    pthread_mutex_unlock(&context->output_lock);
+}
+
+void
+pz_context_flush(PZ_Context *context)
+{
+    pthread_mutex_lock(&context->output_lock);
+    context_flush_locked(context);
+    pthread_mutex_unlock(&context->output_lock);
+}
+
+static void
+context_flush_locked(PZ_Context *context)
+{
+    writev_all(context->output_fd, context->output_pieces,
+               context->num_output_pieces);
+    context->num_output_pieces = 0;
+    context->output_len = 0;
+}
+
+/*
+ * Write the output of every context in the program before it exits with
+ * an error, tasks on other workers may have output that they haven't
+ * written yet.
+ */
+static void
+context_flush_all(PZ_Context *context)
+{
+    if (context->worker != NULL) {
+        pz_scheduler_flush(context->worker);
+    } else {
+        pz_context_flush(context);
+    }
+}
+
+/*
+ * There's nothing useful to do if the output can't be written (for example
+ * the reader has gone away), so errors are ignored.  The pieces are
+ * modified as they're written.
+ */
+static void
+writev_all(int fd, struct iovec *pieces, unsigned num_pieces)
+{
+    while (num_pieces > 0) {
+        ssize_t written = writev(fd, pieces, num_pieces);
+
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        while ((num_pieces > 0) && ((size_t)written >= pieces->iov_len)) {
+            written -= pieces->iov_len;
+            pieces++;
+            num_pieces--;
+        }
+        if (num_pieces > 0) {
+            pieces->iov_base = (char *)pieces->iov_base + written;
+            pieces->iov_len -= written;
+        }
+    }
+}
+
 /*
  * Imported procedures
  *
  **********************/
 
-typedef unsigned (*ccall_func)(Stack_Value *, unsigned);
+typedef unsigned (*ccall_func)(Stack_Value *, unsigned, PZ_Context *);
 
 unsigned
-builtin_print_func(void *void_stack, unsigned sp)
+builtin_print_func(void *void_stack, unsigned sp, PZ_Context *context)
 {
     Stack_Value *stack = void_stack;
 
-    char *string = (char *)(stack[sp--].uptr);
-    printf("%s", string);
+    void        *string = stack[sp--].ptr;
+
+    context_write(context, pz_string_flatten(context->heap, string),
+                  pz_string_length(string));
+    return sp;
+}
+
+unsigned
+builtin_flush_func(void *void_stack, unsigned sp, PZ_Context *context)
+{
+    pz_context_flush(context);
     return sp;
 }
 
 /*
- * Long enough for a 32 bit value, plus a sign, plus a null termination
- * byte.
+ * This is print(int_to_string(num)) without making the string.
  */
-#define INT_TO_STRING_BUFFER_SIZE 11
-
 unsigned
-builtin_int_to_string_func(void *void_stack, unsigned sp)
+builtin_print_int_func(void *void_stack, unsigned sp, PZ_Context *context)
 {
-    char        *string;
-    int32_t      num;
-    int          result;
     Stack_Value *stack = void_stack;
+    char         buffer[PZ_INT_STRING_MAX];
+    unsigned     len;
 
-    num = stack[sp].s32;
-    string = malloc(INT_TO_STRING_BUFFER_SIZE);
-    result = snprintf(string, INT_TO_STRING_BUFFER_SIZE, "%d", (int)num);
-    if ((result < 0) || (result > (INT_TO_STRING_BUFFER_SIZE - 1))) {
-        free(string);
-        stack[sp].ptr = NULL;
-    } else {
-        stack[sp].ptr = string;
-    }
+    len = pz_string_format_int(buffer + PZ_INT_STRING_MAX, stack[sp--].s32);
+    context_write(context, buffer + PZ_INT_STRING_MAX - len, len);
     return sp;
 }
 
 unsigned
-builtin_free_func(void *void_stack, unsigned sp)
+builtin_int_to_string_func(void       *void_stack,
+                           unsigned    sp,
+                           PZ_Context *context)
 {
     Stack_Value *stack = void_stack;
 
-    free(stack[sp--].ptr);
+    stack[sp].ptr = pz_string_from_int(context->heap, stack[sp].s32);
     return sp;
 }
 
 unsigned
-builtin_setenv_func(void *void_stack, unsigned sp)
+builtin_free_func(void *void_stack, unsigned sp, PZ_Context *context)
+{
+    /*
+     * Objects are on the heap, they're freed when the heap is reset.
+     */
+    return sp - 1;
+}
+
+unsigned
+builtin_setenv_func(void *void_stack, unsigned sp, PZ_Context *context)
 {
     Stack_Value *stack = void_stack;
     int         result;
-    const char *value = stack[sp--].ptr;
-    const char *name = stack[sp--].ptr;
+    const char *value = pz_string_flatten(context->heap, stack[sp--].ptr);
+    const char *name = pz_string_flatten(context->heap, stack[sp--].ptr);
 
     result = setenv(name, value, 1);
 
@@ -232,7 +708,9 @@ builtin_setenv_func(void *void_stack, unsigned sp)
 }
 
 unsigned
-builtin_gettimeofday_func(void *void_stack, unsigned sp)
+builtin_gettimeofday_func(void       *void_stack,
+                          unsigned    sp,
+                          PZ_Context *context)
 {
     Stack_Value    *stack = void_stack;
     struct timeval  tv;
@@ -249,36 +727,378 @@ builtin_gettimeofday_func(void *void_stack, unsigned sp)
 }
 
 unsigned
-builtin_concat_string_func(void *void_stack, unsigned sp)
+builtin_concat_string_func(void       *void_stack,
+                           unsigned    sp,
+                           PZ_Context *context)
 {
-    const char *s1, *s2;
-    char       *s;
-    size_t      len;
+    void        *s1, *s2;
     Stack_Value *stack = void_stack;
 
     s2 = stack[sp--].ptr;
     s1 = stack[sp].ptr;
 
-    len = strlen(s1) + strlen(s2) + 1;
-    s = malloc(sizeof(char) * len);
-    strcpy(s, s1);
-    strcat(s, s2);
+    stack[sp].ptr = pz_string_concat(context->heap, s1, s2);
+    return sp;
+}
+
+unsigned
+builtin_intern_func(void *void_stack, unsigned sp, PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
 
-    stack[sp].ptr = s;
+    stack[sp].ptr = pz_string_intern(context->heap, stack[sp].ptr);
     return sp;
 }
 
 unsigned
-builtin_die_func(void *void_stack, unsigned sp)
+builtin_string_equals_func(void       *void_stack,
+                           unsigned    sp,
+                           PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    void        *s2 = stack[sp--].ptr;
+
+    stack[sp].u32 = pz_string_equals(context->heap, stack[sp].ptr, s2);
+    return sp;
+}
+
+unsigned
+builtin_string_compare_func(void       *void_stack,
+                            unsigned    sp,
+                            PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    void        *s2 = stack[sp--].ptr;
+    int          result;
+
+    result = pz_string_compare(context->heap, stack[sp].ptr, s2);
+    stack[sp].s32 = result < 0 ? -1 : (result > 0 ? 1 : 0);
+    return sp;
+}
+
+unsigned
+builtin_string_starts_with_func(void       *void_stack,
+                                unsigned    sp,
+                                PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    void        *prefix = stack[sp--].ptr;
+
+    stack[sp].u32 = pz_string_starts_with(context->heap, stack[sp].ptr,
+                                          prefix);
+    return sp;
+}
+
+unsigned
+builtin_string_find_func(void *void_stack, unsigned sp, PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    void        *sub = stack[sp--].ptr;
+
+    stack[sp].s32 = pz_string_find(context->heap, stack[sp].ptr, sub);
+    return sp;
+}
+
+unsigned
+builtin_string_split_func(void *void_stack, unsigned sp, PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    void        *sep = stack[sp--].ptr;
+    void        *string = stack[sp--].ptr;
+    void        *before, *after;
+    bool         found;
+
+    found = pz_string_split(context->heap, string, sep, &before, &after);
+    stack[++sp].u32 = found;
+    stack[++sp].ptr = before;
+    stack[++sp].ptr = after;
+    return sp;
+}
+
+unsigned
+builtin_string_count_byte_func(void       *void_stack,
+                               unsigned    sp,
+                               PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    uint8_t      byte = stack[sp--].u32;
+
+    stack[sp].s32 = pz_string_count_byte(context->heap, stack[sp].ptr, byte);
+    return sp;
+}
+
+unsigned
+builtin_string_is_utf8_func(void       *void_stack,
+                            unsigned    sp,
+                            PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+
+    stack[sp].u32 = pz_string_is_utf8(context->heap, stack[sp].ptr);
+    return sp;
+}
+
+unsigned
+builtin_die_func(void *void_stack, unsigned sp, PZ_Context *context)
 {
     const char  *s;
     Stack_Value *stack = void_stack;
 
-    s = stack[sp].ptr;
+    s = pz_string_flatten(context->heap, stack[sp].ptr);
+    context_flush_all(context);
     fprintf(stderr, "Die: %s\n", s);
     exit(1);
 }
 
+unsigned
+builtin_new_channel_func(void       *void_stack,
+                         unsigned    sp,
+                         PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    int32_t      capacity = stack[sp].s32;
+
+    stack[sp].ptr = pz_channel_new(context->heap, PZ_CHANNEL_MPMC,
+                                   capacity > 0 ? capacity : 1);
+    return sp;
+}
+
+unsigned
+builtin_new_spsc_channel_func(void       *void_stack,
+                              unsigned    sp,
+                              PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    int32_t      capacity = stack[sp].s32;
+
+    stack[sp].ptr = pz_channel_new(context->heap, PZ_CHANNEL_SPSC,
+                                   capacity > 0 ? capacity : 1);
+    return sp;
+}
+
+/*
+ * Without a scheduler there's no other task that could make room in or
+ * send to the channel.
+ */
+static void
+channel_deadlock(PZ_Context *context, const char *what)
+{
+    context_flush_all(context);
+    fprintf(stderr, "Deadlock: %s with no other tasks\n", what);
+    exit(1);
+}
+
+unsigned
+builtin_send_func(void *void_stack, unsigned sp, PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    uint64_t     value = stack[sp].u64;
+    PZ_Channel  *chan = stack[sp - 1].ptr;
+
+    if (!pz_channel_try_send(chan, value)) {
+        if (context->worker == NULL) {
+            channel_deadlock(context, "send to a full channel");
+        }
+        if (pz_channel_block_send(chan, context->worker, context->fiber,
+                value))
+        {
+            // Leave the arguments for when send is called again.
+            context->blocked = true;
+            return sp;
+        }
+    }
+    return sp - 2;
+}
+
+unsigned
+builtin_recv_func(void *void_stack, unsigned sp, PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    PZ_Channel  *chan = stack[sp].ptr;
+    uint64_t     value;
+
+    if (!pz_channel_try_recv(chan, &value)) {
+        if (context->worker == NULL) {
+            channel_deadlock(context, "recv from an empty channel");
+        }
+        if (pz_channel_block_recv(chan, context->worker, context->fiber,
+                &value))
+        {
+            context->blocked = true;
+            return sp;
+        }
+    }
+    stack[sp].u64 = value;
+    return sp;
+}
+
+unsigned
+builtin_try_recv_func(void *void_stack, unsigned sp, PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    PZ_Channel  *chan = stack[sp].ptr;
+    uint64_t     value = 0;
+    bool         received;
+
+    received = pz_channel_try_recv(chan, &value);
+    stack[sp].u32 = received ? 1 : 0;
+    stack[++sp].u64 = value;
+    return sp;
+}
+
+unsigned
+builtin_array_range_func(void       *void_stack,
+                         unsigned    sp,
+                         PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    int32_t      size = stack[sp].s32;
+    Int_Array   *array;
+
+    array = int_array_new(context->heap, size > 0 ? size : 0);
+    for (uint32_t i = 0; i < array->size; i++) {
+        array->elements[i] = i;
+    }
+    stack[sp].ptr = array;
+    return sp;
+}
+
+unsigned
+builtin_array_size_func(void *void_stack, unsigned sp, PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    Int_Array   *array = stack[sp].ptr;
+
+    stack[sp].s32 = array->size;
+    return sp;
+}
+
+unsigned
+builtin_array_get_func(void *void_stack, unsigned sp, PZ_Context *context)
+{
+    Stack_Value *stack = void_stack;
+    int32_t      index = stack[sp--].s32;
+    Int_Array   *array = stack[sp].ptr;
+
+    if ((index < 0) || ((uint32_t)index >= array->size)) {
+        context_flush_all(context);
+        fprintf(stderr, "Array index %d out of bounds (size %u)\n",
+                (int)index, (unsigned)array->size);
+        exit(1);
+    }
+    stack[sp].s32 = array->elements[index];
+    return sp;
+}
+
+static Int_Array *
+int_array_new(PZ_Heap *heap, uint32_t size)
+{
+    Int_Array *array;
+
+    array = pz_heap_alloc(heap, sizeof(Int_Array) + sizeof(int32_t) * size);
+    array->size = size;
+    return array;
+}
+
+/*
+ * Parallel map and reduce
+ *
+ **************************/
+
+static Parallel_Job *
+parallel_job_new(PZ_Heap *heap, Parallel_Kind kind, uint8_t *func,
+                 const Int_Array *input, int32_t init)
+{
+    Parallel_Job *job;
+    uint32_t      num_chunks;
+
+    num_chunks = (input->size + PZ_PARALLEL_CHUNK_SIZE - 1) /
+        PZ_PARALLEL_CHUNK_SIZE;
+
+    job = pz_heap_alloc(heap, sizeof(Parallel_Job));
+    job->kind = kind;
+    job->func = func;
+    job->output = kind == PARALLEL_MAP ?
+        int_array_new(heap, input->size) : NULL;
+    job->chunks = pz_heap_alloc(heap, sizeof(Chunk) * num_chunks);
+    job->num_chunks = num_chunks;
+    job->next_start = 0;
+    job->next_wait = 0;
+    job->combining = false;
+    job->calling = false;
+    // Later the accumulators are folded into the initial value.
+    job->combine.acc = init;
+
+    for (uint32_t i = 0; i < num_chunks; i++) {
+        Chunk *chunk = &job->chunks[i];
+
+        chunk->job = job;
+        chunk->input = input;
+        chunk->pos = i * PZ_PARALLEL_CHUNK_SIZE;
+        chunk->end = chunk->pos + PZ_PARALLEL_CHUNK_SIZE;
+        if (chunk->end > input->size) {
+            chunk->end = input->size;
+        }
+        if (kind == PARALLEL_REDUCE) {
+            // A chunk is never empty.
+            chunk->acc = input->elements[chunk->pos++];
+        }
+        chunk->calling = false;
+        chunk->task = NULL;
+    }
+
+    return job;
+}
+
+/*
+ * Return the next chunk for the fiber that started the job to run, or to
+ * wait for if it has a task, or NULL if the job is finished.  Chunks are
+ * spawned until the worker's deque is full.
+ */
+static Chunk *
+parallel_next(PZ_Context *context, Parallel_Job *job)
+{
+    while (job->next_start < job->num_chunks) {
+        Chunk *chunk = &job->chunks[job->next_start++];
+
+        if (context->worker != NULL) {
+            chunk->task = pz_scheduler_spawn(context->worker,
+                    context->fiber->task, context->chunk_start_proc,
+                    (uintptr_t)chunk);
+        }
+        if (chunk->task == NULL) {
+            return chunk;
+        }
+    }
+
+    while (job->next_wait < job->num_chunks) {
+        Chunk *chunk = &job->chunks[job->next_wait];
+
+        if (chunk->task != NULL) {
+            return chunk;
+        }
+        job->next_wait++;
+    }
+
+    if ((job->kind == PARALLEL_REDUCE) && !job->combining) {
+        Int_Array *accs = int_array_new(context->heap, job->num_chunks);
+
+        for (uint32_t i = 0; i < job->num_chunks; i++) {
+            accs->elements[i] = job->chunks[i].acc;
+        }
+        job->combine.job = job;
+        job->combine.input = accs;
+        job->combine.pos = 0;
+        job->combine.end = job->num_chunks;
+        job->combine.calling = false;
+        job->combine.task = NULL;
+        job->combining = true;
+        return &job->combine;
+    }
+
+    return NULL;
+}
+
 const unsigned pz_fast_word_size = PZ_FAST_INTEGER_WIDTH / 8;
 
 /* Must match or exceed ptag_bits from src/core.types.m */
@@ -290,52 +1110,179 @@ const uintptr_t pz_tag_bits = 0x3;
  *
  ******************/
 
+uint8_t *
+pz_get_entry_proc_code(const PZ *pz)
+{
+    const PZ_Module *entry_module;
+    int32_t          entry_proc;
+
+    entry_module = pz_get_entry_module(pz);
+    entry_proc = -1;
+    if (NULL != entry_module) {
+        entry_proc = pz_module_get_entry_proc(entry_module);
+    }
+    if (entry_proc < 0) {
+        return NULL;
+    }
+
+    return pz_module_get_proc_code(entry_module, entry_proc);
+}
+
 int
-pz_run(PZ *pz)
+pz_context_run(PZ_Context *context, uint8_t *proc_code)
+{
+    assert(context->main_fiber.esp == 0);
+
+    pz_context_call(context, proc_code);
+    if (context->main_fiber.esp != 1) {
+        fprintf(stderr, "Stack misaligned, esp: %u should be 1\n",
+                context->main_fiber.esp);
+        abort();
+    }
+
+    return pz_context_pop_int(context);
+}
+
+void
+pz_context_push_int(PZ_Context *context, int32_t value)
+{
+    PZ_Fiber *fiber = &context->main_fiber;
+
+    // The return stack is empty between calls.
+    fiber_grow(fiber, 0, fiber->esp + 1);
+    fiber->expr_stack[++fiber->esp].s32 = value;
+}
+
+void
+pz_context_push_ptr(PZ_Context *context, void *value)
+{
+    PZ_Fiber *fiber = &context->main_fiber;
+
+    fiber_grow(fiber, 0, fiber->esp + 1);
+    fiber->expr_stack[++fiber->esp].ptr = value;
+}
+
+int32_t
+pz_context_pop_int(PZ_Context *context)
+{
+    PZ_Fiber *fiber = &context->main_fiber;
+
+    assert(fiber->esp > 0);
+    return fiber->expr_stack[fiber->esp--].s32;
+}
+
+void *
+pz_context_pop_ptr(PZ_Context *context)
+{
+    PZ_Fiber *fiber = &context->main_fiber;
+
+    assert(fiber->esp > 0);
+    return fiber->expr_stack[fiber->esp--].ptr;
+}
+
+const char *
+pz_context_pop_string(PZ_Context *context)
 {
+    return pz_string_flatten(context->heap, pz_context_pop_ptr(context));
+}
+
+void
+pz_context_call(PZ_Context *context, uint8_t *proc_code)
+{
+    PZ_Fiber *fiber = &context->main_fiber;
+
+    assert(context->fiber == fiber);
+    fiber->return_stack[0] = context->wrapper_proc;
+    fiber->rsp = 0;
+    fiber->ip = proc_code;
+    context_exec(context);
+    /*
+     * The wrapper's end instruction is reached by returning from the
+     * bottom of the return stack, which leaves rsp wrapped around.
+     */
+    fiber->rsp = 0;
+    pz_context_flush(context);
+}
+
+/*
+ * Run context's fiber until it returns to the wrapper procedure, or for a
+ * worker's fibers until the scheduler has nothing else for the worker.
+ * The fiber's registers are kept in locals and saved when switching.
+ */
+static void
+context_exec(PZ_Context *context)
+{
+    PZ_Fiber       *fiber = context->fiber;
     uint8_t       **return_stack;
-    unsigned        rsp = 0;
+    unsigned        rsp;
     Stack_Value    *expr_stack;
-    unsigned        esp = 0;
+    unsigned        esp;
     uint8_t        *ip;
-    uint8_t        *wrapper_proc;
-    unsigned        wrapper_proc_size;
-    int             retcode;
-    Immediate_Value imv_none;
-    PZ_Module      *entry_module;
-    int32_t         entry_proc;
+    unsigned        fuel = PZ_TIME_SLICE;
 
     assert(PZT_LAST_TOKEN < 256);
 
-    return_stack = malloc(sizeof(uint8_t *) * RETURN_STACK_SIZE);
-    expr_stack = malloc(sizeof(Stack_Value) * EXPR_STACK_SIZE);
-    expr_stack[0].u64 = 0;
-
+#define SAVE_FIBER()    \
+    fiber->rsp = rsp;   \
+    fiber->esp = esp;   \
+    fiber->ip = ip
+#define LOAD_FIBER()                        \
+    return_stack = fiber->return_stack;     \
+    rsp = fiber->rsp;                       \
+    expr_stack = fiber->expr_stack;         \
+    esp = fiber->esp;                       \
+    ip = fiber->ip
+    // Grow the stacks before pushing n return addresses.
+#define CHECK_STACKS(n)                                   \
+    if ((rsp + (n) >= fiber->return_stack_size) ||        \
+        (esp + PZ_STACK_MARGIN >= fiber->expr_stack_size)) \
+    {                                                     \
+        fiber_grow(fiber, rsp + (n), esp);                \
+        return_stack = fiber->return_stack;               \
+        expr_stack = fiber->expr_stack;                   \
+    }
+    // Grow the expression stack before an instruction pushes a value.
+#define CHECK_PUSH()                                      \
+    if (esp + 1 >= fiber->expr_stack_size) {              \
+        fiber_grow(fiber, rsp, esp + 1);                  \
+        expr_stack = fiber->expr_stack;                   \
+    }
     /*
-     * Assemble a special procedure that exits the interpreter and put its
-     * address on the call stack.
+     * A fiber that was parked by wait has been resumed, its task has
+     * finished.
      */
-    memset(&imv_none, 0, sizeof(imv_none));
-    wrapper_proc_size =
-      pz_write_instr(NULL, 0, PZI_END, 0, 0, IMT_NONE, imv_none);
-    wrapper_proc = malloc(wrapper_proc_size);
-    pz_write_instr(wrapper_proc, 0, PZI_END, 0, 0, IMT_NONE, imv_none);
-    return_stack[0] = wrapper_proc;
+#define COMPLETE_WAIT()                                  \
+    if (fiber->waiting != NULL) {                        \
+        expr_stack[esp].u64 =                            \
+          pz_scheduler_task_result(context->worker,      \
+                                   fiber->waiting);      \
+        fiber->waiting = NULL;                           \
+    }
 
-    // Determine the entry procedure.
-    entry_module = pz_get_entry_module(pz);
-    entry_proc = -1;
-    if (NULL != entry_module) {
-        entry_proc = pz_module_get_entry_proc(entry_module);
+    /*
+     * Calls and backward jumps poll for a safepoint, so that a loop or a
+     * deep recursion can't keep the worker from other fibers, or the
+     * program from being interrupted.  Most polls only decrement the fuel.
+     */
+#define SAFEPOINT()                                 \
+    if (--fuel == 0) {                              \
+        fuel = PZ_TIME_SLICE;                       \
+        SAVE_FIBER();                               \
+        fiber = context_safepoint(context, fiber);  \
+        LOAD_FIBER();                               \
+        COMPLETE_WAIT();                            \
     }
-    if (entry_proc < 0) {
-        fprintf(stderr, "No entry procedure\n");
-        abort();
+#define JUMP_TO(target)                             \
+    {                                               \
+        uint8_t *from = ip;                         \
+        ip = (target);                              \
+        if (ip < from) {                            \
+            SAFEPOINT();                            \
+        }                                           \
     }
 
-    // Set the instruction pointer and start execution.
-    ip = pz_module_get_proc_code(entry_module, entry_proc);
-    retcode = 255;
+    LOAD_FIBER();
+    COMPLETE_WAIT();
     pz_trace_state(ip, rsp, esp, (uint64_t *)expr_stack);
     while (true) {
         PZ_Instruction_Token token = (PZ_Instruction_Token)(*ip);
@@ -346,35 +1293,43 @@ pz_run(PZ *pz)
                 pz_trace_instr(rsp, "nop");
                 break;
             case PZT_LOAD_IMMEDIATE_8:
+                CHECK_PUSH();
                 expr_stack[++esp].u8 = *ip;
                 ip++;
                 pz_trace_instr(rsp, "load imm:8");
                 break;
             case PZT_LOAD_IMMEDIATE_16:
+                CHECK_PUSH();
                 ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, 2);
                 expr_stack[++esp].u16 = *(uint16_t *)ip;
                 ip += 2;
                 pz_trace_instr(rsp, "load imm:16");
                 break;
             case PZT_LOAD_IMMEDIATE_32:
+                CHECK_PUSH();
                 ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, 4);
-                expr_stack[++esp].u32 = *(uint32_t *)ip;
+                // Zero the whole slot so that the value is the same if
+                // it's used as a pointer-sized word.
+                expr_stack[++esp].u64 = *(uint32_t *)ip;
                 ip += 4;
                 pz_trace_instr(rsp, "load imm:32");
                 break;
             case PZT_LOAD_IMMEDIATE_64:
+                CHECK_PUSH();
                 ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, 8);
                 expr_stack[++esp].u64 = *(uint64_t *)ip;
                 ip += 8;
                 pz_trace_instr(rsp, "load imm:64");
                 break;
             case PZT_LOAD_IMMEDIATE_DATA:
+                CHECK_PUSH();
                 ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, MACHINE_WORD_SIZE);
                 expr_stack[++esp].uptr = *(uintptr_t *)ip;
                 ip += MACHINE_WORD_SIZE;
                 pz_trace_instr(rsp, "load imm data:ptr");
                 break;
             case PZT_LOAD_IMMEDIATE_CODE:
+                CHECK_PUSH();
                 /*
                  * Consider merging this instruction with the previous one
                  * as an optimisation.
@@ -555,6 +1510,7 @@ pz_run(PZ *pz)
 #undef PZ_RUN_SHIFT
 
             case PZT_DUP:
+                CHECK_PUSH();
                 esp++;
                 expr_stack[esp] = expr_stack[esp - 1];
                 pz_trace_instr(rsp, "dup");
@@ -604,31 +1560,38 @@ pz_run(PZ *pz)
                  */
                 uint8_t depth = *ip;
                 ip++;
+                CHECK_PUSH();
                 esp++;
                 expr_stack[esp] = expr_stack[esp - depth];
                 pz_trace_instr2(rsp, "pick", depth);
                 break;
             }
             case PZT_CALL:
+                CHECK_STACKS(1);
                 ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, MACHINE_WORD_SIZE);
                 return_stack[++rsp] = (ip + MACHINE_WORD_SIZE);
                 ip = *(uint8_t **)ip;
+                SAFEPOINT();
                 pz_trace_instr(rsp, "call");
                 break;
             case PZT_TCALL:
+                CHECK_STACKS(0);
                 ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, MACHINE_WORD_SIZE);
                 ip = *(uint8_t **)ip;
+                SAFEPOINT();
                 pz_trace_instr(rsp, "tcall");
                 break;
             case PZT_CALL_IND:
+                CHECK_STACKS(1);
                 return_stack[++rsp] = ip;
                 ip = (uint8_t *)expr_stack[esp--].ptr;
+                SAFEPOINT();
                 pz_trace_instr(rsp, "call_ind");
                 break;
             case PZT_CJMP_8:
                 ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, MACHINE_WORD_SIZE);
                 if (expr_stack[esp--].u8) {
-                    ip = *(uint8_t **)ip;
+                    JUMP_TO(*(uint8_t **)ip);
                     pz_trace_instr(rsp, "cjmp:8 taken");
                 } else {
                     ip += MACHINE_WORD_SIZE;
@@ -638,7 +1601,7 @@ pz_run(PZ *pz)
             case PZT_CJMP_16:
                 ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, MACHINE_WORD_SIZE);
                 if (expr_stack[esp--].u16) {
-                    ip = *(uint8_t **)ip;
+                    JUMP_TO(*(uint8_t **)ip);
                     pz_trace_instr(rsp, "cjmp:16 taken");
                 } else {
                     ip += MACHINE_WORD_SIZE;
@@ -648,7 +1611,7 @@ pz_run(PZ *pz)
             case PZT_CJMP_32:
                 ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, MACHINE_WORD_SIZE);
                 if (expr_stack[esp--].u32) {
-                    ip = *(uint8_t **)ip;
+                    JUMP_TO(*(uint8_t **)ip);
                     pz_trace_instr(rsp, "cjmp:32 taken");
                 } else {
                     ip += MACHINE_WORD_SIZE;
@@ -658,7 +1621,7 @@ pz_run(PZ *pz)
             case PZT_CJMP_64:
                 ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, MACHINE_WORD_SIZE);
                 if (expr_stack[esp--].u64) {
-                    ip = *(uint8_t **)ip;
+                    JUMP_TO(*(uint8_t **)ip);
                     pz_trace_instr(rsp, "cjmp:64 taken");
                 } else {
                     ip += MACHINE_WORD_SIZE;
@@ -667,7 +1630,7 @@ pz_run(PZ *pz)
                 break;
             case PZT_JMP:
                 ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, MACHINE_WORD_SIZE);
-                ip = *(uint8_t **)ip;
+                JUMP_TO(*(uint8_t **)ip);
                 pz_trace_instr(rsp, "jmp");
                 break;
             case PZT_RET:
@@ -680,7 +1643,8 @@ pz_run(PZ *pz)
                 ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, MACHINE_WORD_SIZE);
                 size = *(uintptr_t *)ip;
                 ip += MACHINE_WORD_SIZE;
-                addr = malloc(size);
+                addr = pz_heap_alloc(context->heap, size);
+                CHECK_PUSH();
                 expr_stack[++esp].ptr = addr;
                 pz_trace_instr(rsp, "alloc");
                 break;
@@ -692,6 +1656,7 @@ pz_run(PZ *pz)
                 offset = *(uint16_t *)ip;
                 ip += 2;
                 /* (ptr - * ptr) */
+                CHECK_PUSH();
                 addr = expr_stack[esp].ptr + offset;
                 expr_stack[esp + 1].ptr = expr_stack[esp].ptr;
                 expr_stack[esp].u8 = *(uint8_t *)addr;
@@ -706,6 +1671,7 @@ pz_run(PZ *pz)
                 offset = *(uint16_t *)ip;
                 ip += 2;
                 /* (ptr - * ptr) */
+                CHECK_PUSH();
                 addr = expr_stack[esp].ptr + offset;
                 expr_stack[esp + 1].ptr = expr_stack[esp].ptr;
                 expr_stack[esp].u16 = *(uint16_t *)addr;
@@ -720,6 +1686,7 @@ pz_run(PZ *pz)
                 offset = *(uint16_t *)ip;
                 ip += 2;
                 /* (ptr - * ptr) */
+                CHECK_PUSH();
                 addr = expr_stack[esp].ptr + offset;
                 expr_stack[esp + 1].ptr = expr_stack[esp].ptr;
                 expr_stack[esp].u32 = *(uint32_t *)addr;
@@ -734,6 +1701,7 @@ pz_run(PZ *pz)
                 offset = *(uint16_t *)ip;
                 ip += 2;
                 /* (ptr - * ptr) */
+                CHECK_PUSH();
                 addr = expr_stack[esp].ptr + offset;
                 expr_stack[esp + 1].ptr = expr_stack[esp].ptr;
                 expr_stack[esp].u64 = *(uint64_t *)addr;
@@ -797,24 +1765,231 @@ pz_run(PZ *pz)
                 pz_trace_instr(rsp, "store_64");
                 break;
             }
+            case PZT_SPAWN: {
+                uint8_t *callee;
+                PZ_Task *task = NULL;
+                ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, MACHINE_WORD_SIZE);
+                callee = *(uint8_t **)ip;
+                ip += MACHINE_WORD_SIZE;
+                if (context->worker != NULL) {
+                    task = pz_scheduler_spawn(context->worker, fiber->task,
+                                              callee, expr_stack[esp].u64);
+                }
+                if (task != NULL) {
+                    expr_stack[esp].ptr = task;
+                    pz_trace_instr(rsp, "spawn");
+                } else if (context->worker != NULL) {
+                    /*
+                     * The task is too deep or the deque is full, call the
+                     * procedure now and return through task_result_proc
+                     * which makes its result into a finished task.
+                     */
+                    CHECK_STACKS(2);
+                    return_stack[++rsp] = ip;
+                    return_stack[++rsp] = context->task_result_proc;
+                    ip = callee;
+                    pz_trace_instr(rsp, "spawn (call)");
+                } else {
+                    /*
+                     * Call the procedure now, its result takes the place
+                     * of the task and wait does nothing.
+                     */
+                    CHECK_STACKS(1);
+                    return_stack[++rsp] = ip;
+                    ip = callee;
+                    pz_trace_instr(rsp, "spawn (call)");
+                }
+                break;
+            }
+            case PZT_WAIT:
+                pz_trace_instr(rsp, "wait");
+                if (context->worker != NULL) {
+                    PZ_Task *task = expr_stack[esp].ptr;
+
+                    fiber->waiting = task;
+                    SAVE_FIBER();
+                    fiber = pz_scheduler_park(context->worker, task, fiber);
+                    if (fiber == NULL) {
+                        return;
+                    }
+                    context->fiber = fiber;
+                    LOAD_FIBER();
+                    COMPLETE_WAIT();
+                }
+                break;
+            case PZT_TASK_RESULT:
+                expr_stack[esp].ptr =
+                  pz_scheduler_finished_task(context->worker,
+                                             expr_stack[esp].u64);
+                ip = return_stack[rsp--];
+                pz_trace_instr(rsp, "task result");
+                break;
+            case PZT_TASK_END: {
+                PZ_Task *task = fiber->task;
+                uint64_t result;
 
-            case PZT_END:
-                retcode = expr_stack[esp].s32;
+                pz_trace_instr(rsp, "task end");
                 if (esp != 1) {
-                    fprintf(stderr, "Stack misaligned, esp: %d should be 1\n",
+                    fprintf(stderr, "Stack misaligned, esp: %u should be 1\n",
                             esp);
                     abort();
                 }
+                result = expr_stack[esp].u64;
+                // A task's output, if any, can't wait for the end of the
+                // program.
+                pz_context_flush(context);
+
+                fiber->next = context->free_fibers;
+                context->free_fibers = fiber;
+                fiber = pz_scheduler_finish(context->worker, task, result);
+                if (fiber == NULL) {
+                    return;
+                }
+                context->fiber = fiber;
+                LOAD_FIBER();
+                COMPLETE_WAIT();
+                break;
+            }
+            case PZT_PARALLEL_MAP: {
+                uint8_t   *func = expr_stack[esp - 1].ptr;
+                Int_Array *input = expr_stack[esp].ptr;
+
+                esp--;
+                expr_stack[esp].ptr = parallel_job_new(context->heap,
+                        PARALLEL_MAP, func, input, 0);
+                pz_trace_instr(rsp, "parallel map");
+                break;
+            }
+            case PZT_PARALLEL_REDUCE: {
+                uint8_t   *func = expr_stack[esp - 2].ptr;
+                Int_Array *input = expr_stack[esp - 1].ptr;
+                int32_t    init = expr_stack[esp].s32;
+
+                esp -= 2;
+                expr_stack[esp].ptr = parallel_job_new(context->heap,
+                        PARALLEL_REDUCE, func, input, init);
+                pz_trace_instr(rsp, "parallel reduce");
+                break;
+            }
+            case PZT_PARALLEL_STEP: {
+                /*
+                 * This instruction is run again after each chunk that it
+                 * runs or waits for, until the job is finished.
+                 */
+                Parallel_Job *job = expr_stack[esp].ptr;
+                Chunk        *chunk;
+
+                if (job->calling) {
+                    // Drop the job returned by the chunk procedure.
+                    esp--;
+                    job->calling = false;
+                }
+                chunk = parallel_next(context, job);
+                if (chunk == NULL) {
+                    if (job->kind == PARALLEL_MAP) {
+                        expr_stack[esp].ptr = job->output;
+                    } else {
+                        expr_stack[esp].s32 = job->combine.acc;
+                    }
+                    pz_trace_instr(rsp, "parallel step (done)");
+                } else if (chunk->task == NULL) {
+                    CHECK_STACKS(1);
+                    job->calling = true;
+                    expr_stack[++esp].ptr = chunk;
+                    return_stack[++rsp] = ip - 1;
+                    ip = context->chunk_start_proc;
+                    pz_trace_instr(rsp, "parallel step (run)");
+                } else {
+                    PZ_Fiber *next;
+
+                    pz_trace_instr(rsp, "parallel step (wait)");
+                    ip--;
+                    SAVE_FIBER();
+                    next = pz_scheduler_park(context->worker, chunk->task,
+                                             fiber);
+                    if (next == fiber) {
+                        pz_scheduler_task_result(context->worker,
+                                                 chunk->task);
+                        chunk->task = NULL;
+                        job->next_wait++;
+                    } else if (next == NULL) {
+                        return;
+                    } else {
+                        fiber = next;
+                        context->fiber = fiber;
+                        LOAD_FIBER();
+                        COMPLETE_WAIT();
+                    }
+                }
+                break;
+            }
+            case PZT_CHUNK_START:
+                // Push a result for chunk step to ignore.
+                expr_stack[++esp].u64 = 0;
+                /* fall through */
+            case PZT_CHUNK_STEP: {
+                Chunk        *chunk = expr_stack[esp - 1].ptr;
+                Parallel_Job *job = chunk->job;
+                int32_t       result = expr_stack[esp--].s32;
+
+                if (chunk->calling) {
+                    if (job->kind == PARALLEL_REDUCE) {
+                        chunk->acc = result;
+                    } else {
+                        job->output->elements[chunk->pos] = result;
+                    }
+                    chunk->pos++;
+                }
+                if (chunk->pos < chunk->end) {
+                    CHECK_STACKS(1);
+                    if (job->kind == PARALLEL_REDUCE) {
+                        expr_stack[++esp].s32 = chunk->acc;
+                    }
+                    expr_stack[++esp].s32 =
+                      chunk->input->elements[chunk->pos];
+                    chunk->calling = true;
+                    return_stack[++rsp] = context->chunk_step_proc;
+                    ip = job->func;
+                    SAFEPOINT();
+                    pz_trace_instr(rsp, "chunk call");
+                } else {
+                    // Return the job, see PZT_PARALLEL_STEP.
+                    expr_stack[esp].ptr = job;
+                    ip = return_stack[rsp--];
+                    pz_trace_instr(rsp, "chunk end");
+                }
+                break;
+            }
+            case PZT_END:
+                SAVE_FIBER();
                 pz_trace_instr(rsp, "end");
                 pz_trace_state(ip, rsp, esp, (uint64_t *)expr_stack);
-                goto finish;
+                return;
             case PZT_CCALL: {
-                ccall_func callee;
+                ccall_func  callee;
+                uint8_t    *ccall_ip = ip - 1;
+                CHECK_STACKS(0);
                 ip = (uint8_t *)ALIGN_UP((uintptr_t)ip, MACHINE_WORD_SIZE);
                 callee = *(ccall_func *)ip;
-                esp = callee(expr_stack, esp);
+                esp = callee(expr_stack, esp, context);
                 ip += MACHINE_WORD_SIZE;
                 pz_trace_instr(rsp, "ccall");
+                if (context->blocked) {
+                    /*
+                     * The builtin parked the fiber on a channel, it calls
+                     * the builtin again when it is resumed.
+                     */
+                    context->blocked = false;
+                    ip = ccall_ip;
+                    SAVE_FIBER();
+                    fiber = pz_scheduler_next(context->worker);
+                    if (fiber == NULL) {
+                        return;
+                    }
+                    context->fiber = fiber;
+                    LOAD_FIBER();
+                    COMPLETE_WAIT();
+                }
                 break;
             }
             default:
@@ -823,13 +1998,43 @@ pz_run(PZ *pz)
         }
         pz_trace_state(ip, rsp, esp, (uint64_t *)expr_stack);
     }
+#undef SAVE_FIBER
+#undef LOAD_FIBER
+#undef CHECK_STACKS
+#undef CHECK_PUSH
+#undef COMPLETE_WAIT
+#undef SAFEPOINT
+#undef JUMP_TO
+}
 
-finish:
-    free(wrapper_proc);
-    free(return_stack);
-    free(expr_stack);
+/*
+ * Set by pz_interrupt(), possibly from a signal handler.
+ */
+static int interrupted = 0;
 
-    return retcode;
+void
+pz_interrupt(void)
+{
+    __atomic_store_n(&interrupted, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * The fiber has used up its time slice, return the fiber to run next.
+ */
+static PZ_Fiber *
+context_safepoint(PZ_Context *context, PZ_Fiber *fiber)
+{
+    if (__atomic_load_n(&interrupted, __ATOMIC_RELAXED)) {
+        context_flush_all(context);
+        fprintf(stderr, "Interrupted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (context->worker != NULL) {
+        fiber = pz_scheduler_yield(context->worker, fiber);
+        context->fiber = fiber;
+    }
+    return fiber;
 }
 
 /*
@@ -862,6 +2067,16 @@ pz_immediate_size(Immediate_Type imt)
     abort();
 }
 
+unsigned
+pz_immediate_offset(unsigned offset, Immediate_Type imm_type)
+{
+    // The immediate follows the one byte token, aligned to its size.
+    if (imm_type == IMT_NONE) {
+        return offset + 1;
+    }
+    return ALIGN_UP(offset + 1, pz_immediate_size(imm_type));
+}
+
 unsigned
 pz_write_instr(uint8_t *       proc,
                unsigned        offset,
@@ -1099,6 +2314,16 @@ pz_write_instr(uint8_t *       proc,
     PZ_WRITE_INSTR_1(PZI_STORE, PZW_32, PZT_STORE_32);
     PZ_WRITE_INSTR_1(PZI_STORE, PZW_64, PZT_STORE_64);
 
+    PZ_WRITE_INSTR_0(PZI_SPAWN, PZT_SPAWN);
+    PZ_WRITE_INSTR_0(PZI_WAIT, PZT_WAIT);
+
+    PZ_WRITE_INSTR_0(PZI_TASK_RESULT, PZT_TASK_RESULT);
+    PZ_WRITE_INSTR_0(PZI_TASK_END, PZT_TASK_END);
+    PZ_WRITE_INSTR_0(PZI_PARALLEL_MAP, PZT_PARALLEL_MAP);
+    PZ_WRITE_INSTR_0(PZI_PARALLEL_REDUCE, PZT_PARALLEL_REDUCE);
+    PZ_WRITE_INSTR_0(PZI_PARALLEL_STEP, PZT_PARALLEL_STEP);
+    PZ_WRITE_INSTR_0(PZI_CHUNK_START, PZT_CHUNK_START);
+    PZ_WRITE_INSTR_0(PZI_CHUNK_STEP, PZT_CHUNK_STEP);
     PZ_WRITE_INSTR_0(PZI_END, PZT_END);
     PZ_WRITE_INSTR_0(PZI_CCALL, PZT_CCALL);
 
@@ -1115,11 +2340,10 @@ write_opcode:
     if (proc != NULL) {
         *((uint8_t *)(&proc[offset])) = token;
     }
-    offset += 1;
+    offset = pz_immediate_offset(offset, imm_type);
 
     if (imm_type != IMT_NONE) {
         imm_size = pz_immediate_size(imm_type);
-        offset = ALIGN_UP(offset, imm_size);
 
         if (proc != NULL) {
             switch (imm_type) {
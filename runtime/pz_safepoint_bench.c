@@ -0,0 +1,263 @@
+/*
+ * Safepoint polling benchmark
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ *
+ * The interpreter polls for a safepoint at each call and backward jump.
+ * This program measures the cost of a poll by timing a loop that polls on
+ * every iteration and the same loop unrolled with forward jumps, which
+ * polls on only one iteration in UNROLL.  It also times calls, which
+ * always poll.  Each is run with and without a scheduler, with a scheduler
+ * the fiber yields at the end of each time slice.  Run it with "make
+ * bench".
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "pz_common.h"
+
+#include "pz_api.h"
+#include "pz_scheduler.h"
+
+#define LOOP_ITERATIONS (1 << 26)
+#define UNROLL          16
+#define FIB_INPUT       27
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * The benchmark doesn't depend on pzasm, so it builds its procedures in
+ * memory.  Jumps and calls refer to addresses, so each procedure is written
+ * twice: first with proc NULL to find its size, then into its own buffer
+ * at self.
+ */
+
+/*
+ * Write one iteration of a loop: (n - n-1), jumping to target if n-1 isn't
+ * zero and returning otherwise.
+ */
+static unsigned
+write_loop_step(uint8_t *proc, unsigned offset, uint8_t *target)
+{
+    Immediate_Value imm = {.word = 0 };
+
+    imm.uint32 = 1;
+    offset = pz_write_instr(proc, offset, PZI_LOAD_IMMEDIATE_NUM,
+                            PZW_FAST, 0, IMT_32, imm);
+    offset = pz_write_instr(proc, offset, PZI_SUB, PZW_FAST, 0, IMT_NONE,
+                            imm);
+    imm.uint8 = 1;
+    offset = pz_write_instr(proc, offset, PZI_PICK, 0, 0, IMT_8, imm);
+    imm.word = (uintptr_t)target;
+    offset = pz_write_instr(proc, offset, PZI_CJMP, PZW_FAST, 0,
+                            IMT_LABEL_REF, imm);
+    offset = pz_write_instr(proc, offset, PZI_RET, 0, 0, IMT_NONE, imm);
+
+    return offset;
+}
+
+/*
+ * (n - 0) counting down with a backward jump, and so a poll, on each
+ * iteration.
+ */
+static unsigned
+make_poll_loop_instrs(uint8_t *proc, uint8_t *self)
+{
+    return write_loop_step(proc, 0, self);
+}
+
+/*
+ * The same loop unrolled UNROLL times.  Each step jumps forward to the
+ * next, which doesn't poll, and the last jumps back to the first.  n must
+ * be a multiple of UNROLL.
+ */
+static unsigned
+make_unrolled_loop_instrs(uint8_t *proc, uint8_t *self)
+{
+    unsigned offset = 0;
+
+    for (unsigned i = 0; i < UNROLL; i++) {
+        // Find where the next step starts, the size of a step depends on
+        // the alignment of its immediates but not their values.
+        unsigned  next_offset = write_loop_step(NULL, offset, NULL);
+        uint8_t  *next = i + 1 < UNROLL ? self + next_offset : self;
+
+        offset = write_loop_step(proc, offset, next);
+    }
+
+    return offset;
+}
+
+/*
+ * fib (w - w) returns 1 for inputs below 2 and calls itself twice
+ * otherwise.
+ */
+static unsigned
+make_fib_instrs(uint8_t *proc, uint8_t *self, unsigned *base)
+{
+    unsigned        offset = 0;
+    Immediate_Value imm = {.word = 0 };
+
+    imm.uint8 = 1;
+    offset = pz_write_instr(proc, offset, PZI_PICK, 0, 0, IMT_8, imm);
+    imm.uint32 = 2;
+    offset = pz_write_instr(proc, offset, PZI_LOAD_IMMEDIATE_NUM,
+                            PZW_FAST, 0, IMT_32, imm);
+    offset = pz_write_instr(proc, offset, PZI_LT_U, PZW_FAST, 0, IMT_NONE,
+                            imm);
+    imm.word = (uintptr_t)(self + *base);
+    offset = pz_write_instr(proc, offset, PZI_CJMP, PZW_FAST, 0,
+                            IMT_LABEL_REF, imm);
+
+    // n - n fib(n-1)
+    imm.uint8 = 1;
+    offset = pz_write_instr(proc, offset, PZI_PICK, 0, 0, IMT_8, imm);
+    imm.uint32 = 1;
+    offset = pz_write_instr(proc, offset, PZI_LOAD_IMMEDIATE_NUM,
+                            PZW_FAST, 0, IMT_32, imm);
+    offset = pz_write_instr(proc, offset, PZI_SUB, PZW_FAST, 0, IMT_NONE,
+                            imm);
+    imm.word = (uintptr_t)self;
+    offset = pz_write_instr(proc, offset, PZI_CALL, 0, 0, IMT_CODE_REF,
+                            imm);
+
+    // n fib(n-1) - fib(n-1) fib(n-2)
+    imm.uint8 = 2;
+    offset = pz_write_instr(proc, offset, PZI_ROLL, 0, 0, IMT_8, imm);
+    imm.uint32 = 2;
+    offset = pz_write_instr(proc, offset, PZI_LOAD_IMMEDIATE_NUM,
+                            PZW_FAST, 0, IMT_32, imm);
+    offset = pz_write_instr(proc, offset, PZI_SUB, PZW_FAST, 0, IMT_NONE,
+                            imm);
+    imm.word = (uintptr_t)self;
+    offset = pz_write_instr(proc, offset, PZI_CALL, 0, 0, IMT_CODE_REF,
+                            imm);
+    offset = pz_write_instr(proc, offset, PZI_ADD, PZW_FAST, 0, IMT_NONE,
+                            imm);
+    offset = pz_write_instr(proc, offset, PZI_RET, 0, 0, IMT_NONE, imm);
+
+    *base = offset;
+    offset = pz_write_instr(proc, offset, PZI_DROP, 0, 0, IMT_NONE, imm);
+    imm.uint32 = 1;
+    offset = pz_write_instr(proc, offset, PZI_LOAD_IMMEDIATE_NUM,
+                            PZW_FAST, 0, IMT_32, imm);
+    offset = pz_write_instr(proc, offset, PZI_RET, 0, 0, IMT_NONE, imm);
+
+    return offset;
+}
+
+static uint8_t *
+make_loop(unsigned (*make_instrs)(uint8_t *proc, uint8_t *self))
+{
+    unsigned  size;
+    uint8_t  *proc;
+
+    size = make_instrs(NULL, NULL);
+    proc = malloc(size);
+    make_instrs(proc, proc);
+
+    return proc;
+}
+
+static uint8_t *
+make_fib(void)
+{
+    unsigned  base = 0;
+    unsigned  size;
+    uint8_t  *proc;
+
+    size = make_fib_instrs(NULL, NULL, &base);
+    proc = malloc(size);
+    make_fib_instrs(proc, proc, &base);
+
+    return proc;
+}
+
+/*
+ * Run proc(input) on a new context, with a single worker scheduler if
+ * sched is true.
+ */
+static double
+time_proc(uint8_t *proc, int32_t input, bool sched, int32_t *result)
+{
+    PZ_Context   *context;
+    PZ_Scheduler *scheduler = NULL;
+    double        start, time;
+
+    context = pz_context_init();
+    if (sched) {
+        scheduler = pz_scheduler_init(1);
+        pz_scheduler_attach(scheduler, context);
+    }
+
+    start = now();
+    pz_context_push_int(context, input);
+    pz_context_call(context, proc);
+    *result = pz_context_pop_int(context);
+    time = now() - start;
+
+    if (scheduler != NULL) {
+        pz_scheduler_free(scheduler);
+    }
+    pz_context_free(context);
+
+    return time;
+}
+
+int
+main(int argc, char *const argv[])
+{
+    uint8_t *poll_loop = make_loop(make_poll_loop_instrs);
+    uint8_t *unrolled_loop = make_loop(make_unrolled_loop_instrs);
+    uint8_t *fib = make_fib();
+    unsigned num_polls;
+    int32_t  result;
+
+    // All but one in UNROLL of the poll loop's polls are saved by the
+    // unrolled loop.
+    num_polls = LOOP_ITERATIONS - LOOP_ITERATIONS / UNROLL;
+
+    for (unsigned sched = 0; sched < 2; sched++) {
+        double poll_time, unrolled_time, fib_time;
+        int32_t num_calls;
+
+        poll_time = time_proc(poll_loop, LOOP_ITERATIONS, sched, &result);
+        if (result != 0) goto wrong;
+        unrolled_time = time_proc(unrolled_loop, LOOP_ITERATIONS, sched,
+                                  &result);
+        if (result != 0) goto wrong;
+        fib_time = time_proc(fib, FIB_INPUT, sched, &num_calls);
+        // fib(n) returns the number of base cases it reaches, so it makes
+        // one fewer calls than twice that.
+        num_calls = num_calls * 2 - 1;
+
+        printf("%s:\n", sched ? "1 worker" : "No scheduler");
+        printf("  Loop, poll every iteration: %6.1fms\n", poll_time * 1e3);
+        printf("  Loop, poll every %2d:        %6.1fms "
+               "(%+.2fns per poll)\n",
+               UNROLL, unrolled_time * 1e3,
+               (poll_time - unrolled_time) * 1e9 / num_polls);
+        printf("  fib(%d):                    %6.1fms (%.2fns per call)\n",
+               FIB_INPUT, fib_time * 1e3, fib_time * 1e9 / num_calls);
+    }
+
+    free(poll_loop);
+    free(unrolled_loop);
+    free(fib);
+    return EXIT_SUCCESS;
+
+wrong:
+    fprintf(stderr, "A loop returned %d, expected 0\n", (int)result);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,637 @@
+/*
+ * Plasma task scheduler
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pz_common.h"
+
+#include "pz_scheduler.h"
+
+#define DEQUE_INITIAL_CAPACITY 64
+#define READY_INITIAL_CAPACITY 16
+
+struct PZ_Task_Struct {
+    uint8_t   *proc_code;
+    uint64_t   arg;
+    uint64_t   result;
+    // The number of tasks that it was spawned within.
+    unsigned   depth;
+    // The next task in a worker's list of free tasks.
+    PZ_Task   *next_free;
+    // These are protected by the scheduler's lock.
+    bool       done;
+    // The fiber parked waiting for the task, and the worker it belongs to.
+    PZ_Fiber  *waiter;
+    PZ_Worker *waiter_worker;
+};
+
+/*
+ * The owner pushes and pops tasks at the bottom, thieves take them from
+ * the top.  Tasks between top and bottom are waiting to run.
+ */
+typedef struct {
+    pthread_mutex_t   lock;
+    PZ_Task         **tasks;
+    unsigned          top;
+    unsigned          bottom;
+    unsigned          capacity;
+} Deque;
+
+struct PZ_Worker_Struct {
+    PZ_Scheduler *sched;
+    unsigned      id;
+    PZ_Context   *context;
+    Deque         deque;
+    /*
+     * Parked fibers whose tasks have finished, they are resumed before new
+     * tasks are started.  Protected by the scheduler's lock.
+     */
+    PZ_Fiber    **ready;
+    unsigned      num_ready;
+    unsigned      ready_capacity;
+    /*
+     * Tasks that can be reused without calling malloc().  Only the
+     * worker's own thread uses the list, a task is freed by the worker
+     * that waited for it.
+     */
+    PZ_Task      *free_tasks;
+    // For choosing a victim to steal from.
+    uint32_t      random;
+    pthread_t     thread;
+    bool          running;
+};
+
+/*
+ * Workers with nothing to do sleep on the changed condition, it is
+ * signalled when a task is spawned or a fiber becomes ready.  The
+ * scheduler's lock must be taken before any deque's lock.
+ */
+struct PZ_Scheduler_Struct {
+    unsigned         num_workers;
+    PZ_Worker       *workers;
+    bool             started;
+
+    pthread_mutex_t  lock;
+    pthread_cond_t   changed;
+    unsigned         num_sleeping;
+    bool             stopping;
+};
+
+static void
+start_workers(PZ_Scheduler *sched);
+
+static void *
+worker_main(void *worker);
+
+static void
+sleep_locked(PZ_Scheduler *sched);
+
+static void
+ready_push(PZ_Worker *worker, PZ_Fiber *fiber);
+
+static PZ_Task *
+task_new(PZ_Worker *worker);
+
+static void
+task_free(PZ_Worker *worker, PZ_Task *task);
+
+static PZ_Task *
+find_task(PZ_Worker *worker);
+
+static PZ_Task *
+steal_task(PZ_Worker *worker);
+
+static void
+deque_init(Deque *deque);
+
+static void
+deque_free(Deque *deque);
+
+static bool
+deque_push(Deque *deque, PZ_Task *task);
+
+static PZ_Task *
+deque_pop(Deque *deque);
+
+static PZ_Task *
+deque_steal(Deque *deque);
+
+PZ_Scheduler *
+pz_scheduler_init(unsigned num_workers)
+{
+    PZ_Scheduler *sched;
+
+    assert(num_workers > 0);
+
+    sched = malloc(sizeof(PZ_Scheduler));
+    sched->num_workers = num_workers;
+    sched->workers = malloc(sizeof(PZ_Worker) * num_workers);
+    sched->started = false;
+    sched->num_sleeping = 0;
+    sched->stopping = false;
+    if ((0 != pthread_mutex_init(&sched->lock, NULL)) ||
+        (0 != pthread_cond_init(&sched->changed, NULL)))
+    {
+        fprintf(stderr, "Couldn't initialise the scheduler\n");
+        free(sched->workers);
+        free(sched);
+        return NULL;
+    }
+
+    for (unsigned i = 0; i < num_workers; i++) {
+        PZ_Worker *worker = &sched->workers[i];
+
+        worker->sched = sched;
+        worker->id = i;
+        deque_init(&worker->deque);
+        worker->ready = malloc(sizeof(PZ_Fiber *) * READY_INITIAL_CAPACITY);
+        worker->num_ready = 0;
+        worker->ready_capacity = READY_INITIAL_CAPACITY;
+        worker->free_tasks = NULL;
+        worker->random = i + 1;
+        worker->running = false;
+        if (i == 0) {
+            // Worker 0 uses the context it is attached to.
+            worker->context = NULL;
+        } else {
+            worker->context = pz_context_init();
+            pz_context_set_worker(worker->context, worker);
+        }
+    }
+
+    return sched;
+}
+
+void
+pz_scheduler_free(PZ_Scheduler *sched)
+{
+    pthread_mutex_lock(&sched->lock);
+    sched->stopping = true;
+    pthread_cond_broadcast(&sched->changed);
+    pthread_mutex_unlock(&sched->lock);
+
+    // Any worker may steal from any other, so stop them all first.
+    for (unsigned i = 1; i < sched->num_workers; i++) {
+        if (sched->workers[i].running) {
+            pthread_join(sched->workers[i].thread, NULL);
+        }
+    }
+
+    for (unsigned i = 0; i < sched->num_workers; i++) {
+        PZ_Worker *worker = &sched->workers[i];
+
+        if (i == 0) {
+            if (worker->context != NULL) {
+                pz_context_set_worker(worker->context, NULL);
+            }
+        } else {
+            pz_context_free(worker->context);
+        }
+        assert(worker->num_ready == 0);
+        free(worker->ready);
+        deque_free(&worker->deque);
+        while (worker->free_tasks != NULL) {
+            PZ_Task *task = worker->free_tasks;
+
+            worker->free_tasks = task->next_free;
+            free(task);
+        }
+    }
+
+    pthread_cond_destroy(&sched->changed);
+    pthread_mutex_destroy(&sched->lock);
+    free(sched->workers);
+    free(sched);
+}
+
+void
+pz_scheduler_attach(PZ_Scheduler *sched, PZ_Context *context)
+{
+    assert(sched->workers[0].context == NULL);
+
+    sched->workers[0].context = context;
+    pz_context_set_worker(context, &sched->workers[0]);
+}
+
+unsigned
+pz_scheduler_default_workers(void)
+{
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return num_cpus > 0 ? num_cpus : 1;
+}
+
+PZ_Task *
+pz_scheduler_spawn(PZ_Worker *worker, PZ_Task *parent, uint8_t *proc_code,
+                   uint64_t arg)
+{
+    PZ_Scheduler *sched = worker->sched;
+    PZ_Task      *task;
+    unsigned      depth = parent != NULL ? parent->depth + 1 : 1;
+
+    if (depth > PZ_SPAWN_MAX_DEPTH) {
+        return NULL;
+    }
+
+    task = task_new(worker);
+    task->proc_code = proc_code;
+    task->arg = arg;
+    task->depth = depth;
+    task->done = false;
+    task->waiter = NULL;
+    task->waiter_worker = NULL;
+
+    /*
+     * Only worker 0 can spawn a task before the other workers are
+     * started, so this needs no lock.
+     */
+    if (!sched->started) {
+        start_workers(sched);
+    }
+
+    if (!deque_push(&worker->deque, task)) {
+        task_free(worker, task);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&sched->lock);
+    if (sched->num_sleeping > 0) {
+        pthread_cond_broadcast(&sched->changed);
+    }
+    pthread_mutex_unlock(&sched->lock);
+
+    return task;
+}
+
+PZ_Task *
+pz_scheduler_finished_task(PZ_Worker *worker, uint64_t result)
+{
+    PZ_Task *task = task_new(worker);
+
+    task->proc_code = NULL;
+    task->arg = 0;
+    task->result = result;
+    task->done = true;
+    task->waiter = NULL;
+    task->waiter_worker = NULL;
+
+    return task;
+}
+
+PZ_Fiber *
+pz_scheduler_park(PZ_Worker *worker, PZ_Task *task, PZ_Fiber *fiber)
+{
+    PZ_Scheduler *sched = worker->sched;
+
+    /*
+     * Tasks made by pz_scheduler_finished_task() have no procedure, only
+     * the fiber that made them can see them so they need no lock.
+     */
+    if (task->proc_code == NULL) {
+        return fiber;
+    }
+
+    pthread_mutex_lock(&sched->lock);
+    if (task->done) {
+        pthread_mutex_unlock(&sched->lock);
+        return fiber;
+    }
+    task->waiter = fiber;
+    task->waiter_worker = worker;
+    pthread_mutex_unlock(&sched->lock);
+
+    return pz_scheduler_next(worker);
+}
+
+uint64_t
+pz_scheduler_task_result(PZ_Worker *worker, PZ_Task *task)
+{
+    uint64_t result = task->result;
+
+    task_free(worker, task);
+    return result;
+}
+
+PZ_Fiber *
+pz_scheduler_finish(PZ_Worker *worker, PZ_Task *task, uint64_t result)
+{
+    PZ_Scheduler *sched = worker->sched;
+
+    pthread_mutex_lock(&sched->lock);
+    task->result = result;
+    task->done = true;
+    if (task->waiter != NULL) {
+        ready_push(task->waiter_worker, task->waiter);
+        if (sched->num_sleeping > 0) {
+            pthread_cond_broadcast(&sched->changed);
+        }
+    }
+    pthread_mutex_unlock(&sched->lock);
+
+    return pz_scheduler_next(worker);
+}
+
+PZ_Fiber *
+pz_scheduler_yield(PZ_Worker *worker, PZ_Fiber *fiber)
+{
+    PZ_Scheduler *sched = worker->sched;
+    PZ_Fiber     *next;
+    PZ_Task      *task;
+
+    pthread_mutex_lock(&sched->lock);
+    if (worker->num_ready > 0) {
+        next = worker->ready[--worker->num_ready];
+        // The yielding fiber goes to the back of the queue.
+        memmove(&worker->ready[1], &worker->ready[0],
+                sizeof(PZ_Fiber *) * worker->num_ready);
+        worker->ready[0] = fiber;
+        worker->num_ready++;
+        pthread_mutex_unlock(&sched->lock);
+        return next;
+    }
+
+    task = find_task(worker);
+    if (task == NULL) {
+        pthread_mutex_unlock(&sched->lock);
+        return fiber;
+    }
+    ready_push(worker, fiber);
+    pthread_mutex_unlock(&sched->lock);
+
+    return pz_context_new_fiber(worker->context, task, task->proc_code,
+                                task->arg);
+}
+
+void
+pz_scheduler_wake(PZ_Worker *worker, PZ_Fiber *fiber)
+{
+    PZ_Scheduler *sched = worker->sched;
+
+    pthread_mutex_lock(&sched->lock);
+    ready_push(worker, fiber);
+    if (sched->num_sleeping > 0) {
+        pthread_cond_broadcast(&sched->changed);
+    }
+    pthread_mutex_unlock(&sched->lock);
+}
+
+PZ_Fiber *
+pz_scheduler_next(PZ_Worker *worker)
+{
+    PZ_Scheduler *sched = worker->sched;
+    PZ_Task      *task = NULL;
+    PZ_Fiber     *fiber = NULL;
+
+    pthread_mutex_lock(&sched->lock);
+    while (true) {
+        if (worker->num_ready > 0) {
+            fiber = worker->ready[--worker->num_ready];
+            break;
+        }
+        task = find_task(worker);
+        if (task != NULL) break;
+        // Worker 0 stops when its main fiber finishes.
+        if (sched->stopping && (worker->id != 0)) break;
+        sleep_locked(sched);
+    }
+    pthread_mutex_unlock(&sched->lock);
+
+    if (task != NULL) {
+        fiber = pz_context_new_fiber(worker->context, task,
+                                     task->proc_code, task->arg);
+    }
+    return fiber;
+}
+
+void
+pz_scheduler_reset(PZ_Worker *worker)
+{
+    PZ_Scheduler *sched = worker->sched;
+
+    if (worker->id != 0) return;
+
+    for (unsigned i = 1; i < sched->num_workers; i++) {
+        pz_context_reset(sched->workers[i].context);
+    }
+}
+
+void
+pz_scheduler_flush(PZ_Worker *worker)
+{
+    PZ_Scheduler *sched = worker->sched;
+
+    for (unsigned i = 0; i < sched->num_workers; i++) {
+        pz_context_flush(sched->workers[i].context);
+    }
+}
+
+static void
+start_workers(PZ_Scheduler *sched)
+{
+    sched->started = true;
+    for (unsigned i = 1; i < sched->num_workers; i++) {
+        PZ_Worker *worker = &sched->workers[i];
+
+        if (0 != pthread_create(&worker->thread, NULL, worker_main,
+                                worker))
+        {
+            /*
+             * Tasks can still be run by the workers that did start, so
+             * this isn't fatal.
+             */
+            fprintf(stderr, "Couldn't start worker thread %u\n", i);
+            continue;
+        }
+        worker->running = true;
+    }
+}
+
+static void *
+worker_main(void *void_worker)
+{
+    PZ_Worker *worker = void_worker;
+
+    pz_context_run_worker(worker->context);
+
+    return NULL;
+}
+
+static void
+sleep_locked(PZ_Scheduler *sched)
+{
+    sched->num_sleeping++;
+    pthread_cond_wait(&sched->changed, &sched->lock);
+    sched->num_sleeping--;
+}
+
+// The scheduler's lock must be held.
+static void
+ready_push(PZ_Worker *worker, PZ_Fiber *fiber)
+{
+    if (worker->num_ready == worker->ready_capacity) {
+        worker->ready_capacity *= 2;
+        worker->ready = realloc(worker->ready,
+                                sizeof(PZ_Fiber *) * worker->ready_capacity);
+    }
+    worker->ready[worker->num_ready++] = fiber;
+}
+
+static PZ_Task *
+task_new(PZ_Worker *worker)
+{
+    PZ_Task *task = worker->free_tasks;
+
+    if (task != NULL) {
+        worker->free_tasks = task->next_free;
+    } else {
+        task = malloc(sizeof(PZ_Task));
+    }
+    task->depth = 0;
+    return task;
+}
+
+static void
+task_free(PZ_Worker *worker, PZ_Task *task)
+{
+    task->next_free = worker->free_tasks;
+    worker->free_tasks = task;
+}
+
+static PZ_Task *
+find_task(PZ_Worker *worker)
+{
+    PZ_Task *task;
+
+    task = deque_pop(&worker->deque);
+    if (task == NULL) {
+        task = steal_task(worker);
+    }
+    return task;
+}
+
+/*
+ * Try each other worker, starting from a random one so that thieves don't
+ * all pick on the same victim.
+ */
+static PZ_Task *
+steal_task(PZ_Worker *worker)
+{
+    PZ_Scheduler *sched = worker->sched;
+    unsigned      start;
+
+    if (sched->num_workers < 2) return NULL;
+
+    // xorshift32
+    worker->random ^= worker->random << 13;
+    worker->random ^= worker->random >> 17;
+    worker->random ^= worker->random << 5;
+    start = worker->random % sched->num_workers;
+
+    for (unsigned i = 0; i < sched->num_workers; i++) {
+        unsigned victim = (start + i) % sched->num_workers;
+        PZ_Task *task;
+
+        if (victim == worker->id) continue;
+        task = deque_steal(&sched->workers[victim].deque);
+        if (task != NULL) return task;
+    }
+
+    return NULL;
+}
+
+/*
+ * Deques
+ *
+ *********/
+
+static void
+deque_init(Deque *deque)
+{
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->tasks = malloc(sizeof(PZ_Task *) * DEQUE_INITIAL_CAPACITY);
+    deque->top = 0;
+    deque->bottom = 0;
+    deque->capacity = DEQUE_INITIAL_CAPACITY;
+}
+
+static void
+deque_free(Deque *deque)
+{
+    assert(deque->top == deque->bottom);
+    free(deque->tasks);
+    pthread_mutex_destroy(&deque->lock);
+}
+
+/*
+ * Returns false without pushing the task if the deque already holds
+ * PZ_SPAWN_CUTOFF tasks.
+ */
+static bool
+deque_push(Deque *deque, PZ_Task *task)
+{
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom - deque->top >= PZ_SPAWN_CUTOFF) {
+        pthread_mutex_unlock(&deque->lock);
+        return false;
+    }
+    if (deque->bottom == deque->capacity) {
+        if (deque->top > 0) {
+            // Reuse the space left by stolen tasks.
+            memmove(deque->tasks, &deque->tasks[deque->top],
+                    sizeof(PZ_Task *) * (deque->bottom - deque->top));
+            deque->bottom -= deque->top;
+            deque->top = 0;
+        } else {
+            deque->capacity *= 2;
+            deque->tasks = realloc(deque->tasks,
+                                   sizeof(PZ_Task *) * deque->capacity);
+        }
+    }
+    deque->tasks[deque->bottom++] = task;
+    pthread_mutex_unlock(&deque->lock);
+    return true;
+}
+
+static PZ_Task *
+deque_pop(Deque *deque)
+{
+    PZ_Task *task = NULL;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->top < deque->bottom) {
+        task = deque->tasks[--deque->bottom];
+        if (deque->top == deque->bottom) {
+            deque->top = 0;
+            deque->bottom = 0;
+        }
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return task;
+}
+
+static PZ_Task *
+deque_steal(Deque *deque)
+{
+    PZ_Task *task = NULL;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->top < deque->bottom) {
+        task = deque->tasks[deque->top++];
+        if (deque->top == deque->bottom) {
+            deque->top = 0;
+            deque->bottom = 0;
+        }
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return task;
+}
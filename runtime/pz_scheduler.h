@@ -0,0 +1,177 @@
+/*
+ * Plasma task scheduler
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#ifndef PZ_SCHEDULER_H
+#define PZ_SCHEDULER_H
+
+#include "pz_run.h"
+
+/*
+ * The scheduler runs the tasks created by the spawn instruction on a pool
+ * of worker threads.  Each worker has its own context and a deque of
+ * tasks: it pushes the tasks it spawns onto the bottom and pops them from
+ * there too, when it has nothing to do it steals from the top of another
+ * worker's deque.
+ *
+ * Each task that starts runs on a new fiber of the worker's context: a
+ * small set of stacks that the interpreter can switch to by saving and
+ * loading its registers.  A fiber that waits for an unfinished task is
+ * parked and the worker runs another fiber or starts another task, so
+ * waiting never blocks a thread while there is work.  When the task
+ * finishes the parked fiber is made ready again on the worker that parked
+ * it, fibers don't move between workers.
+ *
+ * Worker 0 is the thread that runs the program, it uses the program's own
+ * context.  The other workers' threads are started by the first spawn.
+ *
+ * Spawned procedures must be pure (see docs/pz_machine.txt), then the
+ * program's result is the same however its tasks are scheduled.  A context
+ * without a scheduler runs each task as soon as it is spawned.
+ */
+typedef struct PZ_Scheduler_Struct PZ_Scheduler;
+typedef struct PZ_Worker_Struct    PZ_Worker;
+typedef struct PZ_Task_Struct      PZ_Task;
+typedef struct PZ_Fiber_Struct     PZ_Fiber;
+
+/*
+ * Create a scheduler with num_workers workers including worker 0, returns
+ * NULL after printing an error.
+ */
+PZ_Scheduler *
+pz_scheduler_init(unsigned num_workers);
+
+/*
+ * Stop the scheduler's threads and free it.  There must be no tasks
+ * waiting to be run.
+ */
+void
+pz_scheduler_free(PZ_Scheduler *sched);
+
+/*
+ * Make context the context of worker 0, the program's tasks then run in
+ * parallel.  A scheduler may be attached to only one context.
+ */
+void
+pz_scheduler_attach(PZ_Scheduler *sched, PZ_Context *context);
+
+/*
+ * The number of workers to use if the user doesn't say: one for each
+ * online CPU.
+ */
+unsigned
+pz_scheduler_default_workers(void);
+
+/*
+ * These are used by the interpreter.
+ *
+ *************************************/
+
+/*
+ * Spawn a task on the worker's deque, parent is the task being run by the
+ * spawning fiber or NULL.  Returns NULL if the task would be more than
+ * PZ_SPAWN_MAX_DEPTH tasks deep or the worker already has PZ_SPAWN_CUTOFF
+ * tasks waiting, then the caller should call the procedure itself and
+ * make its result into a task with pz_scheduler_finished_task().  Neither
+ * calls malloc() once the worker has freed some tasks.
+ */
+PZ_Task *
+pz_scheduler_spawn(PZ_Worker *worker, PZ_Task *parent, uint8_t *proc_code,
+                   uint64_t arg);
+
+PZ_Task *
+pz_scheduler_finished_task(PZ_Worker *worker, uint64_t result);
+
+/*
+ * Park the fiber until the task is finished, and return the next fiber
+ * for the worker to run.  This is the same fiber if the task has already
+ * finished.
+ */
+PZ_Fiber *
+pz_scheduler_park(PZ_Worker *worker, PZ_Task *task, PZ_Fiber *fiber);
+
+/*
+ * Free a finished task and return its result, worker is the worker of the
+ * fiber that waited for it.
+ */
+uint64_t
+pz_scheduler_task_result(PZ_Worker *worker, PZ_Task *task);
+
+/*
+ * The fiber running the task has finished it, make any fiber waiting for
+ * it ready and return the next fiber for the worker to run.
+ */
+PZ_Fiber *
+pz_scheduler_finish(PZ_Worker *worker, PZ_Task *task, uint64_t result);
+
+/*
+ * The fiber has used up its time slice.  Return the next fiber for the
+ * worker to run, making this one ready if it is a different one.  This is
+ * the same fiber if the worker has nothing else to do.
+ */
+PZ_Fiber *
+pz_scheduler_yield(PZ_Worker *worker, PZ_Fiber *fiber);
+
+/*
+ * Make a fiber that was blocked ready, worker is the worker it belongs
+ * to.  This is used by channels, see pz_channel.h.
+ */
+void
+pz_scheduler_wake(PZ_Worker *worker, PZ_Fiber *fiber);
+
+/*
+ * Return the next fiber for the worker to run, a ready fiber or a new
+ * fiber for a task from a deque.  This sleeps until there is one, and
+ * returns NULL if the worker's thread should exit.
+ */
+PZ_Fiber *
+pz_scheduler_next(PZ_Worker *worker);
+
+/*
+ * Reset the heaps of the other workers' contexts, this is called when
+ * worker 0's context is reset.
+ */
+void
+pz_scheduler_reset(PZ_Worker *worker);
+
+/*
+ * Write the output of every worker's context, this is called before the
+ * program exits with an error.
+ */
+void
+pz_scheduler_flush(PZ_Worker *worker);
+
+/*
+ * These are defined with the interpreter in pz_run_*.c.
+ *
+ *******************************************************/
+
+void
+pz_context_set_worker(PZ_Context *context, PZ_Worker *worker);
+
+/*
+ * Write the context's buffered output, any thread may call this.
+ */
+void
+pz_context_flush(PZ_Context *context);
+
+/*
+ * Make a fiber to run a task's procedure on a context.  The fiber is freed
+ * by the interpreter when the task finishes.
+ */
+PZ_Fiber *
+pz_context_new_fiber(PZ_Context *context, PZ_Task *task,
+                     uint8_t *proc_code, uint64_t arg);
+
+/*
+ * Run the fibers given to a worker other than worker 0 by the scheduler,
+ * until the scheduler is stopped.
+ */
+void
+pz_context_run_worker(PZ_Context *context);
+
+#endif /* ! PZ_SCHEDULER_H */
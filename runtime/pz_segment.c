@@ -0,0 +1,74 @@
+/*
+ * Plasma memory segments
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+/*
+ * MAP_ANONYMOUS and MADV_HUGEPAGE are not part of POSIX.
+ */
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "pz_common.h"
+
+#include "pz_segment.h"
+#include "pz_util.h"
+
+uint8_t *
+pz_segment_init(size_t size, bool huge_pages, size_t *mapping_size)
+{
+    void *segment;
+
+    assert(size > 0);
+
+    *mapping_size = ALIGN_UP(size, (size_t)sysconf(_SC_PAGESIZE));
+#if defined(PZ_CODE_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+    /*
+     * Only large segments are worth backing with huge pages, rounding the
+     * size up lets the kernel use a huge page for the segment's end.
+     */
+    huge_pages = huge_pages && (*mapping_size >= PZ_HUGE_PAGE_SIZE);
+    if (huge_pages) {
+        *mapping_size = ALIGN_UP(*mapping_size, PZ_HUGE_PAGE_SIZE);
+    }
+#endif
+
+    segment = mmap(NULL, *mapping_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (segment == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+
+#if defined(PZ_CODE_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+    if (huge_pages) {
+        // This is only advice, it's okay if it fails.
+        madvise(segment, *mapping_size, MADV_HUGEPAGE);
+    }
+#endif
+
+    return segment;
+}
+
+bool
+pz_segment_protect(uint8_t *segment, size_t mapping_size)
+{
+    if (0 != mprotect(segment, mapping_size, PROT_READ)) {
+        perror("mprotect");
+        return false;
+    }
+
+    return true;
+}
+
+void
+pz_segment_free(uint8_t *segment, size_t mapping_size)
+{
+    munmap(segment, mapping_size);
+}
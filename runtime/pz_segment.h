@@ -0,0 +1,39 @@
+/*
+ * Plasma memory segments
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#ifndef PZ_SEGMENT_H
+#define PZ_SEGMENT_H
+
+/*
+ * A module's code and its static data are each placed in a single memory
+ * mapping, a segment, so that things used together share cache lines and
+ * pages.  Segments are made read-only once they're loaded.  Since they are
+ * never written after that, processes forked after loading share the
+ * segments' pages rather than each having a copy.
+ */
+
+/*
+ * Map a writable segment of at least size bytes, size must not be zero.
+ * The size of the mapping is returned in mapping_size and must be passed
+ * to the functions below.  If huge_pages is true then large segments are
+ * backed by transparent huge pages, when enabled in pz_config.h and
+ * supported by the OS.  Returns NULL on failure.
+ */
+uint8_t *
+pz_segment_init(size_t size, bool huge_pages, size_t *mapping_size);
+
+/*
+ * Make the segment read-only once it has been written.
+ */
+bool
+pz_segment_protect(uint8_t *segment, size_t mapping_size);
+
+void
+pz_segment_free(uint8_t *segment, size_t mapping_size);
+
+#endif /* ! PZ_SEGMENT_H */
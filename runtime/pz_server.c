@@ -0,0 +1,225 @@
+/*
+ * Plasma persistent server
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "pz_common.h"
+
+#include "pz_api.h"
+#include "pz_server.h"
+
+#define LISTEN_BACKLOG 64
+
+static volatile sig_atomic_t stop_server = 0;
+
+static void
+handle_stop(int sig);
+
+static bool
+setup_signals(void);
+
+static int
+serve_socket(const PZ   *pz,
+             PZ_Context *context,
+             const char *socket_path,
+             bool        verbose);
+
+static void
+serve_requests(const PZ   *pz,
+               PZ_Context *context,
+               FILE       *requests,
+               int         out_fd);
+
+static void
+run_request(const PZ   *pz,
+            PZ_Context *context,
+            const char *name,
+            int         out_fd);
+
+int
+pz_server(const PZ   *pz,
+          PZ_Context *context,
+          const char *socket_path,
+          bool        verbose)
+{
+    if (socket_path != NULL) {
+        return serve_socket(pz, context, socket_path, verbose);
+    }
+
+    serve_requests(pz, context, stdin, STDOUT_FILENO);
+    return EXIT_SUCCESS;
+}
+
+int
+pz_server_listen(const char *socket_path)
+{
+    int                fd;
+    struct sockaddr_un addr;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: Socket path is too long\n", socket_path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (0 != bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        perror(socket_path);
+        close(fd);
+        return -1;
+    }
+    if (0 != listen(fd, LISTEN_BACKLOG)) {
+        perror(socket_path);
+        close(fd);
+        unlink(socket_path);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void
+handle_stop(int sig)
+{
+    stop_server = 1;
+}
+
+static bool
+setup_signals(void)
+{
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    // Not SA_RESTART, these signals must interrupt accept() and reads.
+    action.sa_flags = 0;
+
+    action.sa_handler = handle_stop;
+    if ((0 != sigaction(SIGINT, &action, NULL)) ||
+        (0 != sigaction(SIGTERM, &action, NULL)))
+    {
+        perror("sigaction");
+        return false;
+    }
+    // A client that disconnects early must not stop the server.
+    action.sa_handler = SIG_IGN;
+    if (0 != sigaction(SIGPIPE, &action, NULL)) {
+        perror("sigaction");
+        return false;
+    }
+
+    return true;
+}
+
+static int
+serve_socket(const PZ   *pz,
+             PZ_Context *context,
+             const char *socket_path,
+             bool        verbose)
+{
+    int listener;
+
+    if (!setup_signals()) return EXIT_FAILURE;
+
+    listener = pz_server_listen(socket_path);
+    if (listener < 0) return EXIT_FAILURE;
+    if (verbose) {
+        printf("Waiting for connections on %s\n", socket_path);
+        fflush(stdout);
+    }
+
+    while (!stop_server) {
+        int   connection;
+        FILE *requests;
+
+        connection = accept(listener, NULL, NULL);
+        if (connection < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+
+        requests = fdopen(connection, "r");
+        pz_context_set_output(context, connection);
+        serve_requests(pz, context, requests, connection);
+        pz_context_set_output(context, STDOUT_FILENO);
+        fclose(requests);
+        if (verbose) {
+            printf("Connection closed\n");
+            fflush(stdout);
+        }
+    }
+
+    close(listener);
+    unlink(socket_path);
+    return EXIT_SUCCESS;
+}
+
+static void
+serve_requests(const PZ   *pz,
+               PZ_Context *context,
+               FILE       *requests,
+               int         out_fd)
+{
+    char   *line = NULL;
+    size_t  line_size = 0;
+    ssize_t len;
+
+    while (!stop_server &&
+           ((len = getline(&line, &line_size, requests)) >= 0))
+    {
+        if ((len > 0) && (line[len - 1] == '\n')) {
+            line[len - 1] = 0;
+        }
+        run_request(pz, context, line, out_fd);
+    }
+
+    free(line);
+}
+
+static void
+run_request(const PZ   *pz,
+            PZ_Context *context,
+            const char *name,
+            int         out_fd)
+{
+    uint8_t *proc_code;
+    int      retcode;
+
+    if (name[0] == 0) {
+        proc_code = pz_get_entry_proc_code(pz);
+        if (proc_code == NULL) {
+            dprintf(out_fd, "%cerror: No entry procedure\n", 0);
+            return;
+        }
+    } else {
+        proc_code = pz_lookup_proc(pz, NULL, name);
+        if (proc_code == NULL) {
+            dprintf(out_fd, "%cerror: Procedure not found: %s\n", 0,
+                    name);
+            return;
+        }
+    }
+
+    retcode = pz_context_run(context, proc_code);
+    pz_context_reset(context);
+
+    dprintf(out_fd, "%c%d\n", 0, retcode);
+}
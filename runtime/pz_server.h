@@ -0,0 +1,44 @@
+/*
+ * Plasma persistent server
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#ifndef PZ_SERVER_H
+#define PZ_SERVER_H
+
+#include "pz.h"
+#include "pz_run.h"
+
+/*
+ * A persistent server loads the program once and then runs a procedure
+ * for each request it reads, all in the same process.  The context's heap
+ * is reset after each request, so nothing survives from one request to
+ * the next except what was there when the server started.
+ *
+ * Each request is a line holding the name of a procedure exported by the
+ * entry module, or an empty line for the entry procedure.  The response is
+ * the procedure's output followed by a NUL byte, then its result in
+ * decimal (or "error: " and a message) and a newline.
+ *
+ * If socket_path is NULL requests are read from standard input and
+ * responses written to standard output until the end of the input.
+ * Otherwise connections to the Unix socket are served one at a time until
+ * the server receives SIGINT or SIGTERM, it then removes the socket.
+ */
+int
+pz_server(const PZ   *pz,
+          PZ_Context *context,
+          const char *socket_path,
+          bool        verbose);
+
+/*
+ * Create a Unix socket at socket_path and listen on it, returns the file
+ * descriptor or -1 after printing an error.
+ */
+int
+pz_server_listen(const char *socket_path);
+
+#endif /* ! PZ_SERVER_H */
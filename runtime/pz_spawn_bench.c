@@ -0,0 +1,190 @@
+/*
+ * Spawn overhead benchmark
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ *
+ * This program measures the cost of the spawn and wait instructions by
+ * comparing a naive Fibonacci function with one that spawns one of its
+ * recursive calls at every level, so that almost every spawn is run
+ * immediately by the granularity cutoff.  Run it with "make bench".
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "pz_common.h"
+
+#include "pz_api.h"
+#include "pz_scheduler.h"
+
+#define FIB_INPUT 27
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * The benchmark doesn't depend on pzasm, so it builds its procedures in
+ * memory.  Both are (w - w) and return 1 for inputs below 2.  fib calls
+ * itself twice, pfib spawns its first recursive call and waits for it
+ * after making the second.
+ *
+ * Calls, spawns and jumps refer to addresses, so each procedure is written
+ * twice: first with proc NULL to find its size and where its base case
+ * begins, then into its own buffer at self.
+ */
+static unsigned
+make_fib_instrs(uint8_t *proc, uint8_t *self, bool spawn, unsigned *base)
+{
+    unsigned        offset = 0;
+    Immediate_Value imm = {.word = 0 };
+
+    imm.uint8 = 1;
+    offset = pz_write_instr(proc, offset, PZI_PICK, 0, 0, IMT_8, imm);
+    imm.uint32 = 2;
+    offset = pz_write_instr(proc, offset, PZI_LOAD_IMMEDIATE_NUM,
+                            PZW_FAST, 0, IMT_32, imm);
+    offset = pz_write_instr(proc, offset, PZI_LT_U, PZW_FAST, 0, IMT_NONE,
+                            imm);
+    imm.word = (uintptr_t)(self + *base);
+    offset = pz_write_instr(proc, offset, PZI_CJMP, PZW_FAST, 0,
+                            IMT_LABEL_REF, imm);
+
+    // n - n fib(n-1)
+    imm.uint8 = 1;
+    offset = pz_write_instr(proc, offset, PZI_PICK, 0, 0, IMT_8, imm);
+    imm.uint32 = 1;
+    offset = pz_write_instr(proc, offset, PZI_LOAD_IMMEDIATE_NUM,
+                            PZW_FAST, 0, IMT_32, imm);
+    offset = pz_write_instr(proc, offset, PZI_SUB, PZW_FAST, 0, IMT_NONE,
+                            imm);
+    imm.word = (uintptr_t)self;
+    offset = pz_write_instr(proc, offset, spawn ? PZI_SPAWN : PZI_CALL,
+                            0, 0, IMT_CODE_REF, imm);
+
+    // n fib(n-1) - fib(n-1) fib(n-2)
+    imm.uint8 = 2;
+    offset = pz_write_instr(proc, offset, PZI_ROLL, 0, 0, IMT_8, imm);
+    imm.uint32 = 2;
+    offset = pz_write_instr(proc, offset, PZI_LOAD_IMMEDIATE_NUM,
+                            PZW_FAST, 0, IMT_32, imm);
+    offset = pz_write_instr(proc, offset, PZI_SUB, PZW_FAST, 0, IMT_NONE,
+                            imm);
+    imm.word = (uintptr_t)self;
+    offset = pz_write_instr(proc, offset, PZI_CALL, 0, 0, IMT_CODE_REF,
+                            imm);
+
+    if (spawn) {
+        imm.uint8 = 2;
+        offset = pz_write_instr(proc, offset, PZI_ROLL, 0, 0, IMT_8, imm);
+        offset = pz_write_instr(proc, offset, PZI_WAIT, 0, 0, IMT_NONE,
+                                imm);
+    }
+    offset = pz_write_instr(proc, offset, PZI_ADD, PZW_FAST, 0, IMT_NONE,
+                            imm);
+    offset = pz_write_instr(proc, offset, PZI_RET, 0, 0, IMT_NONE, imm);
+
+    *base = offset;
+    offset = pz_write_instr(proc, offset, PZI_DROP, 0, 0, IMT_NONE, imm);
+    imm.uint32 = 1;
+    offset = pz_write_instr(proc, offset, PZI_LOAD_IMMEDIATE_NUM,
+                            PZW_FAST, 0, IMT_32, imm);
+    offset = pz_write_instr(proc, offset, PZI_RET, 0, 0, IMT_NONE, imm);
+
+    return offset;
+}
+
+static uint8_t *
+make_fib(bool spawn)
+{
+    unsigned  base = 0;
+    unsigned  size;
+    uint8_t  *proc;
+
+    size = make_fib_instrs(NULL, NULL, spawn, &base);
+    proc = malloc(size);
+    make_fib_instrs(proc, proc, spawn, &base);
+
+    return proc;
+}
+
+/*
+ * Run proc(FIB_INPUT) on a new context with the given number of workers,
+ * or without a scheduler if num_workers is 0.
+ */
+static double
+time_fib(uint8_t *proc, unsigned num_workers, int32_t *result)
+{
+    PZ_Context   *context;
+    PZ_Scheduler *sched = NULL;
+    double        start, time;
+
+    context = pz_context_init();
+    if (num_workers > 0) {
+        sched = pz_scheduler_init(num_workers);
+        pz_scheduler_attach(sched, context);
+    }
+
+    start = now();
+    pz_context_push_int(context, FIB_INPUT);
+    pz_context_call(context, proc);
+    *result = pz_context_pop_int(context);
+    time = now() - start;
+
+    if (sched != NULL) {
+        pz_scheduler_free(sched);
+    }
+    pz_context_free(context);
+
+    return time;
+}
+
+int
+main(int argc, char *const argv[])
+{
+    uint8_t  *fib = make_fib(false);
+    uint8_t  *pfib = make_fib(true);
+    unsigned  num_workers = pz_scheduler_default_workers();
+    unsigned  num_spawns;
+    double    fib_time, inline_time, one_time, par_time;
+    int32_t   expect, result;
+
+    // fib(n) returns the number of base cases it reaches, every other call
+    // makes a spawn in pfib.
+    fib_time = time_fib(fib, 0, &expect);
+    num_spawns = expect - 1;
+
+    inline_time = time_fib(pfib, 0, &result);
+    if (result != expect) goto wrong;
+    one_time = time_fib(pfib, 1, &result);
+    if (result != expect) goto wrong;
+    par_time = time_fib(pfib, num_workers, &result);
+    if (result != expect) goto wrong;
+
+    printf("fib(%d), %u spawns\n", FIB_INPUT, num_spawns);
+    printf("Calls only:               %6.1fms\n", fib_time * 1e3);
+    printf("Spawns, no scheduler:     %6.1fms (%+.1fns per spawn)\n",
+           inline_time * 1e3,
+           (inline_time - fib_time) * 1e9 / num_spawns);
+    printf("Spawns, 1 worker:         %6.1fms (%+.1fns per spawn)\n",
+           one_time * 1e3, (one_time - fib_time) * 1e9 / num_spawns);
+    printf("Spawns, %u workers:        %6.1fms\n", num_workers,
+           par_time * 1e3);
+
+    free(fib);
+    free(pfib);
+    return EXIT_SUCCESS;
+
+wrong:
+    fprintf(stderr, "pfib(%d) returned %d, expected %d\n", FIB_INPUT,
+            (int)result, (int)expect);
+    return EXIT_FAILURE;
+}
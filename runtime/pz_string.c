@@ -0,0 +1,541 @@
+/*
+ * Plasma strings
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pz_common.h"
+
+#include "pz_bytes.h"
+#include "pz_format.h"
+#include "pz_string.h"
+
+#define ROPE_TAG ((uintptr_t)1)
+
+#define IS_ROPE(s)  (((uintptr_t)(s) & ROPE_TAG) != 0)
+#define ROPE(s)     ((Rope *)((uintptr_t)(s) & ~ROPE_TAG))
+
+typedef struct {
+    size_t      length;
+    void       *left;
+    void       *right;
+    /*
+     * NULL until the rope is flattened.  It's read and written with
+     * atomics because tasks that share the rope may flatten it at the
+     * same time, each makes a copy and either may be kept.
+     */
+    PZ_String  *flat;
+} Rope;
+
+static void
+copy_rope(char *buffer, Rope *rope);
+
+static void
+init_strings(void);
+
+static uint32_t
+hash_bytes(const char *bytes, size_t length);
+
+static void
+check_length(size_t length);
+
+static void
+intern_grow(void);
+
+/*
+ * The two digit decimal numbers, so that integers can be formatted two
+ * digits at a time.
+ */
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+#define NUM_SMALL_INTS \
+    (PZ_SMALL_INT_STRING_MAX - PZ_SMALL_INT_STRING_MIN + 1)
+
+/*
+ * The strings for small Ints, they're interned.
+ */
+static PZ_String      *small_ints[NUM_SMALL_INTS];
+static pthread_once_t  strings_once = PTHREAD_ONCE_INIT;
+
+/*
+ * The interned strings, an open addressing hash table that's at most half
+ * full.  Each slot holds its string's hash so that most probes that don't
+ * match don't need to compare bytes.  It's shared by every thread and
+ * protected by intern_lock.
+ */
+typedef struct {
+    uint32_t   hash;
+    PZ_String *string;
+} Intern_Slot;
+
+static pthread_mutex_t  intern_lock = PTHREAD_MUTEX_INITIALIZER;
+static Intern_Slot     *intern_slots = NULL;
+static unsigned         intern_num_slots = 0;
+static unsigned         intern_num_strings = 0;
+
+void
+pz_string_init(void)
+{
+    pthread_once(&strings_once, init_strings);
+}
+
+static void
+init_strings(void)
+{
+    pz_bytes_init();
+
+    for (int32_t num = PZ_SMALL_INT_STRING_MIN;
+            num <= PZ_SMALL_INT_STRING_MAX; num++)
+    {
+        char     buffer[PZ_INT_STRING_MAX];
+        unsigned len;
+
+        len = pz_string_format_int(buffer + PZ_INT_STRING_MAX, num);
+        small_ints[num - PZ_SMALL_INT_STRING_MIN] = pz_string_intern_bytes(
+                buffer + PZ_INT_STRING_MAX - len, len);
+    }
+}
+
+PZ_String *
+pz_string_alloc(PZ_Heap *heap, size_t length)
+{
+    PZ_String *string;
+
+    check_length(length);
+    string = pz_heap_alloc(heap, PZ_STRING_SIZE(length));
+    string->length = length;
+    string->flags = 0;
+    string->bytes[length] = 0;
+    return string;
+}
+
+PZ_String *
+pz_string_new(PZ_Heap *heap, const char *bytes, size_t length)
+{
+    PZ_String *string = pz_string_alloc(heap, length);
+
+    memcpy(string->bytes, bytes, length);
+    return string;
+}
+
+unsigned
+pz_string_format_int(char *end, int32_t num)
+{
+    // The magnitude is unsigned so that negating INT32_MIN can't overflow.
+    uint32_t value = num < 0 ? -(uint32_t)num : (uint32_t)num;
+    char    *p = end;
+
+    while (value >= 100) {
+        const char *pair = &digit_pairs[(value % 100) * 2];
+
+        value /= 100;
+        p -= 2;
+        p[0] = pair[0];
+        p[1] = pair[1];
+    }
+    if (value >= 10) {
+        p -= 2;
+        p[0] = digit_pairs[value * 2];
+        p[1] = digit_pairs[value * 2 + 1];
+    } else {
+        *--p = '0' + value;
+    }
+    if (num < 0) {
+        *--p = '-';
+    }
+
+    return end - p;
+}
+
+PZ_String *
+pz_string_from_int(PZ_Heap *heap, int32_t num)
+{
+    char     buffer[PZ_INT_STRING_MAX];
+    unsigned len;
+
+    if ((num >= PZ_SMALL_INT_STRING_MIN) &&
+        (num <= PZ_SMALL_INT_STRING_MAX))
+    {
+        return small_ints[num - PZ_SMALL_INT_STRING_MIN];
+    }
+
+    len = pz_string_format_int(buffer + PZ_INT_STRING_MAX, num);
+    return pz_string_new(heap, buffer + PZ_INT_STRING_MAX - len, len);
+}
+
+void *
+pz_string_concat(PZ_Heap *heap, void *s1, void *s2)
+{
+    size_t  len1 = pz_string_length(s1);
+    size_t  len2 = pz_string_length(s2);
+    Rope   *rope;
+
+    if (len1 == 0) return s2;
+    if (len2 == 0) return s1;
+    // Both lengths are at most PZ_STRING_MAX_LENGTH, so this can't wrap.
+    check_length(len1 + len2);
+
+    if (len1 + len2 <= PZ_STRING_FLAT_MAX) {
+        // A short string is cheaper to copy than to make into a rope.
+        PZ_String *string = pz_string_alloc(heap, len1 + len2);
+
+        memcpy(string->bytes, pz_string_flatten(heap, s1), len1);
+        memcpy(string->bytes + len1, pz_string_flatten(heap, s2), len2);
+        return string;
+    }
+
+    rope = pz_heap_alloc(heap, sizeof(Rope));
+    rope->length = len1 + len2;
+    rope->left = s1;
+    rope->right = s2;
+    rope->flat = NULL;
+
+    return (void *)((uintptr_t)rope | ROPE_TAG);
+}
+
+size_t
+pz_string_length(void *string)
+{
+    if (IS_ROPE(string)) {
+        return ROPE(string)->length;
+    } else {
+        return ((PZ_String *)string)->length;
+    }
+}
+
+const char *
+pz_string_flatten(PZ_Heap *heap, void *string)
+{
+    Rope      *rope;
+    PZ_String *flat;
+
+    if (!IS_ROPE(string)) {
+        return ((PZ_String *)string)->bytes;
+    }
+
+    rope = ROPE(string);
+    flat = __atomic_load_n(&rope->flat, __ATOMIC_ACQUIRE);
+    if (flat != NULL) {
+        return flat->bytes;
+    }
+
+    flat = pz_string_alloc(heap, rope->length);
+    copy_rope(flat->bytes, rope);
+    __atomic_store_n(&rope->flat, flat, __ATOMIC_RELEASE);
+
+    return flat->bytes;
+}
+
+/*
+ * Copy the rope's pieces into the buffer from the end backwards, using a
+ * stack of the pieces still to copy.  A rope built by appending is deep
+ * on the left and only needs a couple of entries, one built by prepending
+ * needs an entry for each piece.
+ */
+static void
+copy_rope(char *buffer, Rope *rope)
+{
+    size_t   pos = rope->length;
+    unsigned stack_size = 16;
+    unsigned sp = 0;
+    void   **stack = malloc(sizeof(void *) * stack_size);
+
+    stack[sp++] = rope->left;
+    stack[sp++] = rope->right;
+    while (sp > 0) {
+        void      *piece = stack[--sp];
+        PZ_String *flat;
+
+        if (IS_ROPE(piece)) {
+            Rope *piece_rope = ROPE(piece);
+
+            flat = __atomic_load_n(&piece_rope->flat, __ATOMIC_ACQUIRE);
+            if (flat == NULL) {
+                if (sp + 2 > stack_size) {
+                    stack_size *= 2;
+                    stack = realloc(stack, sizeof(void *) * stack_size);
+                }
+                stack[sp++] = piece_rope->left;
+                stack[sp++] = piece_rope->right;
+                continue;
+            }
+        } else {
+            flat = piece;
+        }
+        pos -= flat->length;
+        memcpy(buffer + pos, flat->bytes, flat->length);
+    }
+
+    free(stack);
+}
+
+int
+pz_string_compare(PZ_Heap *heap, void *s1, void *s2)
+{
+    size_t len1 = pz_string_length(s1);
+    size_t len2 = pz_string_length(s2);
+    int    result;
+
+    result = memcmp(pz_string_flatten(heap, s1), pz_string_flatten(heap, s2),
+                    len1 < len2 ? len1 : len2);
+    if (result != 0) {
+        return result;
+    }
+    return len1 < len2 ? -1 : (len1 > len2 ? 1 : 0);
+}
+
+bool
+pz_string_starts_with(PZ_Heap *heap, void *string, void *prefix)
+{
+    size_t len = pz_string_length(prefix);
+
+    return (len <= pz_string_length(string)) &&
+        (0 == memcmp(pz_string_flatten(heap, string),
+                     pz_string_flatten(heap, prefix), len));
+}
+
+/*
+ * Scan for the first byte of sub and compare the rest wherever it's found.
+ */
+int32_t
+pz_string_find(PZ_Heap *heap, void *string, void *sub)
+{
+    const char *bytes = pz_string_flatten(heap, string);
+    const char *sub_bytes = pz_string_flatten(heap, sub);
+    size_t      len = pz_string_length(string);
+    size_t      sub_len = pz_string_length(sub);
+    const char *pos = bytes;
+    const char *last;
+
+    if (sub_len == 0) return 0;
+    if (sub_len > len) return -1;
+
+    last = bytes + len - sub_len;
+    while (pos <= last) {
+        pos = pz_bytes_find(pos, last - pos + 1, sub_bytes[0]);
+        if (pos == NULL) {
+            return -1;
+        }
+        if (0 == memcmp(pos + 1, sub_bytes + 1, sub_len - 1)) {
+            return pos - bytes;
+        }
+        pos++;
+    }
+    return -1;
+}
+
+bool
+pz_string_split(PZ_Heap *heap, void *string, void *sep, void **before,
+                void **after)
+{
+    int32_t     pos = pz_string_find(heap, string, sep);
+    const char *bytes;
+    size_t      end;
+
+    if (pos < 0) {
+        *before = string;
+        *after = pz_string_alloc(heap, 0);
+        return false;
+    }
+
+    bytes = pz_string_flatten(heap, string);
+    end = pos + pz_string_length(sep);
+    *before = pz_string_new(heap, bytes, pos);
+    *after = pz_string_new(heap, bytes + end,
+                           pz_string_length(string) - end);
+    return true;
+}
+
+size_t
+pz_string_count_byte(PZ_Heap *heap, void *string, uint8_t byte)
+{
+    return pz_bytes_count(pz_string_flatten(heap, string),
+                          pz_string_length(string), byte);
+}
+
+/*
+ * Skip runs of ASCII with pz_bytes_ascii_prefix() and check each
+ * multi-byte sequence.  The range of a sequence's second byte depends on
+ * its first byte, this rules out overlong encodings, surrogates and code
+ * points that are too large.
+ */
+bool
+pz_string_is_utf8(PZ_Heap *heap, void *string)
+{
+    const uint8_t *bytes = (const uint8_t *)pz_string_flatten(heap, string);
+    size_t         len = pz_string_length(string);
+    size_t         i = 0;
+
+    while (true) {
+        uint8_t  lead;
+        unsigned num_cont;
+        uint8_t  min = 0x80, max = 0xBF;
+
+        i += pz_bytes_ascii_prefix((const char *)bytes + i, len - i);
+        if (i == len) {
+            return true;
+        }
+
+        lead = bytes[i];
+        if ((lead >= 0xC2) && (lead <= 0xDF)) {
+            num_cont = 1;
+        } else if ((lead >= 0xE0) && (lead <= 0xEF)) {
+            num_cont = 2;
+            if (lead == 0xE0) min = 0xA0;
+            if (lead == 0xED) max = 0x9F;
+        } else if ((lead >= 0xF0) && (lead <= 0xF4)) {
+            num_cont = 3;
+            if (lead == 0xF0) min = 0x90;
+            if (lead == 0xF4) max = 0x8F;
+        } else {
+            return false;
+        }
+
+        if (len - i <= num_cont) return false;
+        if ((bytes[i + 1] < min) || (bytes[i + 1] > max)) return false;
+        for (unsigned j = 2; j <= num_cont; j++) {
+            if ((bytes[i + j] & 0xC0) != 0x80) return false;
+        }
+        i += num_cont + 1;
+    }
+}
+
+PZ_String *
+pz_string_intern_bytes(const char *bytes, size_t length)
+{
+    uint32_t   hash = hash_bytes(bytes, length);
+    unsigned   mask;
+    unsigned   i;
+    PZ_String *string;
+
+    check_length(length);
+    pthread_mutex_lock(&intern_lock);
+    if ((intern_num_strings + 1) * 2 > intern_num_slots) {
+        intern_grow();
+    }
+
+    mask = intern_num_slots - 1;
+    for (i = hash & mask; intern_slots[i].string != NULL; i = (i + 1) & mask)
+    {
+        string = intern_slots[i].string;
+        if ((intern_slots[i].hash == hash) && (string->length == length) &&
+            (0 == memcmp(string->bytes, bytes, length)))
+        {
+            pthread_mutex_unlock(&intern_lock);
+            return string;
+        }
+    }
+
+    string = malloc(PZ_STRING_SIZE(length));
+    string->length = length;
+    string->flags = PZ_STRING_INTERNED;
+    memcpy(string->bytes, bytes, length);
+    string->bytes[length] = 0;
+
+    intern_slots[i].hash = hash;
+    intern_slots[i].string = string;
+    intern_num_strings++;
+    pthread_mutex_unlock(&intern_lock);
+
+    return string;
+}
+
+PZ_String *
+pz_string_intern(PZ_Heap *heap, void *string)
+{
+    if (!IS_ROPE(string) &&
+        (((PZ_String *)string)->flags & PZ_STRING_INTERNED))
+    {
+        return string;
+    }
+
+    return pz_string_intern_bytes(pz_string_flatten(heap, string),
+                                  pz_string_length(string));
+}
+
+bool
+pz_string_equals(PZ_Heap *heap, void *s1, void *s2)
+{
+    size_t len;
+
+    if (s1 == s2) return true;
+    if (!IS_ROPE(s1) && !IS_ROPE(s2) &&
+        (((PZ_String *)s1)->flags & ((PZ_String *)s2)->flags &
+            PZ_STRING_INTERNED))
+    {
+        return false;
+    }
+
+    len = pz_string_length(s1);
+    return (len == pz_string_length(s2)) &&
+        (0 == memcmp(pz_string_flatten(heap, s1),
+                     pz_string_flatten(heap, s2), len));
+}
+
+/*
+ * 32bit FNV-1a, as used by pz_hash_table.c.
+ */
+static uint32_t
+hash_bytes(const char *bytes, size_t length)
+{
+    uint32_t hash = PZ_HASH_INIT;
+
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)bytes[i]) * PZ_HASH_PRIME;
+    }
+    return hash;
+}
+
+static void
+check_length(size_t length)
+{
+    if (length > PZ_STRING_MAX_LENGTH) {
+        fprintf(stderr, "String too long\n");
+        abort();
+    }
+}
+
+/*
+ * Double the size of the intern table, the caller holds intern_lock.
+ */
+static void
+intern_grow(void)
+{
+    Intern_Slot *old_slots = intern_slots;
+    unsigned     old_num_slots = intern_num_slots;
+    unsigned     mask;
+
+    intern_num_slots = old_num_slots > 0 ? old_num_slots * 2 : 256;
+    intern_slots = malloc(sizeof(Intern_Slot) * intern_num_slots);
+    memset(intern_slots, 0, sizeof(Intern_Slot) * intern_num_slots);
+    mask = intern_num_slots - 1;
+
+    for (unsigned j = 0; j < old_num_slots; j++) {
+        unsigned i;
+
+        if (old_slots[j].string == NULL) continue;
+        i = old_slots[j].hash & mask;
+        while (intern_slots[i].string != NULL) {
+            i = (i + 1) & mask;
+        }
+        intern_slots[i] = old_slots[j];
+    }
+
+    free(old_slots);
+}
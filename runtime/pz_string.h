@@ -0,0 +1,178 @@
+/*
+ * Plasma strings
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ */
+
+#ifndef PZ_STRING_H
+#define PZ_STRING_H
+
+#include "pz_heap.h"
+
+/*
+ * A Plasma string is either a pointer to a PZ_String, such as a string
+ * literal in a module's data, or a rope: a pointer, with its low bit set,
+ * to a node that is the concatenation of two other strings.
+ * Concatenation makes a node without copying either string, so building a
+ * string piece by piece takes time in proportion to its length.
+ *
+ * Both kinds of string know their length, so finding it never needs to
+ * scan the bytes.  A rope is flattened into contiguous bytes when
+ * something needs them, such as print.  The flat copy is kept in the node
+ * so that a rope is only flattened once.
+ *
+ * Strings don't change once they're made, and tasks may share them.
+ */
+
+/*
+ * The bytes are followed by a NUL byte that isn't counted in the length,
+ * so that they can be given to C functions.
+ *
+ * An interned string is the only interned string with its bytes, so two
+ * interned strings are equal only if they're the same string.  Interned
+ * strings are shared by every context and never freed.  Strings in a
+ * module's data are interned when it's loaded (see PZ_DATA_STRING in
+ * pz_format.h), as are the strings for small Ints, other strings are
+ * interned by the intern builtin.
+ */
+typedef struct {
+    uint32_t length;
+    uint32_t flags;
+    char     bytes[];
+} PZ_String;
+
+#define PZ_STRING_INTERNED 0x1
+
+#define PZ_STRING_SIZE(length) (sizeof(PZ_String) + (length) + 1)
+
+/*
+ * The longest a string can be.  Positions in strings are returned as Ints,
+ * so a longer string couldn't be searched, making one aborts the program
+ * as running out of memory does.
+ */
+#define PZ_STRING_MAX_LENGTH ((size_t)INT32_MAX)
+
+/*
+ * The longest an Int can be as a string: "-2147483648".
+ */
+#define PZ_INT_STRING_MAX 11
+
+/*
+ * Make the interned strings for small Ints and choose the byte scanning
+ * code for the CPU (see pz_bytes.h).  This is called by pz_context_init()
+ * and may be called more than once.
+ */
+void
+pz_string_init(void);
+
+/*
+ * Allocate a string with room for length bytes and the NUL byte, the
+ * caller fills in the bytes.
+ */
+PZ_String *
+pz_string_alloc(PZ_Heap *heap, size_t length);
+
+/*
+ * Make a string on the heap from a copy of length bytes.
+ */
+PZ_String *
+pz_string_new(PZ_Heap *heap, const char *bytes, size_t length);
+
+/*
+ * Write the decimal digits of num, and a sign if it's negative, so that
+ * they end just before end, and return how many bytes they take.  At most
+ * PZ_INT_STRING_MAX bytes are written.
+ */
+unsigned
+pz_string_format_int(char *end, int32_t num);
+
+/*
+ * Return num as a string, this only allocates if num is outside the range
+ * of the small Int table.
+ */
+PZ_String *
+pz_string_from_int(PZ_Heap *heap, int32_t num);
+
+/*
+ * Concatenate two strings, making a rope on the heap.
+ */
+void *
+pz_string_concat(PZ_Heap *heap, void *s1, void *s2);
+
+size_t
+pz_string_length(void *string);
+
+/*
+ * Return the string's bytes followed by a NUL byte, allocating them on the
+ * heap if it's a rope that hasn't been flattened yet.
+ */
+const char *
+pz_string_flatten(PZ_Heap *heap, void *string);
+
+/*
+ * Return the interned string with these bytes, adding a copy of them to
+ * the table if there isn't one.  This may be called before
+ * pz_string_init().
+ */
+PZ_String *
+pz_string_intern_bytes(const char *bytes, size_t length);
+
+/*
+ * Return the interned string equal to this string.
+ */
+PZ_String *
+pz_string_intern(PZ_Heap *heap, void *string);
+
+/*
+ * Whether the strings have the same bytes.  This doesn't look at the
+ * bytes if both strings are interned.
+ */
+bool
+pz_string_equals(PZ_Heap *heap, void *s1, void *s2);
+
+/*
+ * The operations below flatten their arguments if they're ropes.
+ * Positions and lengths are in bytes.
+ */
+
+/*
+ * Compare the strings' bytes, returning a negative number, zero or a
+ * positive number if s1 sorts before, the same as or after s2.
+ */
+int
+pz_string_compare(PZ_Heap *heap, void *s1, void *s2);
+
+bool
+pz_string_starts_with(PZ_Heap *heap, void *string, void *prefix);
+
+/*
+ * The position of the first occurrence of sub in string, or -1.
+ */
+int32_t
+pz_string_find(PZ_Heap *heap, void *string, void *sub);
+
+/*
+ * Split the string at the first occurrence of sep, setting before and
+ * after to the parts before and after it.  If sep doesn't occur then
+ * before is the whole string, after is empty and false is returned.
+ */
+bool
+pz_string_split(PZ_Heap *heap, void *string, void *sep, void **before,
+                void **after);
+
+/*
+ * The number of bytes in the string equal to byte.
+ */
+size_t
+pz_string_count_byte(PZ_Heap *heap, void *string, uint8_t byte);
+
+/*
+ * Whether the string is valid UTF-8.  Overlong encodings, surrogates and
+ * code points above U+10FFFF are invalid.
+ */
+bool
+pz_string_is_utf8(PZ_Heap *heap, void *string);
+
+#endif /* ! PZ_STRING_H */
@@ -0,0 +1,184 @@
+/*
+ * Symbol table benchmark
+ * vim: ts=4 sw=4 et
+ *
+ * Copyright (C) 2018 Plasma Team
+ * Distributed under the terms of the MIT license, see ../LICENSE.code
+ *
+ * This program compares the data structures that have been used for
+ * symbol lookup: pz_radix_tree and pz_hash_table.  Run it with "make
+ * bench".
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "pz_common.h"
+
+#include "pz_hash_table.h"
+#include "pz_radix_tree.h"
+
+#define NUM_ROUNDS 20
+
+typedef struct {
+    const char *name;
+    void *    (*init)(void);
+    void      (*free)(void *table);
+    void      (*insert)(void *table, const char *key, void *value);
+    void *    (*lookup)(void *table, const char *key);
+} Table_Ops;
+
+static void *
+radix_init(void)
+{
+    return pz_radix_init();
+}
+
+static void
+radix_free(void *table)
+{
+    pz_radix_free(table, NULL);
+}
+
+static void
+radix_insert(void *table, const char *key, void *value)
+{
+    pz_radix_insert(table, key, value);
+}
+
+static void *
+radix_lookup(void *table, const char *key)
+{
+    return pz_radix_lookup(table, key);
+}
+
+static void *
+hash_init(void)
+{
+    return pz_hash_init();
+}
+
+static void
+hash_free(void *table)
+{
+    pz_hash_free(table, NULL);
+}
+
+static void
+hash_insert(void *table, const char *key, void *value)
+{
+    pz_hash_insert(table, key, value);
+}
+
+static void *
+hash_lookup(void *table, const char *key)
+{
+    return pz_hash_lookup(table, key);
+}
+
+static const Table_Ops tables[] = {
+    { "radix tree", radix_init, radix_free, radix_insert, radix_lookup },
+    { "hash table", hash_init, hash_free, hash_insert, hash_lookup },
+};
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Symbol names look like those of real programs, they share long
+ * prefixes.  Keys that are missing from the tables differ only by their
+ * suffix.
+ */
+static char **
+make_keys(unsigned num_keys, const char *suffix)
+{
+    char   **keys = malloc(sizeof(char *) * num_keys);
+    char     buffer[64];
+
+    for (unsigned i = 0; i < num_keys; i++) {
+        snprintf(buffer, sizeof(buffer), "proc_%u_%s%s", i,
+                 (i % 2) ? "loop" : "helper", suffix);
+        keys[i] = strdup(buffer);
+    }
+
+    return keys;
+}
+
+static void
+free_keys(char **keys, unsigned num_keys)
+{
+    for (unsigned i = 0; i < num_keys; i++) {
+        free(keys[i]);
+    }
+    free(keys);
+}
+
+static void
+bench(const Table_Ops *ops, unsigned num_keys)
+{
+    char   **keys = make_keys(num_keys, "");
+    char   **missing = make_keys(num_keys, "2");
+    double   insert_time = 0, hit_time = 0, miss_time = 0;
+    unsigned found = 0;
+
+    for (unsigned round = 0; round < NUM_ROUNDS; round++) {
+        void  *table;
+        double start;
+
+        start = now();
+        table = ops->init();
+        for (unsigned i = 0; i < num_keys; i++) {
+            ops->insert(table, keys[i], keys[i]);
+        }
+        insert_time += now() - start;
+
+        start = now();
+        for (unsigned i = 0; i < num_keys; i++) {
+            found += ops->lookup(table, keys[i]) == keys[i];
+        }
+        hit_time += now() - start;
+
+        start = now();
+        for (unsigned i = 0; i < num_keys; i++) {
+            found += ops->lookup(table, missing[i]) != NULL;
+        }
+        miss_time += now() - start;
+
+        ops->free(table);
+    }
+
+    if (found != num_keys * NUM_ROUNDS) {
+        fprintf(stderr, "%s returned wrong results\n", ops->name);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%-10s %7u keys: insert %6.1fns, hit %6.1fns, miss %6.1fns\n",
+           ops->name, num_keys,
+           insert_time * 1e9 / (num_keys * NUM_ROUNDS),
+           hit_time * 1e9 / (num_keys * NUM_ROUNDS),
+           miss_time * 1e9 / (num_keys * NUM_ROUNDS));
+
+    free_keys(keys, num_keys);
+    free_keys(missing, num_keys);
+}
+
+int
+main(int argc, char *const argv[])
+{
+    static const unsigned sizes[] = { 16, 256, 4096, 65536 };
+
+    for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (unsigned t = 0; t < sizeof(tables) / sizeof(tables[0]); t++) {
+            bench(&tables[t], sizes[s]);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
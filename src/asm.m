@@ -15,11 +15,16 @@
 :- import_module asm_ast.
 :- import_module asm_error.
 :- import_module pz.
+:- import_module q_name.
 :- import_module result.
 
 %-----------------------------------------------------------------------%
 
-:- pred assemble(asm::in, result(pz, asm_error)::out) is det.
+    % assemble(ModuleName, PZT, MaybePZ)
+    %
+    % All the procedures defined by the module are exported.
+    %
+:- pred assemble(q_name::in, asm::in, result(pz, asm_error)::out) is det.
 
 %-----------------------------------------------------------------------%
 %-----------------------------------------------------------------------%
@@ -37,14 +42,13 @@
 :- import_module context.
 :- import_module common_types.
 :- import_module pz.code.
-:- import_module q_name.
 :- import_module util.
 
 %-----------------------------------------------------------------------%
 
-assemble(PZT, MaybePZ) :-
+assemble(ModuleName, PZT, MaybePZ) :-
     some [!PZ] (
-        !:PZ = init_pz,
+        !:PZ = init_pz(ModuleName),
         Entries = PZT ^ asm_entries,
         foldl3(prepare_map, Entries, init, SymbolMap, init, StructMap, !PZ),
         foldl(build_entries(SymbolMap, StructMap), Entries, !PZ),
@@ -70,6 +74,7 @@ prepare_map(Entry, !SymMap, !StructMap, !PZ) :-
     (
         ( Type = asm_proc(_, _),
             pz_new_proc_id(i_local, PID, !PZ),
+            pz_export_proc(PID, !PZ),
             ID = pzei_proc(PID)
         ; Type = asm_proc_decl(_),
             pz_new_proc_id(i_imported, PID, !PZ),
@@ -227,6 +232,7 @@ build_instruction(Map, BlockMap, StructMap, Context, PInstr, Width1, Width2,
     ;
         ( PInstr = pzti_call(QName)
         ; PInstr = pzti_tcall(QName)
+        ; PInstr = pzti_spawn(QName)
         ),
         ( if
             search(Map, QName, Entry),
@@ -236,6 +242,8 @@ build_instruction(Map, BlockMap, StructMap, Context, PInstr, Width1, Width2,
                 MaybeInstr = ok(pzi_call(PID))
             ; PInstr = pzti_tcall(_),
                 MaybeInstr = ok(pzi_tcall(PID))
+            ; PInstr = pzti_spawn(_),
+                MaybeInstr = ok(pzi_spawn(PID, Width1))
             )
         else
             MaybeInstr = return_error(Context, e_symbol_not_found(QName))
@@ -300,6 +308,7 @@ builtin_instr("eq",         W1, _,  pzi_eq(W1)).
 builtin_instr("not",        W1, _,  pzi_not(W1)).
 builtin_instr("ret",        _,  _,  pzi_ret).
 builtin_instr("call_ind",   _,  _,  pzi_call_ind).
+builtin_instr("wait",       W1, _,  pzi_wait(W1)).
 
 %-----------------------------------------------------------------------%
 %-----------------------------------------------------------------------%
@@ -96,6 +96,7 @@
             % easier when we introduce tail calls.
     ;       pzti_call(q_name)
     ;       pzti_tcall(q_name)
+    ;       pzti_spawn(q_name)
 
             % These instructions are handled specifically because the have
             % immediate values.
@@ -348,6 +348,17 @@ setup_misc_builtins(BoolType, BoolTrue, BoolFalse, !Map, !Core) :-
             [builtin_type(string)], [], set([RIO]), init),
         _, !Map, !Core),
 
+    FlushName = q_name_snoc(builtin_module_name, "flush"),
+    register_builtin_func(q_name("flush"),
+        func_init_builtin_rts(FlushName, [], [], set([RIO]), init),
+        _, !Map, !Core),
+
+    PrintIntName = q_name_snoc(builtin_module_name, "print_int"),
+    register_builtin_func(q_name("print_int"),
+        func_init_builtin_rts(PrintIntName,
+            [builtin_type(int)], [], set([RIO]), init),
+        _, !Map, !Core),
+
     IntToStringName = q_name_snoc(builtin_module_name, "int_to_string"),
     register_builtin_func(q_name("int_to_string"),
         func_init_builtin_rts(IntToStringName,
@@ -400,6 +411,163 @@ setup_misc_builtins(BoolType, BoolTrue, BoolFalse, !Map, !Core) :-
     DieName = q_name_snoc(builtin_module_name, "die"),
     register_builtin_func(DieName,
         func_init_builtin_rts(DieName, [builtin_type(string)], [], init, init),
+        _, !Map, !Core),
+
+    setup_channel_builtins(BoolType, RIO, !Map, !Core),
+    setup_array_builtins(!Map, !Core),
+    setup_string_builtins(BoolType, !Map, !Core).
+
+    % Channels pass Ints between tasks, recv blocks until there is one to
+    % receive and send blocks while the channel is full.  The Channel type
+    % is a builtin_type, the Channel resource is for the operations on
+    % channels.
+    %
+:- pred setup_channel_builtins(type_id::in, resource_id::in,
+    map(q_name, builtin_item)::in, map(q_name, builtin_item)::out,
+    core::in, core::out) is det.
+
+setup_channel_builtins(BoolType, RIO, !Map, !Core) :-
+    ChannelName = q_name("Channel"),
+    register_builtin_resource(ChannelName, r_other(ChannelName, RIO),
+        RChannel, !Map, !Core),
+
+    NewChannelName = q_name_snoc(builtin_module_name, "new_channel"),
+    register_builtin_func(q_name("new_channel"),
+        func_init_builtin_rts(NewChannelName,
+            [builtin_type(int)], [builtin_type(channel)],
+            set([RChannel]), init),
+        _, !Map, !Core),
+
+    NewSPSCChannelName = q_name_snoc(builtin_module_name,
+        "new_spsc_channel"),
+    register_builtin_func(q_name("new_spsc_channel"),
+        func_init_builtin_rts(NewSPSCChannelName,
+            [builtin_type(int)], [builtin_type(channel)],
+            set([RChannel]), init),
+        _, !Map, !Core),
+
+    SendName = q_name_snoc(builtin_module_name, "send"),
+    register_builtin_func(q_name("send"),
+        func_init_builtin_rts(SendName,
+            [builtin_type(channel), builtin_type(int)], [],
+            set([RChannel]), init),
+        _, !Map, !Core),
+
+    RecvName = q_name_snoc(builtin_module_name, "recv"),
+    register_builtin_func(q_name("recv"),
+        func_init_builtin_rts(RecvName,
+            [builtin_type(channel)], [builtin_type(int)],
+            set([RChannel]), init),
+        _, !Map, !Core),
+
+    TryRecvName = q_name_snoc(builtin_module_name, "try_recv"),
+    register_builtin_func(q_name("try_recv"),
+        func_init_builtin_rts(TryRecvName,
+            [builtin_type(channel)],
+            [type_ref(BoolType, []), builtin_type(int)],
+            set([RChannel]), init),
+        _, !Map, !Core).
+
+    % Arrays of Ints are made by array_range, which returns the array
+    % [0, 1, ..., n-1].  parallel_map and parallel_reduce split an array
+    % into chunks that are run as tasks.  Their function arguments use no
+    % resources, so the tasks may run in any order: parallel_reduce's
+    % function must be associative and its initial value must be an
+    % identity of the function.  It reduces each chunk from its first
+    % element and then folds the initial value and the chunks' results
+    % together in order.
+    %
+:- pred setup_array_builtins(
+    map(q_name, builtin_item)::in, map(q_name, builtin_item)::out,
+    core::in, core::out) is det.
+
+setup_array_builtins(!Map, !Core) :-
+    ArrayRangeName = q_name_snoc(builtin_module_name, "array_range"),
+    register_builtin_func(q_name("array_range"),
+        func_init_builtin_rts(ArrayRangeName,
+            [builtin_type(int)], [builtin_type(array)], init, init),
+        _, !Map, !Core),
+
+    ArraySizeName = q_name_snoc(builtin_module_name, "array_size"),
+    register_builtin_func(q_name("array_size"),
+        func_init_builtin_rts(ArraySizeName,
+            [builtin_type(array)], [builtin_type(int)], init, init),
+        _, !Map, !Core),
+
+    ArrayGetName = q_name_snoc(builtin_module_name, "array_get"),
+    register_builtin_func(q_name("array_get"),
+        func_init_builtin_rts(ArrayGetName,
+            [builtin_type(array), builtin_type(int)], [builtin_type(int)],
+            init, init),
+        _, !Map, !Core),
+
+    MapFuncType = func_type([builtin_type(int)], [builtin_type(int)],
+        init, init),
+    ParallelMapName = q_name_snoc(builtin_module_name, "parallel_map"),
+    register_builtin_func(q_name("parallel_map"),
+        func_init_builtin_rts(ParallelMapName,
+            [MapFuncType, builtin_type(array)], [builtin_type(array)],
+            init, init),
+        _, !Map, !Core),
+
+    ReduceFuncType = func_type([builtin_type(int), builtin_type(int)],
+        [builtin_type(int)], init, init),
+    ParallelReduceName = q_name_snoc(builtin_module_name,
+        "parallel_reduce"),
+    register_builtin_func(q_name("parallel_reduce"),
+        func_init_builtin_rts(ParallelReduceName,
+            [ReduceFuncType, builtin_type(array), builtin_type(int)],
+            [builtin_type(int)], init, init),
+        _, !Map, !Core).
+
+    % String operations work on bytes, positions and lengths are in bytes.
+    % intern returns the interned string equal to its argument, there's
+    % only one interned string with any given bytes so string_equals
+    % compares two interned strings without looking at their bytes.
+    % String constants are interned.  string_compare returns -1, 0 or 1.
+    % string_find returns the position of the first occurrence of its
+    % second argument, or -1.  string_split splits a string at the first
+    % occurrence of a separator, returning whether it was found and the
+    % parts before and after it.
+    %
+:- pred setup_string_builtins(type_id::in,
+    map(q_name, builtin_item)::in, map(q_name, builtin_item)::out,
+    core::in, core::out) is det.
+
+setup_string_builtins(BoolType, !Map, !Core) :-
+    register_string_builtin("intern",
+        [builtin_type(string)], [builtin_type(string)], !Map, !Core),
+    register_string_builtin("string_equals",
+        [builtin_type(string), builtin_type(string)],
+        [type_ref(BoolType, [])], !Map, !Core),
+    register_string_builtin("string_compare",
+        [builtin_type(string), builtin_type(string)], [builtin_type(int)],
+        !Map, !Core),
+    register_string_builtin("string_starts_with",
+        [builtin_type(string), builtin_type(string)],
+        [type_ref(BoolType, [])], !Map, !Core),
+    register_string_builtin("string_find",
+        [builtin_type(string), builtin_type(string)], [builtin_type(int)],
+        !Map, !Core),
+    register_string_builtin("string_split",
+        [builtin_type(string), builtin_type(string)],
+        [type_ref(BoolType, []), builtin_type(string),
+            builtin_type(string)],
+        !Map, !Core),
+    register_string_builtin("string_count_byte",
+        [builtin_type(string), builtin_type(int)], [builtin_type(int)],
+        !Map, !Core),
+    register_string_builtin("string_is_utf8",
+        [builtin_type(string)], [type_ref(BoolType, [])], !Map, !Core).
+
+:- pred register_string_builtin(string::in, list(type_)::in,
+    list(type_)::in, map(q_name, builtin_item)::in,
+    map(q_name, builtin_item)::out, core::in, core::out) is det.
+
+register_string_builtin(Name, Inputs, Outputs, !Map, !Core) :-
+    FullName = q_name_snoc(builtin_module_name, Name),
+    register_builtin_func(q_name(Name),
+        func_init_builtin_rts(FullName, Inputs, Outputs, init, init),
         _, !Map, !Core).
 
 %-----------------------------------------------------------------------%
@@ -197,6 +197,11 @@ compute_arity_expr_call(Core, Callee, Args, !CodeInfo, Result) :-
         )
     ; Callee = c_ho(_),
         Result = ok(no)
+    ;
+        ( Callee = c_spawn(_)
+        ; Callee = c_join(_)
+        ),
+        unexpected($file, $pred, "Spawn or join before parallelisation")
     ).
 
 :- pred compute_arity_expr_match(core::in, list(expr_case)::in,
@@ -77,7 +77,11 @@ branchcheck_match(Core, Context, Type, Cases) = Errors :-
     ( Type = builtin_type(Builtin),
         % For all the current builtins there may be an infinite number of
         % values.  They must contain at least one wildcard.
-        ( Builtin = int ; Builtin = string ),
+        ( Builtin = int
+        ; Builtin = string
+        ; Builtin = channel
+        ; Builtin = array
+        ),
         Errors = branchcheck_inf(Context, Cases, set.init)
     ; Type = type_ref(TypeId, _),
         Ctors = set(type_get_ctors(core_get_type(Core, TypeId))),
@@ -43,7 +43,14 @@
 
 :- type callee
     --->    c_plain(func_id)
-    ;       c_ho(var).
+    ;       c_ho(var)
+
+            % Created by the parallelisation pass: spawn a task that calls
+            % the function, the result is the task.  The task is waited for
+            % by a join of the variable it is bound to, which has no
+            % arguments.
+    ;       c_spawn(func_id)
+    ;       c_join(var).
 
 %-----------------------------------------------------------------------%
 
@@ -174,9 +181,15 @@ expr_get_callees(Expr) = Callees :-
     ; ExprType = e_let(_, ExprA, ExprB),
         Callees = union(expr_get_callees(ExprA), expr_get_callees(ExprB))
     ; ExprType = e_call(Callee, _, _),
-        ( Callee = c_plain(FuncId),
+        (
+            ( Callee = c_plain(FuncId)
+            ; Callee = c_spawn(FuncId)
+            ),
             Callees = make_singleton_set(FuncId)
-        ; Callee = c_ho(_),
+        ;
+            ( Callee = c_ho(_)
+            ; Callee = c_join(_)
+            ),
             Callees = init
         )
     ; ExprType = e_var(_),
@@ -220,11 +233,17 @@ rename_expr(Vars, expr(ExprType0, Info), expr(ExprType, Info),
         ExprType = e_let(LetVars, LetExpr, InExpr)
     ; ExprType0 = e_call(Callee0, Args0, MaybeResources),
         map_foldl2(rename_var(Vars), Args0, Args, !Renaming, !Varmap),
-        ( Callee0 = c_plain(_),
+        (
+            ( Callee0 = c_plain(_)
+            ; Callee0 = c_spawn(_)
+            ),
             Callee = Callee0
         ; Callee0 = c_ho(CalleeVar0),
             rename_var(Vars, CalleeVar0, CalleeVar, !Renaming, !Varmap),
             Callee = c_ho(CalleeVar)
+        ; Callee0 = c_join(TaskVar0),
+            rename_var(Vars, TaskVar0, TaskVar, !Renaming, !Varmap),
+            Callee = c_join(TaskVar)
         ),
         ExprType = e_call(Callee, Args, MaybeResources)
     ; ExprType0 = e_var(Var0),
@@ -62,6 +62,8 @@
 
 :- func func_get_imported(function) = imported.
 
+:- func func_get_sharing(function) = sharing.
+
 :- pred func_get_type_signature(function::in, list(type_)::out,
     list(type_)::out, arity::out) is det.
 
@@ -222,6 +224,8 @@ func_get_name(Func) = Func ^ f_name.
 
 func_get_context(Func) = Func ^ f_context.
 
+func_get_sharing(Func) = Func ^ f_sharing.
+
 func_get_imported(Func) = Imported :-
     % XXX: The import status should not be tied to the definition.
     MaybeDefn = Func ^ f_maybe_func_defn,
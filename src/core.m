@@ -20,6 +20,7 @@
 
 :- include_module core.arity_chk.
 :- include_module core.branch_chk.
+:- include_module core.parallel.
 :- include_module core.res_chk.
 :- include_module core.simplify.
 :- include_module core.type_chk.
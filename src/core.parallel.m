@@ -0,0 +1,495 @@
+%-----------------------------------------------------------------------%
+% vim: ts=4 sw=4 et
+%-----------------------------------------------------------------------%
+:- module core.parallel.
+%
+% Copyright (C) 2018 Plasma Team
+% Distributed under the terms of the MIT see ../LICENSE.code
+%
+% Plasma automatic parallelisation
+%
+% This compiler stage finds calls to pure functions whose results aren't
+% needed until after some more expensive work, and spawns them as tasks
+% that may run in parallel with that work.  For example in:
+%
+%   fib(n-1) + fib(n-2)
+%
+% the first call is spawned, the second is made as usual and then the
+% first is joined before the addition.  The runtime decides how many tasks
+% are worth running in parallel, the compiler only avoids spawning calls
+% that are too cheap to be worth a task.
+%
+% The compiler can't bound the cost of a recursive function, so every call
+% to one is spawned.  The granularity of a recursive computation is
+% controlled by the runtime instead: a spawn within tasks nested more than
+% PZ_SPAWN_MAX_DEPTH deep (runtime/pz_config.h) calls the function, and
+% this costs little more than a plain call.
+%
+%-----------------------------------------------------------------------%
+:- interface.
+
+:- import_module compile_error.
+:- import_module result.
+
+:- pred parallelise(errors(compile_error)::out, core::in, core::out) is det.
+
+%-----------------------------------------------------------------------%
+%-----------------------------------------------------------------------%
+:- implementation.
+
+:- import_module bool.
+
+:- import_module core.util.
+
+%-----------------------------------------------------------------------%
+
+parallelise(Errors, !Core) :-
+    Recursive = recursive_funcs(!.Core),
+    foldl(compute_func_cost(!.Core, Recursive),
+        core_all_nonimported_functions(!.Core), map.init, Costs),
+    Info = par_info(!.Core, Recursive, Costs),
+    process_noerror_funcs(parallelise_func(Info), Errors, !Core).
+
+:- type par_info
+    --->    par_info(
+                pi_core         :: core,
+                pi_recursive    :: set(func_id),
+                pi_costs        :: map(func_id, cost)
+            ).
+
+%-----------------------------------------------------------------------%
+
+    % The cost of an expression is the number of expression nodes that may
+    % be executed, including those in the functions it calls.  It is
+    % unbounded if it may call a recursive function.
+    %
+:- type cost
+    --->    cost(int)
+    ;       cost_unbounded.
+
+    % The smallest cost worth spawning a task for, and worth running in
+    % parallel with a task.  This is a guess, tasks cost a few hundred
+    % instructions to create and join.
+    %
+:- func min_task_cost = int.
+
+min_task_cost = 100.
+
+:- pred is_expensive(cost::in) is semidet.
+
+is_expensive(cost_unbounded).
+is_expensive(cost(Cost)) :-
+    Cost >= min_task_cost.
+
+:- func cost_add(cost, cost) = cost.
+
+cost_add(cost(A), cost(B)) = cost(A + B).
+cost_add(cost(_), cost_unbounded) = cost_unbounded.
+cost_add(cost_unbounded, _) = cost_unbounded.
+
+:- func cost_max(cost, cost) = cost.
+
+cost_max(cost(A), cost(B)) = cost(max(A, B)).
+cost_max(cost(_), cost_unbounded) = cost_unbounded.
+cost_max(cost_unbounded, _) = cost_unbounded.
+
+:- func recursive_funcs(core) = set(func_id).
+
+recursive_funcs(Core) =
+    union_list(filter(is_recursive_scc(Core),
+        core_all_nonimported_functions_sccs(Core))).
+
+:- pred is_recursive_scc(core::in, set(func_id)::in) is semidet.
+
+is_recursive_scc(Core, SCC) :-
+    ( if is_singleton(SCC, FuncId) then
+        core_get_function_det(Core, FuncId, Func),
+        member(FuncId, func_get_callees(Func))
+    else
+        true
+    ).
+
+:- pred compute_func_cost(core::in, set(func_id)::in, func_id::in,
+    map(func_id, cost)::in, map(func_id, cost)::out) is det.
+
+compute_func_cost(Core, Recursive, FuncId, !Costs) :-
+    func_cost(Core, Recursive, FuncId, _, !Costs).
+
+:- pred func_cost(core::in, set(func_id)::in, func_id::in, cost::out,
+    map(func_id, cost)::in, map(func_id, cost)::out) is det.
+
+func_cost(Core, Recursive, FuncId, Cost, !Costs) :-
+    ( if search(!.Costs, FuncId, CostP) then
+        Cost = CostP
+    else
+        ( if member(FuncId, Recursive) then
+            Cost = cost_unbounded
+        else
+            core_get_function_det(Core, FuncId, Func),
+            ( if func_get_body(Func, _, _, Expr) then
+                expr_cost(Core, Recursive, Expr, Cost, !Costs)
+            else
+                % Builtins and imported functions are assumed to be
+                % cheap.
+                Cost = cost(0)
+            )
+        ),
+        map.det_insert(FuncId, Cost, !Costs)
+    ).
+
+:- pred expr_cost(core::in, set(func_id)::in, expr::in, cost::out,
+    map(func_id, cost)::in, map(func_id, cost)::out) is det.
+
+expr_cost(Core, Recursive, Expr, Cost, !Costs) :-
+    ExprType = Expr ^ e_type,
+    ( ExprType = e_tuple(Exprs),
+        map_foldl(expr_cost(Core, Recursive), Exprs, Costs, !Costs),
+        Cost = foldl(cost_add, Costs, cost(1))
+    ; ExprType = e_let(_, LetExpr, InExpr),
+        expr_cost(Core, Recursive, LetExpr, LetCost, !Costs),
+        expr_cost(Core, Recursive, InExpr, InCost, !Costs),
+        Cost = cost_add(LetCost, InCost)
+    ; ExprType = e_call(Callee, _, _),
+        ( Callee = c_plain(FuncId),
+            func_cost(Core, Recursive, FuncId, CalleeCost, !Costs),
+            Cost = cost_add(cost(1), CalleeCost)
+        ;
+            % We don't know what a higher order call will call, assume
+            % that it's cheap.  A spawn or join's own cost is also small.
+            ( Callee = c_ho(_)
+            ; Callee = c_spawn(_)
+            ; Callee = c_join(_)
+            ),
+            Cost = cost(1)
+        )
+    ;
+        ( ExprType = e_var(_)
+        ; ExprType = e_constant(_)
+        ; ExprType = e_construction(_, _)
+        ),
+        Cost = cost(1)
+    ; ExprType = e_match(_, Cases),
+        map_foldl((pred(Case::in, C::out, Cs0::in, Cs::out) is det :-
+                Case = e_case(_, E),
+                expr_cost(Core, Recursive, E, C, Cs0, Cs)
+            ), Cases, CaseCosts, !Costs),
+        Cost = cost_add(cost(1), foldl(cost_max, CaseCosts, cost(0)))
+    ).
+
+:- func bindings_cost(par_info, list(binding)) = cost.
+
+bindings_cost(Info, Bindings) = Cost :-
+    map_foldl((pred(B::in, C::out, Cs0::in, Cs::out) is det :-
+            expr_cost(Info ^ pi_core, Info ^ pi_recursive, B ^ b_expr, C,
+                Cs0, Cs)
+        ), Bindings, Costs, Info ^ pi_costs, _),
+    Cost = foldl(cost_add, Costs, cost(0)).
+
+%-----------------------------------------------------------------------%
+
+:- pred parallelise_func(par_info::in, core::in, func_id::in, function::in,
+    result(function, compile_error)::out) is det.
+
+parallelise_func(Info, _Core, _FuncId, !.Func, ok(!:Func)) :-
+    ( if
+        func_get_body(!.Func, Varmap0, Params, Expr0),
+        func_get_vartypes(!.Func, VarTypes0)
+    then
+        parallelise_expr(Info, Expr0, Expr, Varmap0, Varmap,
+            VarTypes0, VarTypes),
+        func_set_body(Varmap, Params, Expr, VarTypes, !Func)
+    else
+        unexpected($file, $pred, "Body missing")
+    ).
+
+    % A let expression, or a chain of nested let expressions, is handled
+    % as a list of bindings followed by a final expression.
+    %
+:- type binding
+    --->    binding(
+                b_vars      :: list(var),
+                b_expr      :: expr,
+                % The code_info of the let expression.
+                b_info      :: code_info
+            ).
+
+:- pred parallelise_expr(par_info::in, expr::in, expr::out,
+    varmap::in, varmap::out, map(var, type_)::in, map(var, type_)::out)
+    is det.
+
+parallelise_expr(Info, !Expr, !Varmap, !VarTypes) :-
+    ExprType = !.Expr ^ e_type,
+    ( ExprType = e_tuple(Exprs0),
+        map_foldl2(parallelise_expr(Info), Exprs0, Exprs, !Varmap,
+            !VarTypes),
+        !Expr ^ e_type := e_tuple(Exprs),
+        parallelise_chain(Info, [], !Expr, !Varmap, !VarTypes)
+    ; ExprType = e_let(_, _, _),
+        flatten_lets(!.Expr, Bindings0, Final0),
+        map_foldl2(parallelise_binding(Info), Bindings0, Bindings,
+            !Varmap, !VarTypes),
+        parallelise_expr(Info, Final0, Final, !Varmap, !VarTypes),
+        parallelise_chain(Info, Bindings, Final, !:Expr, !Varmap,
+            !VarTypes)
+    ;
+        ( ExprType = e_call(_, _, _)
+        ; ExprType = e_var(_)
+        ; ExprType = e_constant(_)
+        ; ExprType = e_construction(_, _)
+        )
+    ; ExprType = e_match(Var, Cases0),
+        map_foldl2(parallelise_case(Info), Cases0, Cases, !Varmap,
+            !VarTypes),
+        !Expr ^ e_type := e_match(Var, Cases)
+    ).
+
+:- pred parallelise_binding(par_info::in, binding::in, binding::out,
+    varmap::in, varmap::out, map(var, type_)::in, map(var, type_)::out)
+    is det.
+
+parallelise_binding(Info, binding(Vars, !.Expr, CodeInfo),
+        binding(Vars, !:Expr, CodeInfo), !Varmap, !VarTypes) :-
+    parallelise_expr(Info, !Expr, !Varmap, !VarTypes).
+
+:- pred parallelise_case(par_info::in, expr_case::in, expr_case::out,
+    varmap::in, varmap::out, map(var, type_)::in, map(var, type_)::out)
+    is det.
+
+parallelise_case(Info, e_case(Pat, !.Expr), e_case(Pat, !:Expr),
+        !Varmap, !VarTypes) :-
+    parallelise_expr(Info, !Expr, !Varmap, !VarTypes).
+
+    % Spawn what we can in a chain of bindings whose sub-expressions have
+    % already been parallelised.  The chain is rebuilt from its bindings
+    % and final expression, the original is kept if nothing was spawned.
+    %
+:- pred parallelise_chain(par_info::in, list(binding)::in,
+    expr::in, expr::out, varmap::in, varmap::out,
+    map(var, type_)::in, map(var, type_)::out) is det.
+
+parallelise_chain(Info, Bindings0, Final0, Expr, !Varmap, !VarTypes) :-
+    expand_chain(Bindings0, Final0, Bindings1, Final, !.Varmap, Varmap1,
+        !.VarTypes, VarTypes1),
+    parallelise_bindings(Info, Bindings1, Final, Bindings, no, Spawned,
+        Varmap1, Varmap, VarTypes1, VarTypes),
+    ( Spawned = yes,
+        Expr = build_lets(Bindings, Final),
+        !:Varmap = Varmap,
+        !:VarTypes = VarTypes
+    ; Spawned = no,
+        Expr = build_lets(Bindings0, Final0)
+    ).
+
+:- pred flatten_lets(expr::in, list(binding)::out, expr::out) is det.
+
+flatten_lets(Expr, Bindings, Final) :-
+    ( if Expr = expr(e_let(Vars, LetExpr, InExpr), CodeInfo) then
+        flatten_lets(InExpr, Bindings0, Final),
+        Bindings = [binding(Vars, LetExpr, CodeInfo) | Bindings0]
+    else
+        Bindings = [],
+        Final = Expr
+    ).
+
+:- func build_lets(list(binding), expr) = expr.
+
+build_lets(Bindings, Final) =
+    foldr((func(Binding, InExpr) = Expr :-
+            Binding = binding(Vars, LetExpr, Info),
+            Expr = expr(e_let(Vars, LetExpr, InExpr), Info)
+        ), Bindings, Final).
+
+    % Expose the calls within a chain as bindings of their own.  A binding
+    % of several variables to a tuple is split into a binding for each
+    % element, with each element's let expressions brought into the chain.
+    % A final tuple is treated the same way, using new variables.
+    %
+:- pred expand_chain(list(binding)::in, expr::in,
+    list(binding)::out, expr::out, varmap::in, varmap::out,
+    map(var, type_)::in, map(var, type_)::out) is det.
+
+expand_chain(Bindings0, Final0, Bindings, Final, !Varmap, !VarTypes) :-
+    BindingsList = map(expand_binding, Bindings0),
+    ( if
+        Final0 = expr(e_tuple(Exprs), TupleInfo),
+        Exprs = [_, _ | _],
+        all_true(is_single_value, Exprs)
+    then
+        map2_foldl2(expand_tuple_elem(TupleInfo), Exprs, ElemBindings,
+            FinalExprs, !Varmap, !VarTypes),
+        Bindings = condense(BindingsList) ++ condense(ElemBindings),
+        Final = expr(e_tuple(FinalExprs), TupleInfo)
+    else
+        Bindings = condense(BindingsList),
+        Final = Final0
+    ).
+
+:- func expand_binding(binding) = list(binding).
+
+expand_binding(Binding) = Bindings :-
+    Binding = binding(Vars, Expr, CodeInfo),
+    ( if
+        Expr = expr(e_tuple(Exprs), _),
+        Vars = [_, _ | _],
+        length(Vars, Len),
+        length(Exprs, Len),
+        all_true(is_single_value, Exprs)
+    then
+        Bindings = condense(map_corresponding(
+            (func(V, E) = Bs ++ [binding([V], F, CodeInfo)] :-
+                flatten_lets(E, Bs0, F),
+                Bs = map(binding_set_info(CodeInfo), Bs0)
+            ), Vars, Exprs))
+    else
+        Bindings = [Binding]
+    ).
+
+:- pred expand_tuple_elem(code_info::in, expr::in, list(binding)::out,
+    expr::out, varmap::in, varmap::out,
+    map(var, type_)::in, map(var, type_)::out) is det.
+
+expand_tuple_elem(TupleInfo, Expr, Bindings, Final, !Varmap, !VarTypes) :-
+    ( if
+        ( Expr = expr(e_var(_), _)
+        ; Expr = expr(e_constant(_), _)
+        )
+    then
+        Bindings = [],
+        Final = Expr
+    else
+        ( if code_info_get_maybe_types(Expr ^ e_info) = yes([Type]) then
+            create_anon_var_with_type(Type, Var, !Varmap, !VarTypes)
+        else
+            unexpected($file, $pred, "Tuple element isn't a single value")
+        ),
+        flatten_lets(Expr, Bindings0, ExprFinal),
+        Bindings = map(binding_set_info(TupleInfo), Bindings0) ++
+            [binding([Var], ExprFinal, TupleInfo)],
+        Final = expr(e_var(Var), Expr ^ e_info)
+    ).
+
+:- pred is_single_value(expr::in) is semidet.
+
+is_single_value(Expr) :-
+    code_info_get_maybe_types(Expr ^ e_info) = yes([_]).
+
+    % Let expressions moved into a chain take the type of the chain.
+    %
+:- func binding_set_info(code_info, binding) = binding.
+
+binding_set_info(CodeInfo, Binding) = (Binding ^ b_info := CodeInfo).
+
+    % Spawn each call whose result isn't used until after some expensive
+    % work, and join it just before its result is first used.
+    %
+:- pred parallelise_bindings(par_info::in, list(binding)::in, expr::in,
+    list(binding)::out, bool::in, bool::out, varmap::in, varmap::out,
+    map(var, type_)::in, map(var, type_)::out) is det.
+
+parallelise_bindings(_, [], _, [], !Spawned, !Varmap, !VarTypes).
+parallelise_bindings(Info, [Binding | Bindings0], Final, Bindings,
+        !Spawned, !Varmap, !VarTypes) :-
+    ( if
+        spawnable_binding(Info, Binding, Var, FuncId, Args, Resources,
+            CallInfo, Type),
+        split_at_use(Var, Bindings0, Final, Before, After),
+        is_expensive(bindings_cost(Info, Before))
+    then
+        create_anon_var_with_type(Type, TaskVar, !Varmap, !VarTypes),
+        LetInfo = Binding ^ b_info,
+        Spawn = binding([TaskVar],
+            expr(e_call(c_spawn(FuncId), Args, Resources), CallInfo),
+            LetInfo),
+        Join = binding([Var],
+            expr(e_call(c_join(TaskVar), [], resources(init, init)),
+                CallInfo),
+            LetInfo),
+        !:Spawned = yes,
+        parallelise_bindings(Info, Before ++ [Join | After], Final,
+            Bindings1, !Spawned, !Varmap, !VarTypes),
+        Bindings = [Spawn | Bindings1]
+    else
+        parallelise_bindings(Info, Bindings0, Final, Bindings1, !Spawned,
+            !Varmap, !VarTypes),
+        Bindings = [Binding | Bindings1]
+    ).
+
+    % A binding can be spawned if it binds the result of an expensive call
+    % to a function that doesn't use or observe any resources.  The PZ
+    % spawn instruction passes and returns a single value.
+    %
+    % The task variable is given the type of the call's result, since core
+    % has no type for tasks.
+    %
+:- pred spawnable_binding(par_info::in, binding::in, var::out, func_id::out,
+    list(var)::out, maybe_resources::out, code_info::out, type_::out)
+    is semidet.
+
+spawnable_binding(Info, Binding, Var, FuncId, Args, Resources, CallInfo,
+        Type) :-
+    Binding = binding([Var], Expr, _),
+    Expr = expr(e_call(c_plain(FuncId), Args, Resources), CallInfo),
+    Args = [_],
+    Resources = resources(Uses, Observes),
+    is_empty(Uses),
+    is_empty(Observes),
+    code_info_get_maybe_types(CallInfo) = yes([Type]),
+    core_get_function_det(Info ^ pi_core, FuncId, Func),
+    func_get_body(Func, _, _, _),
+    func_get_type_signature(Func, [_], [_], _),
+    search(Info ^ pi_costs, FuncId, Cost),
+    is_expensive(Cost).
+
+    % Split the bindings at the first one that uses the variable.  Fail if
+    % the variable isn't used at all.
+    %
+:- pred split_at_use(var::in, list(binding)::in, expr::in,
+    list(binding)::out, list(binding)::out) is semidet.
+
+split_at_use(Var, [], Final, [], []) :-
+    expr_uses_var(Var, Final).
+split_at_use(Var, [Binding | Bindings], Final, Before, After) :-
+    ( if expr_uses_var(Var, Binding ^ b_expr) then
+        Before = [],
+        After = [Binding | Bindings]
+    else
+        split_at_use(Var, Bindings, Final, Before0, After),
+        Before = [Binding | Before0]
+    ).
+
+:- pred expr_uses_var(var::in, expr::in) is semidet.
+
+expr_uses_var(Var, Expr) :-
+    ExprType = Expr ^ e_type,
+    require_complete_switch [ExprType]
+    ( ExprType = e_tuple(Exprs),
+        some [E] (
+            member(E, Exprs),
+            expr_uses_var(Var, E)
+        )
+    ; ExprType = e_let(_, LetExpr, InExpr),
+        ( expr_uses_var(Var, LetExpr)
+        ; expr_uses_var(Var, InExpr)
+        )
+    ; ExprType = e_call(Callee, Args, _),
+        ( member(Var, Args)
+        ; Callee = c_ho(Var)
+        ; Callee = c_join(Var)
+        )
+    ; ExprType = e_var(Var)
+    ; ExprType = e_constant(_),
+        false
+    ; ExprType = e_construction(_, Args),
+        member(Var, Args)
+    ; ExprType = e_match(MatchVar, Cases),
+        ( MatchVar = Var
+        ; some [Case, E] (
+            member(Case, Cases),
+            Case = e_case(_, E),
+            expr_uses_var(Var, E)
+          )
+        )
+    ).
+
+%-----------------------------------------------------------------------%
+%-----------------------------------------------------------------------%
@@ -234,6 +234,12 @@ expr_pretty(Core, Varmap, IndentWithoutExprNum, PrintNextExprNum, Expr,
                 FuncId)
         ; Callee = c_ho(CalleeVar),
             CalleePretty = var_pretty(Varmap, CalleeVar)
+        ; Callee = c_spawn(FuncId),
+            CalleePretty = singleton("spawn ") ++
+                id_pretty(core_lookup_function_name(Core), FuncId)
+        ; Callee = c_join(TaskVar),
+            CalleePretty = singleton("join ") ++
+                var_pretty(Varmap, TaskVar)
         ),
         ArgsPretty = map(var_pretty(Varmap), Args),
         PrettyExpr = CalleePretty ++ singleton("(") ++
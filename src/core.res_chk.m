@@ -154,6 +154,11 @@ res_check_expr(Info, expr(ExprType, CodeInfo)) = Errors :-
             else
                 unexpected($file, $pred, "Call to non-function")
             )
+        ;
+            ( Callee = c_spawn(_)
+            ; Callee = c_join(_)
+            ),
+            unexpected($file, $pred, "Spawn or join before parallelisation")
         ),
         Context = code_info_get_context(CodeInfo),
         ArgsErrors = cord_list_to_cord(map_corresponding(
@@ -230,6 +230,11 @@ build_cp_expr(Core, expr(ExprType, CodeInfo), TypesOrVars, !Problem,
         ; Callee = c_ho(HOVar),
             build_cp_expr_ho_call(HOVar, Args, CodeInfo, TypesOrVars,
                 !Problem, !TypeVars)
+        ;
+            ( Callee = c_spawn(_)
+            ; Callee = c_join(_)
+            ),
+            unexpected($file, $pred, "Spawn or join before parallelisation")
         )
     ; ExprType = e_match(Var, Cases),
         map_foldl2(build_cp_case(Core, Var), Cases, CasesTypesOrVars,
@@ -674,6 +679,11 @@ update_types_expr(Core, Varmap, TypeMap, AtRoot, !Types, !Expr) :-
             else
                 unexpected($file, $pred, "Call to non-function")
             )
+        ;
+            ( Callee = c_spawn(_)
+            ; Callee = c_join(_)
+            ),
+            unexpected($file, $pred, "Spawn or join before parallelisation")
         ),
         ExprType = e_call(Callee, Args, Resources)
     ; ExprType0 = e_match(Var, Cases0),
@@ -35,7 +35,11 @@
 :- type builtin_type
     --->    int
             % string may not always be builtin.
-    ;       string.
+    ;       string
+            % A channel of Ints, see runtime/pz_channel.h.
+    ;       channel
+            % An immutable array of Ints.
+    ;       array.
 
 :- pred builtin_type_name(builtin_type, string).
 :- mode builtin_type_name(in, out) is det.
@@ -91,6 +95,8 @@ types_equal_except_resources(T1, T2) :-
 
 builtin_type_name(int,      "Int").
 builtin_type_name(string,   "String").
+builtin_type_name(channel,  "Channel").
+builtin_type_name(array,    "Array").
 
 %-----------------------------------------------------------------------%
 
@@ -20,7 +20,8 @@
     map(func_id, list(pz_instr))::in, map(func_id, pzp_id)::in,
     pz_builtin_ids::in, map(type_id, type_tag_info)::in,
     map({type_id, ctor_id}, constructor_data)::in, map(const_data, pzd_id)::in,
-    func_id::in, pair(pzp_id, pz_proc)::out) is det.
+    map(func_id, static_vars)::in, func_id::in, pair(pzp_id, pz_proc)::out)
+    is det.
 
 %-----------------------------------------------------------------------%
 %-----------------------------------------------------------------------%
@@ -38,7 +39,7 @@
 %-----------------------------------------------------------------------%
 
 gen_proc(CompileOpts, Core, OpIdMap, ProcIdMap, BuiltinProcs, TypeTagInfo,
-        TypeCtorTagInfo, DataMap, FuncId, PID - Proc) :-
+        TypeCtorTagInfo, DataMap, StaticVarsMap, FuncId, PID - Proc) :-
     lookup(ProcIdMap, FuncId, PID),
     core_get_function_det(Core, FuncId, Func),
     Symbol = func_get_name(Func),
@@ -55,9 +56,10 @@ gen_proc(CompileOpts, Core, OpIdMap, ProcIdMap, BuiltinProcs, TypeTagInfo,
             func_get_body(Func, Varmap, Inputs, BodyExpr),
             func_get_vartypes(Func, Vartypes)
         then
+            StaticVars = lookup(StaticVarsMap, FuncId),
             CGInfo = code_gen_info(CompileOpts, Core, OpIdMap, ProcIdMap,
                 BuiltinProcs, TypeTagInfo, TypeCtorTagInfo, DataMap,
-                Vartypes, Varmap),
+                StaticVars, Vartypes, Varmap),
             gen_proc_body(CGInfo, Inputs, BodyExpr, Blocks)
         else
             unexpected($file, $pred, format("No function body for %s",
@@ -76,7 +78,11 @@ type_to_pz_width(Type) = Width :-
     ( Type = builtin_type(BuiltinType),
         ( BuiltinType = int,
             Width = pzw_fast
-        ; BuiltinType = string,
+        ;
+            ( BuiltinType = string
+            ; BuiltinType = channel
+            ; BuiltinType = array
+            ),
             Width = pzw_ptr
         )
     ;
@@ -167,6 +173,7 @@ fixup_stack_2(BottomItems, Items) =
                 cgi_type_ctor_tags  :: map({type_id, ctor_id},
                                             constructor_data),
                 cgi_data_map        :: map(const_data, pzd_id),
+                cgi_static_vars     :: static_vars,
                 cgi_type_map        :: map(var, type_),
                 cgi_varmap          :: varmap
             ).
@@ -216,9 +223,20 @@ gen_instrs(CGInfo, Expr, Depth, BindMap, Continuation, Instrs, !Blocks) :-
             )
         ; ExprType = e_construction(CtorId, Args),
             TypeId = one_item(code_info_get_types(CodeInfo)),
-            gen_instrs_args(BindMap, Varmap, Args, ArgsInstrs, Depth, _),
-            InstrsMain = ArgsInstrs ++
-                gen_construction(CGInfo, TypeId, CtorId)
+            ( if
+                static_construction(CGInfo ^ cgi_type_ctor_tags,
+                    CGInfo ^ cgi_data_map, CGInfo ^ cgi_static_vars,
+                    TypeId, CtorId, Args, Value)
+            then
+                % This is a constant term, it's in the module's static
+                % data.
+                InstrsMain = gen_static_value(CGInfo, Value)
+            else
+                gen_instrs_args(BindMap, Varmap, Args, ArgsInstrs, Depth,
+                    _),
+                InstrsMain = ArgsInstrs ++
+                    gen_construction(CGInfo, TypeId, CtorId)
+            )
         ),
         Arity = code_info_get_arity_det(CodeInfo),
         InstrsCont = gen_continuation(Continuation, Depth, Arity ^ a_num,
@@ -290,6 +308,32 @@ gen_call(CGInfo, Callee, Args, CodeInfo, Depth, BindMap, Continuation,
         Instrs0 = gen_var_access(BindMap, Varmap, HOVar, HOVarDepth) ++
             singleton(pzio_instr(pzi_call_ind)),
         PrepareStackInstrs = init
+    ; Callee = c_spawn(FuncId),
+        core_get_function_det(Core, FuncId, Func),
+        Decl = func_call_pretty(Core, Func, Varmap, Args),
+        CallComment = singleton(pzio_comment(
+            append_list(["spawn " | list(Decl)]))),
+        lookup(CGInfo ^ cgi_proc_id_map, FuncId, PID),
+        func_get_type_signature(Func, Inputs, _, _),
+        ( if Inputs = [Input] then
+            Width = type_to_pz_width(Input)
+        else
+            unexpected($file, $pred, "Spawned function must take one value")
+        ),
+        Instrs0 = singleton(pzio_instr(pzi_spawn(PID, Width))),
+        PrepareStackInstrs = init
+    ; Callee = c_join(TaskVar),
+        CallComment = singleton(pzio_comment("join")),
+        ( if code_info_get_types(CodeInfo) = [Type] then
+            Width = type_to_pz_width(Type)
+        else
+            unexpected($file, $pred, "Join must return one value")
+        ),
+        % The task variable stays on the stack, it is dropped with the
+        % other variables at the end of its scope.
+        Instrs0 = gen_var_access(BindMap, Varmap, TaskVar, Depth) ++
+            singleton(pzio_instr(pzi_wait(Width))),
+        PrepareStackInstrs = init
     ),
     InstrsMain = CallComment ++ InstrsArgs ++ PrepareStackInstrs ++ Instrs0,
     Arity = code_info_get_arity_det(CodeInfo),
@@ -450,6 +494,10 @@ var_type_switch_type(_, builtin_type(Builtin)) = SwitchType :-
         SwitchType = enum
     ; Builtin = string,
         util.sorry($file, $pred, "Cannot switch on strings")
+    ; Builtin = channel,
+        unexpected($file, $pred, "Cannot switch on channels")
+    ; Builtin = array,
+        unexpected($file, $pred, "Cannot switch on arrays")
     ).
 var_type_switch_type(_, type_variable(_)) =
     unexpected($file, $pred, "Switch types must be concrete").
@@ -880,6 +928,28 @@ gen_construction(CGInfo, Type, CtorId) = Instrs :-
         util.sorry($file, $pred, "Function type")
     ).
 
+    % Load a value that is known at compile time.
+    %
+:- func gen_static_value(code_gen_info, pz_field_value) =
+    cord(pz_instr_obj).
+
+gen_static_value(_, pzfv_num(Num)) =
+    singleton(pzio_instr(pzi_load_immediate(pzw_ptr, immediate32(Num)))).
+gen_static_value(CGInfo, pzfv_data(DID, PTag)) = Instrs :-
+    InstrLoad = pzio_instr(pzi_load_immediate(pzw_ptr, immediate_data(DID))),
+    ( if PTag = 0 then
+        Instrs = singleton(InstrLoad)
+    else
+        MakeTag = CGInfo ^ cgi_builtin_ids ^ pbi_make_tag,
+        Instrs = from_list([
+            pzio_comment("Load constant term"),
+            InstrLoad,
+            pzio_instr(pzi_load_immediate(pzw_ptr, immediate32(PTag))),
+            pzio_instr(pzi_call(MakeTag))])
+    ).
+gen_static_value(_, pzfv_code(PID)) =
+    singleton(pzio_instr(pzi_load_immediate(pzw_ptr, immediate_code(PID)))).
+
 %-----------------------------------------------------------------------%
 
 :- type continuation
@@ -20,12 +20,39 @@
 %-----------------------------------------------------------------------%
 
 :- type const_data
-    --->    cd_string(string).
+    --->    cd_string(string)
+    ;       cd_struct(pzs_id, list(pz_field_value)).
 
-:- pred gen_const_data(core::in, func_id::in,
+    % The values of the variables in a function that are known at compile
+    % time.
+    %
+:- type static_vars == map(var, pz_field_value).
+
+    % gen_const_data(Core, CtorDatas, ProcIdMap, FuncId, !DataMap,
+    %   !StaticVarsMap, !PZ).
+    %
+    % Generate the static data for a function's constants.  This includes
+    % constant terms: constructions whose arguments are all known at
+    % compile time, they're stored as static structs rather than being
+    % allocated when the code runs.
+    %
+:- pred gen_const_data(core::in,
+    map({type_id, ctor_id}, constructor_data)::in,
+    map(func_id, pzp_id)::in, func_id::in,
     map(const_data, pzd_id)::in, map(const_data, pzd_id)::out,
+    map(func_id, static_vars)::in, map(func_id, static_vars)::out,
     pz::in, pz::out) is det.
 
+    % static_construction(CtorDatas, DataMap, StaticVars, Type, CtorId,
+    %   Args, Value).
+    %
+    % True if the construction is a constant term, Value is the term.
+    % gen_const_data must have already created the term's data.
+    %
+:- pred static_construction(map({type_id, ctor_id}, constructor_data)::in,
+    map(const_data, pzd_id)::in, static_vars::in, type_::in, ctor_id::in,
+    list(var)::in, pz_field_value::out) is semidet.
+
 %-----------------------------------------------------------------------%
 
     % How to represent this constructor in memory.
@@ -83,64 +110,184 @@
 
 %-----------------------------------------------------------------------%
 
-gen_const_data(Core, FuncId, !DataMap, !PZ) :-
+gen_const_data(Core, CtorDatas, ProcIdMap, FuncId, !DataMap,
+        !StaticVarsMap, !PZ) :-
     core_get_function_det(Core, FuncId, Func),
     ( if func_get_body(Func, _, _, Expr) then
-        gen_const_data_expr(Expr, !DataMap, !PZ)
+        Info = const_data_info(CtorDatas, ProcIdMap),
+        gen_const_data_expr(Info, Expr, _, map.init, StaticVars,
+            !DataMap, !PZ),
+        det_insert(FuncId, StaticVars, !StaticVarsMap)
     else
         true
     ).
 
-:- pred gen_const_data_expr(expr::in,
+:- type const_data_info
+    --->    const_data_info(
+                cdi_ctor_datas      :: map({type_id, ctor_id},
+                                            constructor_data),
+                cdi_proc_id_map     :: map(func_id, pzp_id)
+            ).
+
+    % gen_const_data_expr(Info, Expr, MaybeValues, !StaticVars, !DataMap,
+    %   !PZ).
+    %
+    % MaybeValues are the values of the expression's results, if they're
+    % known at compile time.
+    %
+:- pred gen_const_data_expr(const_data_info::in, expr::in,
+    maybe(list(pz_field_value))::out, static_vars::in, static_vars::out,
     map(const_data, pzd_id)::in, map(const_data, pzd_id)::out,
     pz::in, pz::out) is det.
 
-gen_const_data_expr(expr(ExprType, _), !DataMap, !PZ) :-
-    ( ExprType = e_let(_Vars, ExprA, ExprB),
-        gen_const_data_expr(ExprA, !DataMap, !PZ),
-        gen_const_data_expr(ExprB, !DataMap, !PZ)
+gen_const_data_expr(Info, expr(ExprType, CodeInfo), MaybeValues,
+        !StaticVars, !DataMap, !PZ) :-
+    ( ExprType = e_let(Vars, ExprA, ExprB),
+        gen_const_data_expr(Info, ExprA, MaybeValuesA, !StaticVars,
+            !DataMap, !PZ),
+        ( if
+            MaybeValuesA = yes(ValuesA),
+            length(Vars) = length(ValuesA)
+        then
+            foldl_corresponding(det_insert, Vars, ValuesA, !StaticVars)
+        else
+            true
+        ),
+        gen_const_data_expr(Info, ExprB, MaybeValues, !StaticVars,
+            !DataMap, !PZ)
     ; ExprType = e_tuple(Exprs),
-        foldl2(gen_const_data_expr, Exprs, !DataMap, !PZ)
-    ; ExprType = e_call(_, _, _)
-    ; ExprType = e_var(_)
+        map_foldl3(gen_const_data_expr(Info), Exprs, MaybeValuess,
+            !StaticVars, !DataMap, !PZ),
+        ( if map(maybe_is_yes, MaybeValuess, Valuess) then
+            MaybeValues = yes(condense(Valuess))
+        else
+            MaybeValues = no
+        )
+    ; ExprType = e_call(_, _, _),
+        MaybeValues = no
+    ; ExprType = e_var(Var),
+        ( if search(!.StaticVars, Var, Value) then
+            MaybeValues = yes([Value])
+        else
+            MaybeValues = no
+        )
     ; ExprType = e_constant(Const),
         ( Const = c_string(String),
-            gen_const_data_string(String, !DataMap, !PZ)
-        ; Const = c_number(_)
-        ; Const = c_func(_)
-        ; Const = c_ctor(_)
+            gen_const_data_string(String, DID, !DataMap, !PZ),
+            MaybeValues = yes([pzfv_data(DID, 0)])
+        ; Const = c_number(Num),
+            MaybeValues = yes([pzfv_num(Num)])
+        ; Const = c_func(FuncId),
+            ( if search(Info ^ cdi_proc_id_map, FuncId, PID) then
+                MaybeValues = yes([pzfv_code(PID)])
+            else
+                MaybeValues = no
+            )
+        ; Const = c_ctor(_),
+            MaybeValues = no
+        )
+    ; ExprType = e_construction(CtorId, Args),
+        Type = one_item(code_info_get_types(CodeInfo)),
+        ( if
+            construction_term(Info ^ cdi_ctor_datas, !.StaticVars, Type,
+                CtorId, Args, Term)
+        then
+            ( Term = ct_value(Value)
+            ; Term = ct_struct(StructId, PTag, Fields),
+                ConstData = cd_struct(StructId, Fields),
+                ( if search(!.DataMap, ConstData, DIDPrime) then
+                    DID = DIDPrime
+                else
+                    Data = pz_data(type_struct(StructId),
+                        pzv_fields(Fields)),
+                    pz_intern_data(Data, DID, !PZ),
+                    det_insert(ConstData, DID, !DataMap)
+                ),
+                Value = pzfv_data(DID, PTag)
+            ),
+            MaybeValues = yes([Value])
+        else
+            MaybeValues = no
         )
-    ; ExprType = e_construction(_, _)
     ; ExprType = e_match(_, Cases),
-        foldl2(gen_const_data_case, Cases, !DataMap, !PZ)
+        foldl3(gen_const_data_case(Info), Cases, !StaticVars, !DataMap,
+            !PZ),
+        MaybeValues = no
     ).
 
-:- pred gen_const_data_case(expr_case::in,
+:- pred gen_const_data_case(const_data_info::in, expr_case::in,
+    static_vars::in, static_vars::out,
     map(const_data, pzd_id)::in, map(const_data, pzd_id)::out,
     pz::in, pz::out) is det.
 
-gen_const_data_case(e_case(_, Expr), !DataMap, !PZ) :-
-    gen_const_data_expr(Expr, !DataMap, !PZ).
+gen_const_data_case(Info, e_case(_, Expr), !StaticVars, !DataMap, !PZ) :-
+    gen_const_data_expr(Info, Expr, _, !StaticVars, !DataMap, !PZ).
+
+:- pred maybe_is_yes(maybe(T)::in, T::out) is semidet.
 
-:- pred gen_const_data_string(string::in,
+maybe_is_yes(yes(X), X).
+
+:- pred gen_const_data_string(string::in, pzd_id::out,
     map(const_data, pzd_id)::in, map(const_data, pzd_id)::out,
     pz::in, pz::out) is det.
 
-gen_const_data_string(String, !DataMap, !PZ) :-
+gen_const_data_string(String, DID, !DataMap, !PZ) :-
     ConstData = cd_string(String),
-    ( if search(!.DataMap, ConstData, _) then
-        true
+    ( if search(!.DataMap, ConstData, DIDPrime) then
+        DID = DIDPrime
     else
-        pz_new_data_id(DID, !PZ),
         % XXX: currently ASCII.
-        Bytes = map(to_int, to_char_list(String)) ++ [0],
-        Data = pz_data(type_array(pzw_8), pzv_sequence(Bytes)),
-        pz_add_data(DID, Data, !PZ),
+        Bytes = map(to_int, to_char_list(String)),
+        Data = pz_data(type_string, pzv_sequence(Bytes)),
+        pz_intern_data(Data, DID, !PZ),
         det_insert(ConstData, DID, !DataMap)
     ).
 
 %-----------------------------------------------------------------------%
 
+static_construction(CtorDatas, DataMap, StaticVars, Type, CtorId, Args,
+        Value) :-
+    construction_term(CtorDatas, StaticVars, Type, CtorId, Args, Term),
+    ( Term = ct_value(Value)
+    ; Term = ct_struct(StructId, PTag, Fields),
+        search(DataMap, cd_struct(StructId, Fields), DID),
+        Value = pzfv_data(DID, PTag)
+    ).
+
+:- type construction_term
+    --->    ct_value(pz_field_value)
+    ;       ct_struct(pzs_id, int, list(pz_field_value)).
+
+    % Succeeds if all the construction's arguments are known at compile
+    % time.  Constructors without fields are simply a value, others are a
+    % struct, its primary tag and the values of its fields.
+    %
+:- pred construction_term(map({type_id, ctor_id}, constructor_data)::in,
+    static_vars::in, type_::in, ctor_id::in, list(var)::in,
+    construction_term::out) is semidet.
+
+construction_term(CtorDatas, StaticVars, type_ref(TypeId, _), CtorId, Args,
+        Term) :-
+    map((pred(Arg::in, Value::out) is semidet :-
+            search(StaticVars, Arg, Value)
+        ), Args, ArgValues),
+    lookup(CtorDatas, {TypeId, CtorId}, CtorData),
+    TagInfo = CtorData ^ cd_tag_info,
+    ( TagInfo = ti_constant(PTag, WordBits),
+        Term = ct_value(pzfv_num((WordBits << num_ptag_bits) \/ PTag))
+    ; TagInfo = ti_constant_notag(Word),
+        Term = ct_value(pzfv_num(Word))
+    ; TagInfo = ti_tagged_pointer(PTag, StructId, MaybeSTag),
+        ( MaybeSTag = no,
+            Fields = ArgValues
+        ; MaybeSTag = yes(STag),
+            Fields = [pzfv_num(STag) | ArgValues]
+        ),
+        Term = ct_struct(StructId, PTag, Fields)
+    ).
+
+%-----------------------------------------------------------------------%
+
 gen_constructor_data(Core, BuiltinProcs, TypeTagMap, CtorTagMap, !PZ) :-
     TypeIds = core_all_types(Core),
     foldl3(gen_constructor_data_type(Core, BuiltinProcs), TypeIds,
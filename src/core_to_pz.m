@@ -53,7 +53,7 @@
 %-----------------------------------------------------------------------%
 
 core_to_pz(CompileOpts, !.Core, !:PZ) :-
-    !:PZ = init_pz,
+    !:PZ = init_pz(module_name(!.Core)),
 
     % Get ProcIds for builtin procedures.
     setup_pz_builtin_procs(BuiltinProcs, !PZ),
@@ -66,15 +66,18 @@ core_to_pz(CompileOpts, !.Core, !:PZ) :-
     % each structure.
     gen_constructor_data(!.Core, BuiltinProcs, TypeTagMap, TypeCtorTagMap, !PZ),
 
-    % Generate constants.
+    % Allocate procedure IDs, constants may refer to procedures.
     FuncIds = core_all_functions(!.Core),
-    foldl2(gen_const_data(!.Core), FuncIds, init, DataMap, !PZ),
-
-    % Generate functions.
     foldl3(make_proc_id_map(!.Core), FuncIds,
         init, ProcIdMap, init, OpIdMap, !PZ),
+
+    % Generate constants.
+    foldl3(gen_const_data(!.Core, TypeCtorTagMap, ProcIdMap), FuncIds,
+        init, DataMap, init, StaticVarsMap, !PZ),
+
+    % Generate functions.
     map(gen_proc(CompileOpts, !.Core, OpIdMap, ProcIdMap, BuiltinProcs,
-            TypeTagMap, TypeCtorTagMap, DataMap),
+            TypeTagMap, TypeCtorTagMap, DataMap, StaticVarsMap),
         keys(ProcIdMap), Procs),
     foldl((pred((PID - P)::in, PZ0::in, PZ::out) is det :-
             pz_add_proc(PID, P, PZ0, PZ)
@@ -229,7 +232,7 @@ make_proc_id_map(Core, FuncId, !ProcMap, !OpMap, !PZ) :-
     Name = q_name_to_string(func_get_name(Function)),
     ( if func_builtin_type(Function, BuiltinType) then
         ( BuiltinType = bit_core,
-            make_proc_id_core_or_rts(FuncId, Function, !ProcMap, !PZ),
+            make_proc_id_core_or_rts(Core, FuncId, Function, !ProcMap, !PZ),
             ( if func_get_body(Function, _, _, _) then
                 true
             else
@@ -246,7 +249,7 @@ make_proc_id_map(Core, FuncId, !ProcMap, !OpMap, !PZ) :-
                     [s(Name)]))
             )
         ; BuiltinType = bit_rts,
-            make_proc_id_core_or_rts(FuncId, Function, !ProcMap, !PZ),
+            make_proc_id_core_or_rts(Core, FuncId, Function, !ProcMap, !PZ),
             ( if
                 not func_builtin_inline_pz(Function, _),
                 not func_get_body(Function, _, _, _)
@@ -259,7 +262,7 @@ make_proc_id_map(Core, FuncId, !ProcMap, !OpMap, !PZ) :-
             )
         )
     else
-        make_proc_id_core_or_rts(FuncId, Function, !ProcMap, !PZ),
+        make_proc_id_core_or_rts(Core, FuncId, Function, !ProcMap, !PZ),
         ( if func_get_body(Function, _, _, _) then
             true
         else
@@ -268,14 +271,26 @@ make_proc_id_map(Core, FuncId, !ProcMap, !OpMap, !PZ) :-
         )
     ).
 
-:- pred make_proc_id_core_or_rts(func_id::in, function::in,
+:- pred make_proc_id_core_or_rts(core::in, func_id::in, function::in,
     map(func_id, pzp_id)::in, map(func_id, pzp_id)::out,
     pz::in, pz::out) is det.
 
-make_proc_id_core_or_rts(FuncId, Function, !Map, !PZ) :-
+make_proc_id_core_or_rts(Core, FuncId, Function, !Map, !PZ) :-
     Imported = func_get_imported(Function),
     pz_new_proc_id(Imported, ProcId, !PZ),
-    det_insert(FuncId, ProcId, !Map).
+    det_insert(FuncId, ProcId, !Map),
+    % Export the public functions defined by this module, so that other
+    % modules can link against them.
+    Name = func_get_name(Function),
+    ( if
+        Imported = i_local,
+        func_get_sharing(Function) = s_public,
+        Name = q_name_snoc(module_name(Core), q_name_unqual(Name))
+    then
+        pz_export_proc(ProcId, !PZ)
+    else
+        true
+    ).
 
 %-----------------------------------------------------------------------%
 %-----------------------------------------------------------------------%
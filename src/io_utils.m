@@ -5,6 +5,10 @@
 %
 % Tag Length Value serialisation.
 %
+% The write_* predicates write directly to a stream, the put_* predicates
+% build a sequence of bytes in memory so that its size and contents can be
+% examined before it is written.
+%
 % Copyright (C) 2015 Plasma Team
 % Distributed under the terms of the MIT License see ../LICENSE.code
 %
@@ -12,6 +16,7 @@
 
 :- interface.
 
+:- import_module cord.
 :- import_module io.
 :- import_module int.
 :- import_module string.
@@ -50,6 +55,48 @@
 :- pred write_int64(binary_output_stream::in, int::in, int::in,
     io::di, io::uo) is det.
 
+    % write_bytes(Stream, Bytes, !IO)
+    %
+:- pred write_bytes(binary_output_stream::in, cord(int)::in,
+    io::di, io::uo) is det.
+
+%-----------------------------------------------------------------------%
+
+    % A sequence of bytes being built in memory.
+    %
+:- type bytes == cord(int).
+
+:- pred put_len_string(string::in, bytes::in, bytes::out) is det.
+
+:- pred put_int8(int::in, bytes::in, bytes::out) is det.
+
+:- pred put_int16(int::in, bytes::in, bytes::out) is det.
+
+:- pred put_int32(int::in, bytes::in, bytes::out) is det.
+
+    % put_int64(IntHigh32, IntLow32, !Bytes)
+    %
+:- pred put_int64(int::in, int::in, bytes::in, bytes::out) is det.
+
+    % put_uvarint(Int, !Bytes)
+    %
+    % Put a non-negative integer as an unsigned LEB128 variable length
+    % integer: seven bits per byte, least significant group first, with
+    % the high bit set on every byte except the last.
+    %
+:- pred put_uvarint(int::in, bytes::in, bytes::out) is det.
+
+    % put_svarint(Int, !Bytes)
+    %
+    % Put a signed integer as the unsigned varint of its zigzag encoding,
+    % which maps 0, -1, 1, -2, ... to 0, 1, 2, 3, ...
+    %
+:- pred put_svarint(int::in, bytes::in, bytes::out) is det.
+
+:- pred put_bytes(bytes::in, bytes::in, bytes::out) is det.
+
+:- func bytes_length(bytes) = int.
+
 %-----------------------------------------------------------------------%
 %-----------------------------------------------------------------------%
 
@@ -57,6 +104,8 @@
 
 :- import_module char.
 :- import_module int.
+:- import_module list.
+:- import_module require.
 
 %-----------------------------------------------------------------------%
 
@@ -92,5 +141,54 @@ write_int64(Stream, IntHigh, IntLow, !IO) :-
     write_int32(Stream, IntHigh, !IO),
     write_int32(Stream, IntLow, !IO).
 
+write_bytes(Stream, Bytes, !IO) :-
+    list.foldl(write_byte(Stream), cord.list(Bytes), !IO).
+
+%-----------------------------------------------------------------------%
+
+put_len_string(String, !Bytes) :-
+    put_int16(length(String), !Bytes),
+    foldl(put_char_as_byte, String, !Bytes).
+
+:- pred put_char_as_byte(char::in, bytes::in, bytes::out) is det.
+
+put_char_as_byte(Char, !Bytes) :-
+    put_int8(to_int(Char), !Bytes).
+
+put_int8(Int, !Bytes) :-
+    !:Bytes = snoc(!.Bytes, Int /\ 0xFF).
+
+put_int16(Int, !Bytes) :-
+    put_int8(Int >> 8, !Bytes),
+    put_int8(Int, !Bytes).
+
+put_int32(Int, !Bytes) :-
+    put_int8(Int >> 24, !Bytes),
+    put_int8(Int >> 16, !Bytes),
+    put_int8(Int >> 8, !Bytes),
+    put_int8(Int, !Bytes).
+
+put_int64(IntHigh, IntLow, !Bytes) :-
+    put_int32(IntHigh, !Bytes),
+    put_int32(IntLow, !Bytes).
+
+put_uvarint(Int, !Bytes) :-
+    ( if Int < 0 then
+        unexpected($file, $pred, "Negative value")
+    else if Int < 0x80 then
+        put_int8(Int, !Bytes)
+    else
+        put_int8((Int /\ 0x7F) \/ 0x80, !Bytes),
+        put_uvarint(Int >> 7, !Bytes)
+    ).
+
+put_svarint(Int, !Bytes) :-
+    put_uvarint((Int << 1) `xor` (Int >> (bits_per_int - 1)), !Bytes).
+
+put_bytes(New, !Bytes) :-
+    !:Bytes = !.Bytes ++ New.
+
+bytes_length(Bytes) = cord.length(Bytes).
+
 %-----------------------------------------------------------------------%
 %-----------------------------------------------------------------------%
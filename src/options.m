@@ -35,6 +35,7 @@
                 % compilation, by making them options they're easier toe
                 % test.
                 co_do_simplify      :: do_simplify,
+                co_do_parallel      :: do_parallel,
                 co_enable_tailcalls :: enable_tailcalls
             ).
 
@@ -50,6 +51,10 @@
     --->    do_simplify_pass
     ;       skip_simplify_pass.
 
+:- type do_parallel
+    --->    do_parallel_pass
+    ;       skip_parallel_pass.
+
 :- type enable_tailcalls
     --->    enable_tailcalls
     ;       dont_enable_tailcalls.
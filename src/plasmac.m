@@ -41,6 +41,7 @@
 :- import_module core.branch_chk.
 :- import_module core.pretty.
 :- import_module core.res_chk.
+:- import_module core.parallel.
 :- import_module core.simplify.
 :- import_module core.type_chk.
 :- import_module core_to_pz.
@@ -189,6 +190,14 @@ process_options(Args0, Result, !IO) :-
                     DoSimplify = skip_simplify_pass
                 ),
 
+                lookup_bool_option(OptionTable, parallel,
+                    DoParallelBool),
+                ( DoParallelBool = yes,
+                    DoParallel = do_parallel_pass
+                ; DoParallelBool = no,
+                    DoParallel = skip_parallel_pass
+                ),
+
                 lookup_bool_option(OptionTable, tailcalls,
                     EnableTailcallsBool),
                 ( EnableTailcallsBool = yes,
@@ -200,7 +209,7 @@ process_options(Args0, Result, !IO) :-
                 Result = ok(plasmac_options(compile(
                         compile_options(OutputDir, InputFile, Output,
                             DumpStages, WriteOutput, DoSimplify,
-                            EnableTailcalls)),
+                            DoParallel, EnableTailcalls)),
                     Verbose))
             ;
                 Result = error("Error processing command line options: " ++
@@ -247,6 +256,7 @@ usage(!IO) :-
     ;       dump_stages
     ;       write_output
     ;       simplify
+    ;       parallel
     ;       tailcalls.
 
 :- pred short_option(char::in, option::out) is semidet.
@@ -264,6 +274,7 @@ long_option("output-dir",       output_dir).
 long_option("dump-stages",      dump_stages).
 long_option("write-output",     write_output).
 long_option("simplify",         simplify).
+long_option("parallel",         parallel).
 long_option("tailcalls",        tailcalls).
 
 :- pred option_default(option::out, option_data::out) is multi.
@@ -275,6 +286,7 @@ option_default(output_dir,      string("")).
 option_default(dump_stages,     bool(no)).
 option_default(write_output,    bool(yes)).
 option_default(simplify,        bool(yes)).
+option_default(parallel,        bool(yes)).
 option_default(tailcalls,       bool(yes)).
 
 %-----------------------------------------------------------------------%
@@ -323,8 +335,16 @@ semantic_checks(CompileOpts, !.Core, Result, !IO) :-
         SimplifyErrors = init
     ),
 
+    Parallel = CompileOpts ^ co_do_parallel,
+    ( Parallel = do_parallel_pass,
+        parallelise(ParallelErrors, !Core),
+        maybe_dump_core_stage(CompileOpts, "core6_parallel", !.Core, !IO)
+    ; Parallel = skip_parallel_pass,
+        ParallelErrors = init
+    ),
+
     Errors = ArityErrors ++ TypecheckErrors ++ BranchcheckErrors ++
-        RescheckErrors ++ SimplifyErrors,
+        RescheckErrors ++ SimplifyErrors ++ ParallelErrors,
     ( if is_empty(Errors) then
         Result = ok(!.Core)
     else
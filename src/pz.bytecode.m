@@ -31,11 +31,29 @@
 
 %-----------------------------------------------------------------------%
 
+% Constants for the section directory.
+
+:- func pzf_section_imports = int.
+:- func pzf_section_structs = int.
+:- func pzf_section_data = int.
+:- func pzf_section_code = int.
+:- func pzf_section_exports = int.
+
+:- func pzf_section_entry_size = int.
+
+    % The FNV-1a hash parameters used to hash each section.
+    %
+:- func pzf_hash_init = int.
+:- func pzf_hash_prime = int.
+
+%-----------------------------------------------------------------------%
+
 % Constants for encoding data types.
 
 :- func pzf_data_basic = int.
 :- func pzf_data_array = int.
 :- func pzf_data_struct = int.
+:- func pzf_data_string = int.
 
     % Encoding type is used for data items, it is used by the code that
     % reads/writes this static data so that it knows how to interpret each
@@ -45,7 +63,8 @@
     --->    t_normal
     ;       t_ptr
     ;       t_wptr
-    ;       t_wfast.
+    ;       t_wfast
+    ;       t_code.
 
 :- pred pz_enc_byte(enc_type::in, int::in, int::out) is det.
 
@@ -87,7 +106,9 @@
     ;       pzo_ret
     ;       pzo_alloc
     ;       pzo_load
-    ;       pzo_store.
+    ;       pzo_store
+    ;       pzo_spawn
+    ;       pzo_wait.
 
 :- pred instr_opcode(pz_instr, pz_opcode).
 :- mode instr_opcode(in, out) is det.
@@ -98,6 +119,13 @@
 :- pred pz_width_byte(pz_width, int).
 :- mode pz_width_byte(in, out) is det.
 
+    % pz_widths_byte(WidthA, WidthB, Byte)
+    %
+    % Instructions with two operand widths encode both in a single byte.
+    %
+:- pred pz_widths_byte(pz_width, pz_width, int).
+:- mode pz_widths_byte(in, in, out) is det.
+
     % This type represents intermediate values within the instruction
     % stream, such as labels and stack depths.  The related immediate_value
     % type, represents only the types of immediate values that can be loaded
@@ -179,6 +207,43 @@ pzf_id_string =
 
 %-----------------------------------------------------------------------%
 
+:- pragma foreign_proc("C",
+    pzf_section_imports = (X::out),
+    [will_not_call_mercury, thread_safe, promise_pure],
+    "X = PZ_SECTION_IMPORTS;").
+:- pragma foreign_proc("C",
+    pzf_section_structs = (X::out),
+    [will_not_call_mercury, thread_safe, promise_pure],
+    "X = PZ_SECTION_STRUCTS;").
+:- pragma foreign_proc("C",
+    pzf_section_data = (X::out),
+    [will_not_call_mercury, thread_safe, promise_pure],
+    "X = PZ_SECTION_DATA;").
+:- pragma foreign_proc("C",
+    pzf_section_code = (X::out),
+    [will_not_call_mercury, thread_safe, promise_pure],
+    "X = PZ_SECTION_CODE;").
+:- pragma foreign_proc("C",
+    pzf_section_exports = (X::out),
+    [will_not_call_mercury, thread_safe, promise_pure],
+    "X = PZ_SECTION_EXPORTS;").
+
+:- pragma foreign_proc("C",
+    pzf_section_entry_size = (X::out),
+    [will_not_call_mercury, thread_safe, promise_pure],
+    "X = PZ_SECTION_ENTRY_SIZE;").
+
+:- pragma foreign_proc("C",
+    pzf_hash_init = (X::out),
+    [will_not_call_mercury, thread_safe, promise_pure],
+    "X = PZ_HASH_INIT;").
+:- pragma foreign_proc("C",
+    pzf_hash_prime = (X::out),
+    [will_not_call_mercury, thread_safe, promise_pure],
+    "X = PZ_HASH_PRIME;").
+
+%-----------------------------------------------------------------------%
+
 % These are used directly as integers when writing out PZ files,
 % otherwise this would be a good candidate for a foreign_enum.
 
@@ -194,13 +259,18 @@ pzf_id_string =
     pzf_data_struct = (X::out),
     [will_not_call_mercury, thread_safe, promise_pure],
     "X = PZ_DATA_STRUCT;").
+:- pragma foreign_proc("C",
+    pzf_data_string = (X::out),
+    [will_not_call_mercury, thread_safe, promise_pure],
+    "X = PZ_DATA_STRING;").
 
 
 :- pragma foreign_enum("C", enc_type/0,
     [   t_normal        - "pz_data_enc_type_normal",
         t_wfast         - "pz_data_enc_type_fast",
         t_wptr          - "pz_data_enc_type_wptr",
-        t_ptr           - "pz_data_enc_type_ptr"
+        t_ptr           - "pz_data_enc_type_ptr",
+        t_code          - "pz_data_enc_type_code"
     ]).
 
 :- pragma foreign_proc("C",
@@ -248,7 +318,9 @@ pzf_id_string =
     pzo_ret                 - "PZI_RET",
     pzo_alloc               - "PZI_ALLOC",
     pzo_load                - "PZI_LOAD",
-    pzo_store               - "PZI_STORE"
+    pzo_store               - "PZI_STORE",
+    pzo_spawn               - "PZI_SPAWN",
+    pzo_wait                - "PZI_WAIT"
 ]).
 
 :- pragma foreign_proc("C",
@@ -302,6 +374,8 @@ instr_opcode(pzi_ret,           pzo_ret).
 instr_opcode(pzi_alloc(_),      pzo_alloc).
 instr_opcode(pzi_load(_, _, _), pzo_load).
 instr_opcode(pzi_store(_, _, _),pzo_store).
+instr_opcode(pzi_spawn(_, _),   pzo_spawn).
+instr_opcode(pzi_wait(_),       pzo_wait).
 
 %-----------------------------------------------------------------------%
 
@@ -310,6 +384,11 @@ instr_opcode(pzi_store(_, _, _),pzo_store).
     [will_not_call_mercury, promise_pure, thread_safe],
     "Byte = WidthValue;").
 
+:- pragma foreign_proc("C",
+    pz_widths_byte(WidthA::in, WidthB::in, Byte::out),
+    [will_not_call_mercury, promise_pure, thread_safe],
+    "Byte = PZ_MAKE_WIDTHS(WidthA, WidthB);").
+
 %-----------------------------------------------------------------------%
 
 pz_instr_immediate(Instr, Imm) :-
@@ -319,6 +398,7 @@ pz_instr_immediate(Instr, Imm) :-
     ;
         ( Instr = pzi_call(Callee)
         ; Instr = pzi_tcall(Callee)
+        ; Instr = pzi_spawn(Callee, _)
         ),
         Imm = pz_immediate_code(Callee)
     ;
@@ -358,6 +438,7 @@ pz_instr_immediate(Instr, Imm) :-
         ; Instr = pzi_drop
         ; Instr = pzi_call_ind
         ; Instr = pzi_ret
+        ; Instr = pzi_wait(_)
         ),
         false
     ; Instr = pzi_alloc(Struct),
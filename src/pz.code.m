@@ -105,7 +105,13 @@
 
     ;       pzi_alloc(pzs_id)
     ;       pzi_load(pzs_id, int, pz_width)
-    ;       pzi_store(pzs_id, int, pz_width).
+    ;       pzi_store(pzs_id, int, pz_width)
+
+            % Spawn a task calling a procedure with one argument and one
+            % result, and wait for a task's result.  See
+            % docs/pz_machine.txt.
+    ;       pzi_spawn(pzp_id, pz_width)
+    ;       pzi_wait(pz_width).
 
     % This type represents the kinds of immediate value that can be loaded
     % onto the stack via the pzi_load_immediate instruction.  The related
@@ -180,6 +186,8 @@ instr_operand_width(pzi_ret,                    no_width).
 instr_operand_width(pzi_alloc(_),               no_width).
 instr_operand_width(pzi_load(_, _, W),          one_width(W)).
 instr_operand_width(pzi_store(_, _, W),         one_width(W)).
+instr_operand_width(pzi_spawn(_, W),            one_width(W)).
+instr_operand_width(pzi_wait(W),                one_width(W)).
 
 %-----------------------------------------------------------------------%
 
@@ -27,6 +27,7 @@
 :- import_module asm_error.
 :- import_module common_types.
 :- import_module pz.code.
+:- import_module q_name.
 :- import_module result.
 
 %-----------------------------------------------------------------------%
@@ -51,7 +52,12 @@
 :- type pz_data_type
     --->    type_basic(pz_width)
     ;       type_array(pz_width)
-    ;       type_struct(pzs_id).
+    ;       type_struct(pzs_id)
+
+            % A string's value is a sequence of bytes, the runtime stores
+            % its length with it.
+            %
+    ;       type_string.
 
     % A static data entry
     %
@@ -79,7 +85,16 @@
 :- type pz_data_value
     --->    pzv_num(int)
     ;       pzv_sequence(list(int))
-    ;       pzv_data(pzd_id).
+    ;       pzv_data(pzd_id)
+    ;       pzv_fields(list(pz_field_value)).
+
+    % The value of a field of a static struct.  A reference to data may
+    % have a primary tag, which is added to the referenced address.
+    %
+:- type pz_field_value
+    --->    pzfv_num(int)
+    ;       pzfv_data(pzd_id, int)
+    ;       pzfv_code(pzp_id).
 
 %-----------------------------------------------------------------------%
 
@@ -107,7 +122,9 @@
 
 %-----------------------------------------------------------------------%
 
-:- func init_pz = pz.
+:- func init_pz(q_name) = pz.
+
+:- func pz_get_module_name(pz) = q_name.
 
 %-----------------------------------------------------------------------%
 
@@ -139,12 +156,27 @@
 
 :- func pz_get_imported_procs(pz) = assoc_list(pzp_id, pz_proc).
 
+    % Export a local procedure so that other modules may import it.  It is
+    % exported using the unqualified part of its name.
+    %
+:- pred pz_export_proc(pzp_id::in, pz::in, pz::out) is det.
+
+:- func pz_get_exported_procs(pz) = assoc_list(pzp_id, pz_proc).
+
 %-----------------------------------------------------------------------%
 
 :- pred pz_new_data_id(pzd_id::out, pz::in, pz::out) is det.
 
 :- pred pz_add_data(pzd_id::in, pz_data::in, pz::in, pz::out) is det.
 
+    % pz_intern_data(Data, DataID, !PZ)
+    %
+    % Return the ID of a data item added by this predicate with the same
+    % contents, or add it if there is none.  This way identical constants
+    % are stored once.
+    %
+:- pred pz_intern_data(pz_data::in, pzd_id::out, pz::in, pz::out) is det.
+
 :- func pz_get_data_items(pz) = assoc_list(pzd_id, pz_data).
 
 %-----------------------------------------------------------------------%
@@ -161,6 +193,8 @@
 :- import_module array.
 :- import_module map.
 :- import_module pair.
+:- import_module require.
+:- import_module set.
 
 :- include_module pz.bytecode.
 
@@ -208,6 +242,8 @@ pzd_id_get_num(_, pzd_id(Num)) = Num.
 
 :- type pz
     ---> pz(
+        pz_module_name              :: q_name,
+
         pz_structs                  :: map(pzs_id, pz_struct),
         pz_next_struct_id           :: pzs_id,
 
@@ -215,16 +251,21 @@ pzd_id_get_num(_, pzd_id(Num)) = Num.
         pz_next_local_proc_id       :: int,
         pz_next_imported_proc_id    :: int,
         pz_maybe_entry              :: maybe(pzp_id),
+        pz_exports                  :: set(pzp_id),
 
         pz_data                     :: map(pzd_id, pz_data),
         pz_next_data_id             :: pzd_id,
+        pz_interned_data            :: map(pz_data, pzd_id),
 
         pz_errors                   :: cord(error(asm_error))
     ).
 
 %-----------------------------------------------------------------------%
 
-init_pz = pz(init, pzs_id(0), init, 0, 0, no, init, pzd_id(0), init).
+init_pz(ModuleName) = pz(ModuleName, init, pzs_id(0), init, 0, 0, no, init,
+    init, pzd_id(0), init, init).
+
+pz_get_module_name(PZ) = PZ ^ pz_module_name.
 
 %-----------------------------------------------------------------------%
 
@@ -266,6 +307,17 @@ pz_get_imported_procs(PZ) =
     filter((pred((pzp_id_imported(_) - _)::in) is semidet),
         pz_get_procs(PZ)).
 
+pz_export_proc(ProcID, !PZ) :-
+    ( ProcID = pzp_id_local(_),
+        !PZ ^ pz_exports := set.insert(!.PZ ^ pz_exports, ProcID)
+    ; ProcID = pzp_id_imported(_),
+        unexpected($file, $pred, "Cannot export an imported procedure")
+    ).
+
+pz_get_exported_procs(PZ) =
+    map((func(PID) = PID - pz_lookup_proc(PZ, PID)),
+        set.to_sorted_list(PZ ^ pz_exports)).
+
 %-----------------------------------------------------------------------%
 
 pz_set_entry_proc(ProcID, !PZ) :-
@@ -284,6 +336,16 @@ pz_add_data(DataID, Data, !PZ) :-
     map.det_insert(DataID, Data, Datas0, Datas),
     !PZ ^ pz_data := Datas.
 
+pz_intern_data(Data, DataID, !PZ) :-
+    ( if search(!.PZ ^ pz_interned_data, Data, DataIDPrime) then
+        DataID = DataIDPrime
+    else
+        pz_new_data_id(DataID, !PZ),
+        pz_add_data(DataID, Data, !PZ),
+        !PZ ^ pz_interned_data :=
+            det_insert(!.PZ ^ pz_interned_data, Data, DataID)
+    ).
+
 %-----------------------------------------------------------------------%
 
 pz_get_data_items(PZ) = to_assoc_list(PZ ^ pz_data).
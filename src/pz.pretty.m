@@ -23,7 +23,6 @@
 
 :- import_module pretty_utils.
 :- import_module q_name.
-:- import_module util.
 
 pz_pretty(PZ) = condense(StructsPretty) ++ nl ++ condense(DataPretty) ++ nl
         ++ condense(ProcsPretty) :-
@@ -49,18 +48,20 @@ data_pretty(PZ, DID - pz_data(Type, Data)) = String :-
     DIDNum = pzd_id_get_num(PZ, DID),
     DeclStr = format("data d%d = ", [i(DIDNum)]),
 
-    TypeStr = data_type_pretty(Type),
+    TypeStr = data_type_pretty(PZ, Type),
 
     DataStr = data_value_pretty(PZ, Data),
 
     String = singleton(DeclStr) ++ TypeStr ++ spc ++ DataStr ++ semicolon ++ nl.
 
-:- func data_type_pretty(pz_data_type) = cord(string).
+:- func data_type_pretty(pz, pz_data_type) = cord(string).
 
-data_type_pretty(type_basic(Width)) = width_pretty(Width).
-data_type_pretty(type_array(Width)) = cons("array(",
+data_type_pretty(_, type_basic(Width)) = width_pretty(Width).
+data_type_pretty(_, type_array(Width)) = cons("array(",
     snoc(width_pretty(Width), ")")).
-data_type_pretty(type_struct(_)) = util.sorry($file, $pred, "structures").
+data_type_pretty(PZ, type_struct(PZSId)) =
+    singleton(format("struct_%d", [i(pzs_id_get_num(PZ, PZSId))])).
+data_type_pretty(_, type_string) = singleton("string").
 
 :- func data_value_pretty(pz, pz_data_value) = cord(string).
 
@@ -70,6 +71,22 @@ data_value_pretty(_, pzv_sequence(Nums)) =
     singleton(" }").
 data_value_pretty(PZ, pzv_data(DID)) =
     singleton(format("d%i", [i(pzd_id_get_num(PZ, DID))])).
+data_value_pretty(PZ, pzv_fields(Fields)) =
+    singleton("{ ") ++ join(spc, map(field_value_pretty(PZ), Fields)) ++
+    singleton(" }").
+
+:- func field_value_pretty(pz, pz_field_value) = cord(string).
+
+field_value_pretty(_, pzfv_num(Num)) = singleton(string(Num)).
+field_value_pretty(PZ, pzfv_data(DID, Tag)) = String :-
+    DataString = format("d%i", [i(pzd_id_get_num(PZ, DID))]),
+    ( if Tag = 0 then
+        String = singleton(DataString)
+    else
+        String = singleton(format("%s+%d", [s(DataString), i(Tag)]))
+    ).
+field_value_pretty(PZ, pzfv_code(PID)) =
+    singleton(format("proc_%d", [i(pzp_id_get_num(PZ, PID))])).
 
 %-----------------------------------------------------------------------%
 
@@ -201,6 +218,11 @@ pretty_instr(PZ, Instr) = String :-
             Name = "not"
         ; Instr = pzi_cjmp(Dest, Width),
             Name = format("cjmp b%d", [i(Dest)])
+        ; Instr = pzi_spawn(PID, Width),
+            Name = "spawn " ++
+                q_name_to_string(pz_lookup_proc(PZ, PID) ^ pzp_name)
+        ; Instr = pzi_wait(Width),
+            Name = "wait"
         ),
         String = singleton(Name) ++ colon ++ width_pretty(Width)
     ;
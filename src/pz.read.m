@@ -26,7 +26,7 @@
 
 %-----------------------------------------------------------------------%
 
-read_pz(_Name, init_pz, !IO).
+read_pz(Name, init_pz(q_name(Name)), !IO).
 
 %-----------------------------------------------------------------------%
 %-----------------------------------------------------------------------%
@@ -25,6 +25,7 @@
 
 :- implementation.
 
+:- import_module cord.
 :- import_module int.
 :- import_module list.
 :- import_module pair.
@@ -40,11 +41,27 @@
 write_pz(Filename, PZ, Result, !IO) :-
     io.open_binary_output(Filename, MaybeFile, !IO),
     ( MaybeFile = ok(File),
-        write_int16(File, pzf_magic, !IO),
-        write_len_string(File, pzf_id_string, !IO),
-        write_int16(File, pzf_version, !IO),
-        write_pz_options(File, PZ, !IO),
-        write_pz_entries(File, PZ, !IO),
+        some [!Header] (
+            !:Header = cord.init,
+            put_int16(pzf_magic, !Header),
+            put_len_string(pzf_id_string, !Header),
+            put_int16(pzf_version, !Header),
+            put_pz_options(PZ, !Header),
+            Header = !.Header
+        ),
+        Sections = pz_sections(PZ),
+        % The directory is a count followed by an entry per section.
+        DirectoryLength = 1 + length(Sections) * pzf_section_entry_size,
+        some [!Directory] (
+            !:Directory = cord.init,
+            put_int8(length(Sections), !Directory),
+            foldl2(put_section_entry, Sections,
+                bytes_length(Header) + DirectoryLength, _, !Directory),
+            Directory = !.Directory
+        ),
+        write_bytes(File, Header, !IO),
+        write_bytes(File, Directory, !IO),
+        foldl(write_section(File), Sections, !IO),
         Result = ok
     ; MaybeFile = error(Error),
         Result =
@@ -53,49 +70,108 @@ write_pz(Filename, PZ, Result, !IO) :-
 
 %-----------------------------------------------------------------------%
 
-:- pred write_pz_options(io.binary_output_stream::in, pz::in,
-    io::di, io::uo) is det.
+:- pred put_pz_options(pz::in, bytes::in, bytes::out) is det.
 
-write_pz_options(File, PZ, !IO) :-
+put_pz_options(PZ, !Bytes) :-
     MaybeEntryProc = pz_get_maybe_entry_proc(PZ),
     ( MaybeEntryProc = yes(EntryPID),
-        write_int16(File, 1, !IO),
-        write_int16(File, pzf_opt_entry_proc, !IO),
-        write_int16(File, 4, !IO),
-        write_int32(File, pzp_id_get_num(PZ, EntryPID), !IO)
+        put_int16(1, !Bytes),
+        put_int16(pzf_opt_entry_proc, !Bytes),
+        put_int16(4, !Bytes),
+        put_int32(pzp_id_get_num(PZ, EntryPID), !Bytes)
     ; MaybeEntryProc = no,
-        write_int16(File, 0, !IO)
+        put_int16(0, !Bytes)
     ).
 
-:- pred write_pz_entries(io.binary_output_stream::in, pz::in, io::di, io::uo)
-    is det.
+%-----------------------------------------------------------------------%
+
+:- type section
+    --->    section(
+                s_type          :: int,
+                s_bytes         :: bytes
+            ).
+
+:- func pz_sections(pz) = list(section).
 
-write_pz_entries(File, PZ, !IO) :-
-    % Write counts of each entry type
-    % Currently data items are never imported.
-    write_int32(File, 0, !IO),
+pz_sections(PZ) = Sections :-
     ImportedProcs = sort(pz_get_imported_procs(PZ)),
-    write_int32(File, length(ImportedProcs), !IO),
     Structs = sort(pz_get_structs(PZ)),
-    write_int32(File, length(Structs), !IO),
     Datas = sort(pz_get_data_items(PZ)),
-    write_int32(File, length(Datas), !IO),
     Procs = sort(pz_get_local_procs(PZ)),
-    write_int32(File, length(Procs), !IO),
+    ExportedProcs = pz_get_exported_procs(PZ),
+
+    some [!Imports] (
+        !:Imports = cord.init,
+        % Currently data items are never imported.
+        put_uvarint(0, !Imports),
+        put_uvarint(length(ImportedProcs), !Imports),
+        foldl(put_imported_proc, ImportedProcs, !Imports),
+        Imports = !.Imports
+    ),
+    some [!StructBytes] (
+        !:StructBytes = cord.init,
+        put_uvarint(length(Structs), !StructBytes),
+        foldl(put_struct, Structs, !StructBytes),
+        StructBytes = !.StructBytes
+    ),
+    some [!DataBytes] (
+        !:DataBytes = cord.init,
+        put_uvarint(length(Datas), !DataBytes),
+        foldl(put_data(PZ), Datas, !DataBytes),
+        DataBytes = !.DataBytes
+    ),
+    some [!Code] (
+        !:Code = cord.init,
+        put_uvarint(length(Procs), !Code),
+        foldl(put_proc(PZ), Procs, !Code),
+        Code = !.Code
+    ),
+    some [!Exports] (
+        !:Exports = cord.init,
+        put_len_string(q_name_to_string(pz_get_module_name(PZ)), !Exports),
+        put_uvarint(length(ExportedProcs), !Exports),
+        foldl(put_exported_proc(PZ), ExportedProcs, !Exports),
+        Exports = !.Exports
+    ),
+
+    Sections = [
+        section(pzf_section_imports, Imports),
+        section(pzf_section_structs, StructBytes),
+        section(pzf_section_data, DataBytes),
+        section(pzf_section_code, Code),
+        section(pzf_section_exports, Exports)
+    ].
+
+:- pred put_section_entry(section::in, int::in, int::out,
+    bytes::in, bytes::out) is det.
 
-    % Write the actual entries.
-    foldl(write_imported_proc(File), ImportedProcs, !IO),
-    % TODO Write imported data.
-    foldl(write_struct(File), Structs, !IO),
-    foldl(write_data(File, PZ), Datas, !IO),
-    foldl(write_proc(File, PZ), Procs, !IO).
+put_section_entry(section(Type, Bytes), Offset, Offset + Length, !Dir) :-
+    Length = bytes_length(Bytes),
+    put_int8(Type, !Dir),
+    put_int32(Offset, !Dir),
+    put_int32(Length, !Dir),
+    put_int32(section_hash(Bytes), !Dir).
+
+:- func section_hash(bytes) = int.
+
+section_hash(Bytes) = foldl(hash_byte, Bytes, pzf_hash_init).
+
+:- func hash_byte(int, int) = int.
+
+hash_byte(Byte, Hash) = ((Hash `xor` Byte) * pzf_hash_prime) /\ 0xFFFFFFFF.
+
+:- pred write_section(io.binary_output_stream::in, section::in,
+    io::di, io::uo) is det.
+
+write_section(File, Section, !IO) :-
+    write_bytes(File, Section ^ s_bytes, !IO).
 
 %-----------------------------------------------------------------------%
 
-:- pred write_imported_proc(io.binary_output_stream::in,
-    pair(T, pz_proc)::in, io::di, io::uo) is det.
+:- pred put_imported_proc(pair(T, pz_proc)::in, bytes::in, bytes::out)
+    is det.
 
-write_imported_proc(File, _ - Proc, !IO) :-
+put_imported_proc(_ - Proc, !Bytes) :-
     q_name_parts(Proc ^ pzp_name, Qualifiers, ProcName),
     ModuleName = join_list(".", Qualifiers),
     ( if ModuleName = "" then
@@ -103,97 +179,150 @@ write_imported_proc(File, _ - Proc, !IO) :-
     else
         true
     ),
-    write_len_string(File, ModuleName, !IO),
-    write_len_string(File, ProcName, !IO).
+    put_len_string(ModuleName, !Bytes),
+    put_len_string(ProcName, !Bytes).
 
 %-----------------------------------------------------------------------%
 
-:- pred write_struct(io.binary_output_stream::in,
-    pair(T, pz_struct)::in, io::di, io::uo) is det.
+:- pred put_exported_proc(pz::in, pair(pzp_id, pz_proc)::in,
+    bytes::in, bytes::out) is det.
 
-write_struct(File, _ - pz_struct(Widths), !IO) :-
-    write_int32(File, length(Widths), !IO),
-    foldl(write_width(File), Widths, !IO).
+put_exported_proc(PZ, PID - Proc, !Bytes) :-
+    put_len_string(q_name_unqual(Proc ^ pzp_name), !Bytes),
+    put_uvarint(pzp_id_get_num(PZ, PID), !Bytes).
 
-:- pred write_width(io.binary_output_stream::in, pz_width::in,
-    io::di, io::uo) is det.
+%-----------------------------------------------------------------------%
+
+:- pred put_struct(pair(T, pz_struct)::in, bytes::in, bytes::out) is det.
+
+put_struct(_ - pz_struct(Widths), !Bytes) :-
+    put_uvarint(length(Widths), !Bytes),
+    foldl(put_width, Widths, !Bytes).
+
+:- pred put_width(pz_width::in, bytes::in, bytes::out) is det.
 
-write_width(File, Width, !IO) :-
+put_width(Width, !Bytes) :-
     pz_width_byte(Width, Int),
-    write_int8(File, Int, !IO).
+    put_int8(Int, !Bytes).
 
 %-----------------------------------------------------------------------%
 
-:- pred write_data(io.binary_output_stream::in, pz::in,
-    pair(T, pz_data)::in, io::di, io::uo) is det.
+:- pred put_data(pz::in, pair(T, pz_data)::in, bytes::in, bytes::out)
+    is det.
 
-write_data(File, PZ, _ - pz_data(Type, Value), !IO) :-
-    write_data_type(File, PZ, Type, Value, !IO),
-    write_data_value(File, PZ, Type, Value, !IO).
+put_data(PZ, _ - pz_data(Type, Value), !Bytes) :-
+    put_data_type(PZ, Type, Value, !Bytes),
+    put_data_value(PZ, Type, Value, !Bytes).
 
-:- pred write_data_type(io.binary_output_stream::in, pz::in,
-    pz_data_type::in, pz_data_value::in, io::di, io::uo) is det.
+:- pred put_data_type(pz::in, pz_data_type::in, pz_data_value::in,
+    bytes::in, bytes::out) is det.
 
-write_data_type(File, _PZ, type_basic(Width), _, !IO) :-
-    write_int8(File, pzf_data_basic, !IO),
-    write_width(File, Width, !IO).
-write_data_type(File, _PZ, type_array(Width), Value, !IO) :-
-    write_int8(File, pzf_data_array, !IO),
+put_data_type(_PZ, type_basic(Width), _, !Bytes) :-
+    put_int8(pzf_data_basic, !Bytes),
+    put_width(Width, !Bytes).
+put_data_type(_PZ, type_array(Width), Value, !Bytes) :-
+    put_int8(pzf_data_array, !Bytes),
     ( Value = pzv_sequence(Nums),
-        write_int16(File, length(Nums), !IO)
+        put_uvarint(length(Nums), !Bytes)
     ;
         ( Value = pzv_num(_)
         ; Value = pzv_data(_)
+        ; Value = pzv_fields(_)
         ),
         unexpected($file, $pred, "Expected sequence of data")
     ),
-    write_width(File, Width, !IO).
-write_data_type(File, PZ, type_struct(PZSId), _, !IO) :-
-    write_int8(File, pzf_data_struct, !IO),
-    write_int32(File, pzs_id_get_num(PZ, PZSId), !IO).
+    put_width(Width, !Bytes).
+put_data_type(PZ, type_struct(PZSId), _, !Bytes) :-
+    put_int8(pzf_data_struct, !Bytes),
+    put_uvarint(pzs_id_get_num(PZ, PZSId), !Bytes).
+put_data_type(_PZ, type_string, Value, !Bytes) :-
+    put_int8(pzf_data_string, !Bytes),
+    ( Value = pzv_sequence(Nums),
+        put_uvarint(length(Nums), !Bytes)
+    ;
+        ( Value = pzv_num(_)
+        ; Value = pzv_data(_)
+        ; Value = pzv_fields(_)
+        ),
+        unexpected($file, $pred, "Expected sequence of bytes")
+    ).
 
-:- pred write_data_value(io.binary_output_stream::in, pz::in, pz_data_type::in,
-    pz_data_value::in, io::di, io::uo) is det.
+:- pred put_data_value(pz::in, pz_data_type::in, pz_data_value::in,
+    bytes::in, bytes::out) is det.
 
-write_data_value(File, _PZ, Type, pzv_num(Num), !IO) :-
+put_data_value(_PZ, Type, pzv_num(Num), !Bytes) :-
     ( Type = type_basic(Width),
-        write_value(File, Width, Num, !IO)
+        put_value(Width, Num, !Bytes)
     ;
         ( Type = type_array(_)
         ; Type = type_struct(_)
+        ; Type = type_string
         ),
         unexpected($file, $pred,
             "Type and Value do not match, expected nonscalar value.")
     ).
-write_data_value(File, PZ, Type, pzv_sequence(Nums), !IO) :-
+put_data_value(PZ, Type, pzv_sequence(Nums), !Bytes) :-
     ( Type = type_array(Width),
-        foldl(write_value(File, Width), Nums, !IO)
+        foldl(put_value(Width), Nums, !Bytes)
     ; Type = type_struct(PZSId),
         pz_lookup_struct(PZ, PZSId) = pz_struct(Widths),
-        foldl_corresponding(write_value(File), Widths, Nums, !IO)
+        foldl_corresponding(put_value, Widths, Nums, !Bytes)
+    ; Type = type_string,
+        % The bytes of a string have no encoding bytes.
+        foldl(put_int8, Nums, !Bytes)
     ; Type = type_basic(_),
         unexpected($file, $pred,
             "Type and Value do not match, expected scalar value.")
     ).
-write_data_value(File, _, _, pzv_data(DID), !IO) :-
-    write_int32(File, DID ^ pzd_id_num, !IO).
+put_data_value(_, _, pzv_data(DID), !Bytes) :-
+    put_data_ref(DID, 0, !Bytes).
+put_data_value(PZ, Type, pzv_fields(Fields), !Bytes) :-
+    ( Type = type_struct(PZSId),
+        pz_lookup_struct(PZ, PZSId) = pz_struct(Widths),
+        foldl_corresponding(put_field_value(PZ), Widths, Fields, !Bytes)
+    ;
+        ( Type = type_basic(_)
+        ; Type = type_array(_)
+        ; Type = type_string
+        ),
+        unexpected($file, $pred,
+            "Type and Value do not match, expected struct value.")
+    ).
 
-:- pred write_value(io.binary_output_stream::in, pz_width::in, int::in,
-    io::di, io::uo) is det.
+:- pred put_field_value(pz::in, pz_width::in, pz_field_value::in,
+    bytes::in, bytes::out) is det.
 
-write_value(File, Width, Value, !IO) :-
+put_field_value(_, Width, pzfv_num(Num), !Bytes) :-
+    put_value(Width, Num, !Bytes).
+put_field_value(_, _, pzfv_data(DID, Tag), !Bytes) :-
+    put_data_ref(DID, Tag, !Bytes).
+put_field_value(PZ, _, pzfv_code(PID), !Bytes) :-
+    pz_enc_byte(t_code, 0, EncByte),
+    put_int8(EncByte, !Bytes),
+    put_uvarint(pzp_id_get_num(PZ, PID), !Bytes).
+
+:- pred put_data_ref(pzd_id::in, int::in, bytes::in, bytes::out) is det.
+
+put_data_ref(DID, Tag, !Bytes) :-
+    pz_enc_byte(t_ptr, Tag, EncByte),
+    put_int8(EncByte, !Bytes),
+    put_uvarint(DID ^ pzd_id_num, !Bytes).
+
+:- pred put_value(pz_width::in, int::in, bytes::in, bytes::out) is det.
+
+put_value(Width, Value, !Bytes) :-
     ( Width = pzw_8,
         pz_enc_byte(t_normal, 1, EncByte),
-        write_int8(File, EncByte, !IO),
-        write_int8(File, Value, !IO)
+        put_int8(EncByte, !Bytes),
+        put_int8(Value, !Bytes)
     ; Width = pzw_16,
         pz_enc_byte(t_normal, 2, EncByte),
-        write_int8(File, EncByte, !IO),
-        write_int16(File, Value, !IO)
+        put_int8(EncByte, !Bytes),
+        put_int16(Value, !Bytes)
     ; Width = pzw_32,
         pz_enc_byte(t_normal, 4, EncByte),
-        write_int8(File, EncByte, !IO),
-        write_int32(File, Value, !IO)
+        put_int8(EncByte, !Bytes),
+        put_int32(Value, !Bytes)
     ; Width = pzw_64,
         util.sorry($file, $pred, "64bit values")
     ;
@@ -205,83 +334,91 @@ write_value(File, Width, Value, !IO) :-
             Type = t_wfast
         ),
         pz_enc_byte(Type, 4, EncByte),
-        write_int8(File, EncByte, !IO),
-        write_int32(File, Value, !IO)
+        put_int8(EncByte, !Bytes),
+        put_int32(Value, !Bytes)
     ).
 
 %-----------------------------------------------------------------------%
 
-:- pred write_proc(binary_output_stream::in, pz::in, pair(T, pz_proc)::in,
-    io::di, io::uo) is det.
+:- pred put_proc(pz::in, pair(T, pz_proc)::in, bytes::in, bytes::out)
+    is det.
 
-write_proc(File, PZ, _ - Proc, !IO) :-
+put_proc(PZ, _ - Proc, !Bytes) :-
     MaybeBlocks = Proc ^ pzp_blocks,
     ( MaybeBlocks = yes(Blocks),
-        write_int32(File, length(Blocks), !IO),
-        foldl(write_block(File, PZ), Blocks, !IO)
+        put_uvarint(length(Blocks), !Bytes),
+        foldl(put_block(PZ), Blocks, !Bytes)
     ; MaybeBlocks = no,
         unexpected($file, $pred, "Missing definition")
     ).
 
-:- pred write_block(binary_output_stream::in, pz::in, pz_block::in,
-    io::di, io::uo) is det.
+:- pred put_block(pz::in, pz_block::in, bytes::in, bytes::out) is det.
 
-write_block(File, PZ, pz_block(InstrObjs), !IO) :-
+put_block(PZ, pz_block(InstrObjs), !Bytes) :-
     filter_map((pred(pzio_instr(I)::in, I::out) is semidet),
         InstrObjs, Instrs),
-    write_int32(File, length(Instrs), !IO),
-    foldl(write_instr(File, PZ), Instrs, !IO).
+    put_uvarint(length(Instrs), !Bytes),
+    foldl(put_instr(PZ), Instrs, !Bytes).
 
-:- pred write_instr(binary_output_stream::in, pz::in, pz_instr::in,
-    io::di, io::uo) is det.
+:- pred put_instr(pz::in, pz_instr::in, bytes::in, bytes::out) is det.
 
-write_instr(File, PZ, Instr, !IO) :-
+put_instr(PZ, Instr, !Bytes) :-
     instr_opcode(Instr, Opcode),
     opcode_byte(Opcode, OpcodeByte),
-    write_int8(File, OpcodeByte, !IO),
+    put_int8(OpcodeByte, !Bytes),
     instr_operand_width(Instr, Widths),
     ( Widths = no_width
     ; Widths = one_width(Width),
         pz_width_byte(Width, WidthByte),
-        write_int8(File, WidthByte, !IO)
+        put_int8(WidthByte, !Bytes)
     ; Widths = two_widths(WidthA, WidthB),
-        pz_width_byte(WidthA, WidthByteA),
-        write_int8(File, WidthByteA, !IO),
-        pz_width_byte(WidthB, WidthByteB),
-        write_int8(File, WidthByteB, !IO)
+        pz_widths_byte(WidthA, WidthB, WidthsByte),
+        put_int8(WidthsByte, !Bytes)
     ),
     ( if pz_instr_immediate(Instr, Immediate1) then
-        write_immediate(File, PZ, Immediate1, !IO)
+        put_immediate(PZ, Immediate1, !Bytes)
     else
         true
     ).
 
-:- pred write_immediate(binary_output_stream::in, pz::in,
-    pz_immediate_value::in, io::di, io::uo) is det.
+:- pred put_immediate(pz::in, pz_immediate_value::in, bytes::in, bytes::out)
+    is det.
 
-write_immediate(File, PZ, Immediate, !IO) :-
+put_immediate(PZ, Immediate, !Bytes) :-
     ( Immediate = pz_immediate8(Int),
-        write_int8(File, Int, !IO)
+        put_int8(Int, !Bytes)
     ; Immediate = pz_immediate16(Int),
-        write_int16(File, Int, !IO)
-    ;
-        ( Immediate = pz_immediate32(Int)
-        ; Immediate = pz_immediate_label(Int)
-        ),
-        write_int32(File, Int, !IO)
+        % 16 and 32 bit immediates are sign extended from their width and
+        % zigzag encoded, so that small values of either sign take few
+        % bytes.
+        put_svarint(sign_extend(16, Int), !Bytes)
+    ; Immediate = pz_immediate32(Int),
+        put_svarint(sign_extend(32, Int), !Bytes)
+    ; Immediate = pz_immediate_label(Int),
+        put_uvarint(Int, !Bytes)
     ; Immediate = pz_immediate64(IntHigh, IntLow),
-        write_int64(File, IntHigh, IntLow, !IO)
+        put_int64(IntHigh, IntLow, !Bytes)
     ; Immediate = pz_immediate_data(DID),
-        write_int32(File, pzd_id_get_num(PZ, DID), !IO)
+        put_uvarint(pzd_id_get_num(PZ, DID), !Bytes)
     ; Immediate = pz_immediate_code(PID),
-        write_int32(File, pzp_id_get_num(PZ, PID), !IO)
+        put_uvarint(pzp_id_get_num(PZ, PID), !Bytes)
     ; Immediate = pz_immediate_struct(SID),
-        write_int32(File, pzs_id_get_num(PZ, SID), !IO)
+        put_uvarint(pzs_id_get_num(PZ, SID), !Bytes)
     ; Immediate = pz_immediate_struct_field(SID, Field),
-        write_int32(File, pzs_id_get_num(PZ, SID), !IO),
+        put_uvarint(pzs_id_get_num(PZ, SID), !Bytes),
         % Subtract 1 for the zero-based encoding format.
-        write_int8(File, Field - 1, !IO)
+        put_int8(Field - 1, !Bytes)
     ).
 
+    % sign_extend(Bits, Int) = SignedInt
+    %
+    % Treat the low Bits bits of Int as a two's complement number.
+    %
+:- func sign_extend(int, int) = int.
+
+sign_extend(Bits, Int) = ((Int /\ Mask) `xor` SignBit) - SignBit :-
+    Mask = (1 << Bits) - 1,
+    SignBit = 1 << (Bits - 1).
+
 %-----------------------------------------------------------------------%
 %-----------------------------------------------------------------------%
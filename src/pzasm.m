@@ -34,6 +34,7 @@
 :- import_module pz.
 :- import_module pz.write.
 :- import_module pzt_parse.
+:- import_module q_name.
 :- import_module result.
 :- import_module util.
 
@@ -47,7 +48,7 @@ main(!IO) :-
         ( Mode = assemble(InputFile, OutputFile),
             pzt_parse.parse(InputFile, MaybePZAst, !IO),
             ( MaybePZAst = ok(PZAst),
-                assemble(PZAst, MaybePZ),
+                assemble(q_name(module_name(InputFile)), PZAst, MaybePZ),
                 ( MaybePZ = ok(PZ),
                     write_pz(OutputFile, PZ, Result, !IO),
                     ( Result = ok
@@ -69,6 +70,22 @@ main(!IO) :-
         exit_error(ErrMsg, !IO)
     ).
 
+    % The module is named after the input file, without its directory or
+    % extension.
+    %
+:- func module_name(string) = string.
+
+module_name(InputFile) = ModuleName :-
+    FilePartLength = suffix_length((pred(C::in) is semidet :-
+            C \= ('/')
+        ), InputFile),
+    FilePart = right(InputFile, FilePartLength),
+    ( if remove_suffix(FilePart, ".pzt", Base) then
+        ModuleName = Base
+    else
+        ModuleName = FilePart
+    ).
+
 %-----------------------------------------------------------------------%
 
 :- type pzasm_options
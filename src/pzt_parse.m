@@ -66,10 +66,12 @@ parse(Filename, Result, !IO) :-
     ;       struct
     ;       data
     ;       array
+    ;       string
     ;       jmp
     ;       cjmp
     ;       call
     ;       tcall
+    ;       spawn
     ;       roll
     ;       pick
     ;       alloc
@@ -101,10 +103,12 @@ lexemes = [
         ("struct"           -> return(struct)),
         ("data"             -> return(data)),
         ("array"            -> return(array)),
+        ("string"           -> return(string)),
         ("jmp"              -> return(jmp)),
         ("cjmp"             -> return(cjmp)),
         ("call"             -> return(call)),
         ("tcall"            -> return(tcall)),
+        ("spawn"            -> return(spawn)),
         ("roll"             -> return(roll)),
         ("pick"             -> return(pick)),
         ("alloc"            -> return(alloc)),
@@ -213,7 +217,12 @@ parse_data(Result, !Tokens) :-
     pzt_tokens::in, pzt_tokens::out) is det.
 
 parse_data_type(Result, !Tokens) :-
-    % Only arrays are implemented.
+    or([parse_data_type_array, parse_data_type_string], Result, !Tokens).
+
+:- pred parse_data_type_array(parse_res(pz_data_type)::out,
+    pzt_tokens::in, pzt_tokens::out) is det.
+
+parse_data_type_array(Result, !Tokens) :-
     match_tokens([array, open_paren], StartMatch, !Tokens),
     parse_width(WidthResult, !Tokens),
     match_token(close_paren, CloseMatch, !Tokens),
@@ -227,6 +236,13 @@ parse_data_type(Result, !Tokens) :-
         Result = combine_errors_3(StartMatch, WidthResult, CloseMatch)
     ).
 
+:- pred parse_data_type_string(parse_res(pz_data_type)::out,
+    pzt_tokens::in, pzt_tokens::out) is det.
+
+parse_data_type_string(Result, !Tokens) :-
+    match_token(string, MatchString, !Tokens),
+    Result = map((func(_) = type_string), MatchString).
+
 :- pred parse_data_value(parse_res(pz_data_value)::out,
     pzt_tokens::in, pzt_tokens::out) is det.
 
@@ -349,6 +365,7 @@ parse_instr_code(Result, !Tokens) :-
         parse_token_ident_instr(cjmp, (func(Dest) = pzti_cjmp(Dest))),
         parse_token_qname_instr(call, (func(Dest) = pzti_call(Dest))),
         parse_token_qname_instr(tcall, (func(Dest) = pzti_tcall(Dest))),
+        parse_token_qname_instr(spawn, (func(Dest) = pzti_spawn(Dest))),
         parse_token_ident_instr(alloc, (func(Struct) = pzti_alloc(Struct))),
         parse_loadstore_instr,
         parse_imm_instr],
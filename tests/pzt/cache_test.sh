@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+# This is free and unencumbered software released into the public domain.
+# See ../LICENSE.unlicense
+#
+# Run a program several times against one cache directory and print its
+# output and the cache messages from each run.
+#
+# Usage: cache_test.sh PZRUN PZFILE
+
+set -e
+
+PZRUN=$1
+PZFILE=$2
+CACHE_DIR=$(basename $PZFILE .pz).cache
+
+run() {
+    echo "# $1"
+    $PZRUN -v -c $CACHE_DIR $PZFILE 2>$CACHE_DIR.log
+    grep -i 'cache' $CACHE_DIR.log | sed -e 's/[^ ]*\.pzc/CACHE_FILE/'
+}
+
+rm -rf $CACHE_DIR
+run miss
+run hit
+CACHE_FILE=$(ls $CACHE_DIR/*.pzc)
+
+# Change the PZ file's hash in the header, as if the file was written for
+# an older version of the program.
+printf '\377' | dd of=$CACHE_FILE bs=1 seek=8 conv=notrunc 2>/dev/null
+run stale
+run "hit after stale"
+
+# Truncate the file so that the code is missing.
+head -c 100 $CACHE_FILE > $CACHE_FILE.tmp
+mv $CACHE_FILE.tmp $CACHE_FILE
+run corrupt
+run "hit after corrupt"
+
+rm -rf $CACHE_DIR $CACHE_DIR.log
@@ -0,0 +1,33 @@
+# vim: ft=plasma
+# This is free and unencumbered software released into the public domain.
+# See ../LICENSE.unlicense
+
+module Channel_1
+
+export main
+
+import io
+
+func main() uses IO -> Int {
+    c = new_channel!(4)
+    send!(c, 3)
+    send!(c, 4)
+    a = recv!(c)
+    b = recv!(c)
+    print!("received " ++ int_to_string(a) ++ " and " ++
+        int_to_string(b) ++ "\n")
+
+    print_try_recv!(c)
+    send!(c, 5)
+    print_try_recv!(c)
+    return 0
+}
+
+func print_try_recv(c : Channel) uses IO {
+    ok, n = try_recv!(c)
+    if (ok) {
+        print!("try_recv: " ++ int_to_string(n) ++ "\n")
+    } else {
+        print!("try_recv: empty\n")
+    }
+}
@@ -0,0 +1,39 @@
+# vim: ft=plasma
+# This is free and unencumbered software released into the public domain.
+# See ../LICENSE.unlicense
+
+module Parallel_1
+
+export main
+
+import io
+
+func main() uses IO -> Int {
+    print!("fib(20) = " ++ int_to_string(fib(20)) ++ "\n")
+
+    a, b = fib_pair(18)
+    print!("fib_pair(18) = " ++ int_to_string(a) ++ ", " ++
+        int_to_string(b) ++ "\n")
+
+    # The second call needs the result of the first, so neither is
+    # spawned.
+    c = fib(12)
+    d = fib(c - 220)
+    print!("d = " ++ int_to_string(d) ++ "\n")
+    return 0
+}
+
+# Both calls are independent, the first is spawned and joined before the
+# addition.
+func fib(n : Int) -> Int {
+    if (n < 2) {
+        return 1
+    } else {
+        return fib(n-1) + fib(n-2)
+    }
+}
+
+# Independent elements of a tuple.
+func fib_pair(n : Int) -> (Int, Int) {
+    return fib(n), fib(n+1)
+}
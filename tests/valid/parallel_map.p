@@ -0,0 +1,27 @@
+# vim: ft=plasma
+# This is free and unencumbered software released into the public domain.
+# See ../LICENSE.unlicense
+
+module Parallel_Map
+
+export main
+
+import io
+
+func main() uses IO -> Int {
+    squares = parallel_map(square, array_range(1000))
+    print!("size: " ++ int_to_string(array_size(squares)) ++ "\n")
+    print!("squares[999]: " ++ int_to_string(array_get(squares, 999)) ++
+        "\n")
+    print!("sum of squares: " ++
+        int_to_string(parallel_reduce(add, squares, 0)) ++ "\n")
+
+    # Reducing an empty array returns the initial value.
+    print!("empty: " ++
+        int_to_string(parallel_reduce(add, array_range(0), 5)) ++ "\n")
+    return 0
+}
+
+func square(x : Int) -> Int { return x * x }
+
+func add(a : Int, b : Int) -> Int { return a + b }